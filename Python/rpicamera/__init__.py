@@ -6,6 +6,9 @@
 
 from . import util
 from . import streams
+from . import timestamps
+from . import files
+from . import index
 
 try:
     from . import camera
@@ -15,5 +18,8 @@ except ImportError:
 
 __all__ = ['util',
            'streams',
+           'timestamps',
+           'files',
+           'index',
            'camera',
            'controller']
@@ -15,13 +15,24 @@
 from __future__ import print_function
 
 import time
-import os
 import os.path as op
 import traceback
+import threading
+import socket
 
+try:
+    import Queue
+except ImportError:
+    import queue as Queue
+
+import numpy as np
 import picamera
 from picamera import mmal
 
+from .timestamps import TimestampWriter
+from .streams import BufferedFileOutput
+from .trace import tracer
+
 try:
     from RPi import GPIO
     GPIO.setmode(GPIO.BOARD)
@@ -31,6 +42,224 @@ except ImportError:
     print("Could not import RPi.GPIO module. Strobe capability not available.")
     GPIO_AVAILABLE = False
 
+try:
+    # hardware-timed (DMA) pulses via the pigpio daemon
+    import pigpio
+    PIGPIO_AVAILABLE = True
+
+except ImportError:
+    PIGPIO_AVAILABLE = False
+
+
+# "Board" pin -> BCM gpio (40-pin header) for pigpio
+BOARD_TO_BCM = {3: 2, 5: 3, 7: 4, 8: 14, 10: 15, 11: 17, 12: 18, 13: 27,
+                15: 22, 16: 23, 18: 24, 19: 10, 21: 9, 22: 25, 23: 11,
+                24: 8, 26: 7, 27: 0, 28: 1, 29: 5, 31: 6, 32: 12, 33: 13,
+                35: 19, 36: 16, 37: 26, 38: 20, 40: 21}
+
+
+class StrobeGenerator(threading.Thread):
+    """Generate strobe pulses on a separate thread
+
+        The encoder callback only enqueues the index of the finished frame so
+        that the MMAL output thread is never blocked by pulse generation.
+
+        Optionally, every barcode_interval frames the frame pulse is followed
+        by a barcode encoding the frame index (modulo 2**barcode_bits): one
+        pulse per bit, MSB first, and an even parity bit, with a short pulse
+        encoding 0 and a long pulse encoding 1. All bit pulses are shorter
+        than the frame pulse. The barcode must fit into a frame interval
+        (see duration; e.g., 16 bits take up to 12.9 ms, too long for 90 fps).
+
+        If the pigpio daemon is running (sudo pigpiod), pulses are timed by
+        DMA and their widths do not depend on the Python threads. Otherwise
+        pulses are timed in software (RPi.GPIO): the busy wait competes for
+        the GIL with the MMAL callback and zmq threads, which may stretch
+        bit pulses; the plugin ignores barcodes with parity errors or
+        implausible indices, but pigpio should be used for barcodes.
+
+        By default a frame pulse is sent as soon as the encoder callback of
+        its frame runs, which varies from frame to frame. With delay > 0
+        (seconds), it is sent delay after the sensor timestamp of the frame
+        instead (camera clock, requires clock_mode 'raw'), so that the
+        pulses, and the plugin's phase lock which locks on them, follow the
+        exposure of the frames. The delay has to exceed the latency of the
+        encoder callback; pulses that are already late when the callback
+        runs are sent immediately and counted (late_count).
+    """
+
+    def __init__(self, pin,
+                 pulse_width=0.001,
+                 barcode_interval=0,
+                 barcode_bits=16,
+                 bit_short=0.0002,
+                 bit_long=0.0005,
+                 bit_gap=0.0002,
+                 delay=0):
+
+        super(StrobeGenerator, self).__init__()
+
+        self.pin = pin
+        self.pulse_width = pulse_width
+        self.barcode_interval = barcode_interval
+        self.barcode_bits = barcode_bits
+        self.bit_short = bit_short
+        self.bit_long = bit_long
+        self.bit_gap = bit_gap
+        self.delay = delay
+
+        self.queue = Queue.Queue()
+        self.trigger_count = 0
+        self.late_count = 0
+        self.daemon = True
+
+        self.pi = None
+        if PIGPIO_AVAILABLE and pin in BOARD_TO_BCM:
+            pi = pigpio.pi()
+            if pi.connected:
+                self.pi = pi
+                self._create_waves()
+            else:
+                print("pigpio daemon not running -> software-timed strobe")
+
+    def duration(self):
+        """longest time (seconds) from the frame pulse to the end of the
+        barcode, including the gap after its last bit"""
+
+        if self.barcode_interval <= 0:
+            return self.pulse_width
+
+        return self.pulse_width + \
+            (self.barcode_bits + 1) * (self.bit_long + self.bit_gap)
+
+    def check_timing(self, framerate):
+        """raise ValueError if pulses and barcode do not fit into a frame"""
+
+        if self.duration() >= 1. / float(framerate):
+            raise ValueError('Barcode ({} bits, {:.1f} ms) does not fit into '
+                             'a frame interval at {} fps; use fewer bits'
+                             .format(self.barcode_bits, 1e3 * self.duration(),
+                                     float(framerate)))
+
+    def _create_waves(self):
+
+        gpio = BOARD_TO_BCM[self.pin]
+        mask = 1 << gpio
+        pi = self.pi
+
+        pi.set_mode(gpio, pigpio.OUTPUT)
+        pi.write(gpio, 0)
+        pi.wave_clear()
+
+        def create(width):
+            # high for width, then low for the gap before the next bit
+            high = int(round(1e6 * width))
+            low = int(round(1e6 * self.bit_gap))
+            pi.wave_add_generic([pigpio.pulse(mask, 0, high),
+                                 pigpio.pulse(0, mask, low)])
+            return pi.wave_create()
+
+        self.frame_wave = create(self.pulse_width)
+        self.bit_waves = (create(self.bit_short), create(self.bit_long))
+
+    def trigger(self, frame_index, pts=None, ets=None):
+        """called in the encoder callback with the frame's sensor timestamp
+        (pts) and the camera clock at the time of the callback (ets)"""
+
+        send_at = None
+        if self.delay > 0 and pts is not None and ets is not None and \
+                0 <= ets - pts < 1000000:
+            # camera clock (usec) -> local clock
+            send_at = time.time() + self.delay - (ets - pts) * 1e-6
+
+        self.queue.put_nowait((frame_index, send_at))
+
+    def stop_running(self):
+
+        self.queue.put_nowait(None)
+
+    def _wait(self, duration):
+
+        # time.sleep is too coarse for sub-millisecond pulses -> spin for the
+        # last millisecond (holding the GIL, see class docstring)
+        t_end = time.time() + duration
+        if duration > 0.002:
+            time.sleep(duration - 0.001)
+        while time.time() < t_end:
+            pass
+
+    def _remaining(self, send_at):
+
+        if send_at is None:
+            return 0
+
+        wait = send_at - time.time()
+        if wait <= 0:
+            self.late_count += 1
+
+        return wait
+
+    def _pulse(self, width):
+
+        GPIO.output(self.pin, True)
+        self._wait(width)
+        GPIO.output(self.pin, False)
+
+    def _barcode_bits(self, frame_index):
+        """bits of the barcode (MSB first) followed by the parity bit"""
+
+        value = frame_index % (1 << self.barcode_bits)
+        bits = [(value >> i) & 1 for i in range(self.barcode_bits - 1, -1, -1)]
+
+        return bits + [sum(bits) % 2]
+
+    def _send(self, frame_index, barcode, send_at):
+
+        if self.pi is not None:
+            waves = [self.frame_wave]
+            if barcode:
+                waves += [self.bit_waves[b]
+                          for b in self._barcode_bits(frame_index)]
+
+            # (only busy if the last barcode did not fit into a frame)
+            while self.pi.wave_tx_busy():
+                time.sleep(.0002)
+
+            # the delay is timed by DMA as well ("255 2 x y": x + 256 y usec)
+            wait = int(1e6 * self._remaining(send_at))
+            if wait > 0:
+                wait = min(wait, 65535)
+                waves = [255, 2, wait & 255, wait >> 8] + waves
+            self.pi.wave_chain(waves)
+
+        else:
+            wait = self._remaining(send_at)
+            if wait > 0:
+                self._wait(wait)
+            self._pulse(self.pulse_width)
+            if barcode:
+                for bit in self._barcode_bits(frame_index):
+                    self._wait(self.bit_gap)
+                    self._pulse(self.bit_long if bit else self.bit_short)
+
+    def run(self):
+
+        while True:
+
+            item = self.queue.get()
+            if item is None:
+                break
+
+            frame_index, send_at = item
+            barcode = self.barcode_interval > 0 and \
+                frame_index % self.barcode_interval == 0
+            self._send(frame_index, barcode, send_at)
+            self.trigger_count += 1
+
+        if self.pi is not None:
+            self.pi.wave_clear()
+            self.pi.stop()
+
 
 class VideoEncoderGPIO(picamera.PiVideoEncoder):
 
@@ -38,14 +267,13 @@ class VideoEncoderGPIO(picamera.PiVideoEncoder):
 
         super(VideoEncoderGPIO, self).__init__(*args, **kwargs)
 
-        self.strobe_pin = 11
+        self.strobe = None
         self.frame_count = 0
-        self.trigger_count = 0
         self.t_start = 0
 
-    def set_strobe_pin(self, p):
+    def set_strobe(self, strobe):
 
-        self.strobe_pin = p
+        self.strobe = strobe
 
     def start(self, output, motion_output=None):
 
@@ -57,7 +285,10 @@ class VideoEncoderGPIO(picamera.PiVideoEncoder):
 
         t_run = time.time() - self.t_start
         print("frame rate:", self.frame_count / t_run)
-        print("trigger signals:", self.trigger_count)
+        if self.strobe is not None:
+            print("trigger signals:", self.strobe.trigger_count)
+            if self.strobe.delay > 0:
+                print("late trigger signals:", self.strobe.late_count)
 
         super(VideoEncoderGPIO, self).close()
 
@@ -76,13 +307,8 @@ class VideoEncoderGPIO(picamera.PiVideoEncoder):
 
                 current_ts = self.parent.timestamp
 
-                if GPIO_AVAILABLE and self.strobe_pin is not None:
-
-                    GPIO.output(self.strobe_pin, True)
-                    time.sleep(0.001)
-                    GPIO.output(self.strobe_pin, False)
-
-                    self.trigger_count += 1
+                if self.strobe is not None:
+                    self.strobe.trigger(self.frame_count, buf.pts, current_ts)
 
                 if buf.pts < 0:
                     # this usually happens if the video quality is set to
@@ -90,19 +316,181 @@ class VideoEncoderGPIO(picamera.PiVideoEncoder):
                     # 20 to 25.
                     print("invalid time time stamp (buf.pts < 0):", buf.pts)
 
+                if self.frame_count == 0:
+                    tracer.instant('encoder', 'first frame')
+
                 self.parent.write_timestamps(buf.pts, current_ts)
+                self.parent.publish_frame(self.frame_count, buf.pts,
+                                          current_ts)
                 self.frame_count += 1
 
         return super(VideoEncoderGPIO, self)._callback_write(buf, **kwargs)
 
 
+class AnalysisOutput(object):
+    """pass the luma plane of unencoded frames to a list of handlers
+
+        The yuv frames are delivered by a spare splitter port; handlers are
+        called on the encoder thread as handler.process(luma, pts, ets)
+        with luma as a (height, width) uint8 array (padding removed).
+    """
+
+    def __init__(self, camera, handlers, resolution, get_pts=None):
+
+        width, height = resolution
+
+        # rows are padded to 32 (or, for splitter ports of some firmware
+        # versions, 16) pixels; the first frame tells which one applies
+        rows = (height + 15) & ~15
+        self.shapes = [(rows, (width + 31) & ~31), (rows, (width + 15) & ~15)]
+        self.shape = self.shapes[0]
+        self.frame_size = self.shape[0] * self.shape[1] * 3 // 2
+        self.resolution = (width, height)
+        self.handlers = list(handlers)
+        self.get_pts = get_pts
+        self.camera = camera
+        self.pending = bytearray()
+
+    def write(self, buf):
+
+        if self.shapes:
+            for rows, stride in self.shapes:
+                if len(buf) == rows * stride * 3 // 2:
+                    self.shape = (rows, stride)
+                    self.frame_size = len(buf)
+            self.shapes = None
+
+        # frames usually arrive in one piece
+        if self.pending or len(buf) < self.frame_size:
+            self.pending.extend(buf)
+            if len(self.pending) < self.frame_size:
+                return len(buf)
+            buf, self.pending = bytes(self.pending), bytearray()
+
+        luma = np.frombuffer(buf, dtype=np.uint8,
+                             count=self.shape[0] * self.shape[1])
+        width, height = self.resolution
+        luma = luma.reshape(self.shape)[:height, :width]
+
+        pts = self.get_pts() if self.get_pts is not None else None
+        ets = self.camera.timestamp
+
+        for handler in self.handlers:
+            try:
+                handler.process(luma, pts, ets)
+            except BaseException:
+                # one failing handler must not stop the others
+                traceback.print_exc()
+
+        return len(buf)
+
+    def flush(self):
+
+        for handler in self.handlers:
+            if hasattr(handler, 'flush'):
+                handler.flush()
+
+
+class RoiWriter(object):
+    """crop named regions of interest from unencoded frames
+
+        The GPU encoders cannot crop, so the regions are cut from the luma
+        plane of frames delivered by the analysis port (see
+        AnalysisOutput). Each region is resampled (nearest neighbour) to
+        its output size and appended to its own raw 8-bit file
+        (<base>_roi_<name>.gray) with a timestamp file next to it. Regions
+        are given as (name, (x, y, w, h), (width, height)) with normalized
+        coordinates relative to the recorded image (i.e., after zoom).
+
+        The files are not compressed (all splitter ports are in use, and
+        encoding on the CPU would not keep up): each region takes
+        width * height bytes per frame, e.g. 1.7 MB/s for 160x120 at 90
+        fps. They are written through a write-behind buffer (see
+        streams.BufferedFileOutput), so the analysis callback only copies
+        the cropped frame and never waits for the SD card unless the
+        buffer runs full.
+    """
+
+    # write-behind buffer and preallocation step of each region file
+    BUFFER_SIZE = 8 << 20
+    PREALLOCATE = 32 << 20
+
+    def __init__(self, camera, file_base, rois, resolution):
+
+        width, height = resolution
+
+        self.rois = []
+        for name, (x, y, w, h), (out_w, out_h) in rois:
+
+            # index arrays are computed once; cropping is a single gather
+            x0, w = x * width, max(1., w * width)
+            y0, h = y * height, max(1., h * height)
+            cols = (x0 + (np.arange(out_w) + .5) * w / out_w).astype(int)
+            lines = (y0 + (np.arange(out_h) + .5) * h / out_h).astype(int)
+            index = np.ix_(np.clip(lines, 0, height - 1),
+                           np.clip(cols, 0, width - 1))
+
+            path = '{}_roi_{}.gray'.format(file_base, name)
+            ts_file = TimestampWriter(op.splitext(path)[0] + '_timestamps.bin',
+                                      camera_id=socket.gethostname(),
+                                      clock_mode=camera.clock_mode,
+                                      framerate=float(camera.framerate),
+                                      resolution=(out_w, out_h))
+            print("Saving region", name, "to:", path)
+
+            output = BufferedFileOutput(path, buffer_size=self.BUFFER_SIZE,
+                                        preallocate=self.PREALLOCATE)
+            self.rois.append((index, output, ts_file))
+
+    def process(self, luma, pts, ets):
+
+        for index, f, ts_file in self.rois:
+            # (the gather returns a new contiguous array)
+            f.write(luma[index].reshape(-1))
+            ts_file.write(pts if pts is not None else -1, ets)
+
+    def flush(self):
+
+        for _, f, _ in self.rois:
+            f.flush()
+
+    def close(self):
+
+        for _, f, ts_file in self.rois:
+            f.close()
+            ts_file.close()
+        self.rois = []
+
+
 class CameraGPIO(picamera.PiCamera):
+    """Camera sending strobe pulses and writing timestamps while recording
+
+        The recording uses splitter port 1; an optional low-resolution live
+        stream (see start_stream) is encoded on splitter port 2 and still
+        images (see capture_snapshot) are taken from splitter port 3, both
+        without affecting the recording. Unencoded frames of splitter port
+        0 are shared by the region writer (see start_rois) and the
+        exposure monitor (see set_exposure_monitor).
+    """
+
+    ANALYSIS_PORT = 0
+    RECORDING_PORT = 1
+    STREAM_PORT = 2
+    SNAPSHOT_PORT = 3
+
+    # frame size for the exposure monitor without regions of interest
+    ANALYSIS_RESOLUTION = (160, 120)
 
     def __init__(self,
                  framerate=30.,
                  resolution=(640, 480),
                  clock_mode='raw',
                  strobe_pin=11,
+                 barcode_interval=0,
+                 barcode_bits=16,
+                 strobe_delay=0,
+                 write_buffer=64,
+                 intra_period=0,
                  **kwargs):
 
         super(CameraGPIO, self).__init__(framerate=framerate,
@@ -120,56 +508,296 @@ class CameraGPIO(picamera.PiCamera):
                   " to ", self.framerate)
 
         self.ts_file = None
+        self.frame_count = 0
 
+        # write-behind buffer of the video file (MB; 0: picamera writes)
+        self.write_buffer = write_buffer
+        self.video_output = None
+
+        # frames between key frames of the recording and the live stream
+        # (0: encoder default for recordings, one second for the stream)
+        self.intra_period = intra_period
+        self.buffer_callback = None
+        self.buffer_stats = None
+        self.frame_callback = None
+        self._creating_stream = False
+        self.roi_writer = None
+        self.exposure_monitor = None
+
+        self.strobe = None
         if GPIO_AVAILABLE and self.strobe_pin is not None:
             print("Camera: setting GPIO strobe pin ", self.strobe_pin)
             GPIO.setup(self.strobe_pin, GPIO.OUT)
             GPIO.output(self.strobe_pin, False)
 
+            # (strobe delay in ms after the sensor timestamp, 0: callback)
+            self.strobe = StrobeGenerator(self.strobe_pin,
+                                          barcode_interval=barcode_interval,
+                                          barcode_bits=barcode_bits,
+                                          delay=1e-3 * strobe_delay)
+            self.strobe.check_timing(self.framerate)
+            self.strobe.start()
+
     def __del__(self):
 
+        if getattr(self, 'strobe', None) is not None:
+            self.strobe.stop_running()
+
         if GPIO_AVAILABLE:
             GPIO.cleanup()
 
     def _get_video_encoder(self, *args, **kwargs):
 
+        if self._creating_stream:
+            # live stream and regions: no strobe pulses or timestamps
+            return super(CameraGPIO, self)._get_video_encoder(*args, **kwargs)
+
         encoder = VideoEncoderGPIO(self, *args, **kwargs)
-        encoder.set_strobe_pin(self.strobe_pin)
+        encoder.set_strobe(self.strobe)
 
         return encoder
 
+    @property
+    def recording_video(self):
+        """recording to file (the live stream does not count)"""
+
+        encoder = self._encoders.get(self.RECORDING_PORT)
+        return encoder is not None and encoder.active
+
+    @property
+    def streaming(self):
+
+        encoder = self._encoders.get(self.STREAM_PORT)
+        return encoder is not None and encoder.active
+
+    def start_stream(self, output, resize=None, bitrate=500000):
+        """encode a second (e.g., downscaled) h264 stream on its own port"""
+
+        intra_period = self.intra_period
+        if intra_period <= 0:
+            intra_period = max(1, int(round(float(self.framerate))))
+
+        self._creating_stream = True
+        try:
+            # joining clients also request a key frame (see StreamServer)
+            super(CameraGPIO, self).start_recording(
+                output,
+                format='h264',
+                resize=resize,
+                bitrate=bitrate,
+                inline_headers=True,
+                intra_period=intra_period,
+                splitter_port=self.STREAM_PORT)
+        finally:
+            self._creating_stream = False
+
+    def stop_stream(self):
+
+        if self.streaming:
+            super(CameraGPIO, self).stop_recording(
+                splitter_port=self.STREAM_PORT)
+
+    def request_stream_key_frame(self):
+
+        if self.streaming:
+            self.request_key_frame(splitter_port=self.STREAM_PORT)
+
+    def request_key_frames(self, stream=True, recording=True):
+        """IDR frame with the next frame of the active encoders
+
+            Returns the number of encoders asked for a key frame.
+        """
+
+        count = 0
+        if stream and self.streaming:
+            self.request_key_frame(splitter_port=self.STREAM_PORT)
+            count += 1
+        if recording and self.recording_video:
+            self.request_key_frame(splitter_port=self.RECORDING_PORT)
+            count += 1
+
+        return count
+
+    @property
+    def analysing(self):
+
+        encoder = self._encoders.get(self.ANALYSIS_PORT)
+        return encoder is not None and encoder.active
+
+    def start_analysis(self):
+        """(re)start the analysis port for the current handlers
+
+            Frames are only needed at full resolution for the regions of
+            interest; the exposure monitor alone runs on downscaled frames.
+        """
+
+        self.stop_analysis()
+
+        handlers = [h for h in (self.roi_writer, self.exposure_monitor)
+                    if h is not None]
+        if not handlers:
+            return
+
+        resolution = tuple(self.resolution)
+        resize = None
+        if self.roi_writer is None:
+            width, height = self.ANALYSIS_RESOLUTION
+            if resolution[0] > width and resolution[1] > height:
+                resolution = resize = (width, height)
+
+        def get_pts():
+            encoder = self._encoders.get(self.ANALYSIS_PORT)
+            frame = getattr(encoder, 'frame', None)
+            return frame.timestamp if frame is not None else None
+
+        output = AnalysisOutput(self, handlers, resolution, get_pts)
+
+        self._creating_stream = True
+        try:
+            super(CameraGPIO, self).start_recording(
+                output,
+                format='yuv',
+                resize=resize,
+                splitter_port=self.ANALYSIS_PORT)
+        finally:
+            self._creating_stream = False
+
+    def stop_analysis(self):
+
+        if self.analysing:
+            super(CameraGPIO, self).stop_recording(
+                splitter_port=self.ANALYSIS_PORT)
+
+    def set_exposure_monitor(self, monitor):
+        """ExposureMonitor fed by the analysis port (None: off)"""
+
+        self.exposure_monitor = monitor
+        self.start_analysis()
+
+    def start_rois(self, file_base, rois):
+        """record regions of interest alongside the recording"""
+
+        if not rois:
+            return
+
+        self.roi_writer = RoiWriter(self, file_base, rois,
+                                    tuple(self.resolution))
+        self.start_analysis()
+
+    def stop_rois(self):
+
+        if self.roi_writer is not None:
+            roi_writer, self.roi_writer = self.roi_writer, None
+            self.start_analysis()
+            roi_writer.close()
+
+    def capture_snapshot(self, output, quality=90):
+        """jpeg image at the current camera resolution
+
+            Returns the camera timestamp (usec, same clock as the frame
+            timestamps) read just before the capture. The image is the next
+            frame delivered by the splitter port, i.e. it was exposed at
+            most about one frame period after this timestamp (encoding the
+            jpeg takes longer, so a timestamp read afterwards would be tens
+            of ms late).
+        """
+
+        timestamp = self.timestamp
+
+        self.capture(output,
+                     format='jpeg',
+                     use_video_port=True,
+                     splitter_port=self.SNAPSHOT_PORT,
+                     quality=quality)
+
+        return timestamp
+
     def start_recording(self, output, **kwargs):
 
-        ts_path = op.splitext(output)[0] + '_timestamps.csv'
+        if self.strobe is not None:
+            # (the frame rate may have changed since __init__)
+            self.strobe.check_timing(self.framerate)
+
+        ts_path = op.splitext(output)[0] + '_timestamps.bin'
+        self.frame_count = 0
+
         try:
-            self.ts_file = open(ts_path, 'w')
-            self.ts_file.write('# frame timestamp, TTL timestamp\n')
+            self.ts_file = TimestampWriter(ts_path,
+                                           camera_id=socket.gethostname(),
+                                           clock_mode=self.clock_mode,
+                                           framerate=float(self.framerate),
+                                           resolution=self.resolution)
             print("Saving timestamps to:", ts_path)
 
         except BaseException:
             print("Could not open time stamp file:", ts_path)
             traceback.print_exc()
 
-        super(CameraGPIO, self).start_recording(output, **kwargs)
+        if self.write_buffer > 0:
+            # the encoder thread must never wait for the SD card
+            self.video_output = BufferedFileOutput(
+                output,
+                buffer_size=int(self.write_buffer * (1 << 20)),
+                status_callback=self._buffer_status)
+            output = self.video_output
 
-    def stop_recording(self):
+        if self.intra_period > 0:
+            # denser key frames for seeking in the recorded file
+            kwargs.setdefault('intra_period', self.intra_period)
 
-        if self.ts_file is not None:
+        with tracer.span('encoder', 'start encoder'):
+            super(CameraGPIO, self).start_recording(
+                output, splitter_port=self.RECORDING_PORT, **kwargs)
 
-            # make sure all (buffered) data are being written
-            self.ts_file.flush()
-            os.fsync(self.ts_file.fileno())
+    def _buffer_status(self, stats):
 
-            self.ts_file.close()
-            self.ts_file = None
+        self.buffer_stats = stats
+        if self.buffer_callback is not None:
+            self.buffer_callback(stats)
+
+    def stop_recording(self):
+
+        try:
+            self.stop_rois()
+        except BaseException:
+            traceback.print_exc()
 
         try:
             # catch "ValueError: I/O operation on closed file" exception
-            super(CameraGPIO, self).stop_recording()
+            with tracer.span('encoder', 'stop encoder'):
+                super(CameraGPIO, self).stop_recording(
+                    splitter_port=self.RECORDING_PORT)
         except BaseException:
             traceback.print_exc()
 
+        if self.video_output is not None:
+            # waits for the buffered data to be written
+            self.video_output.close()
+            self.video_output = None
+
+            stats = self.buffer_stats
+            print("Write buffer: high water {:.1f} of {:.0f} MB, {} stalls,"
+                  " longest write {:.0f} ms".format(
+                      stats['high_water'] / 1048576.,
+                      stats['buffer_size'] / 1048576.,
+                      stats['stalls'], 1000 * stats['max_write_time']))
+
+        if self.ts_file is not None:
+
+            # writes all buffered records to disk
+            self.ts_file.close()
+            self.ts_file = None
+
     def write_timestamps(self, pts, ets):
 
+        self.frame_count += 1
+
         if self.ts_file is not None:
-            self.ts_file.write("{},{}\n".format(pts, ets))
+            self.ts_file.write(pts, ets)
+
+    def publish_frame(self, index, pts, ets):
+
+        if self.frame_callback is not None:
+            if pts is None:
+                pts = -1
+            self.frame_callback(index, pts, ets)
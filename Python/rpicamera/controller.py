@@ -16,22 +16,203 @@ from __future__ import print_function
 
 import os
 import os.path as op
+import io
 import time
+import contextlib
 import traceback
 import json
 import threading
 import zmq
+import picamera
+
+try:
+    import Queue
+except ImportError:
+    import queue as Queue
 
 from .camera import CameraGPIO
+from .exposure import ExposureMonitor
+from .streams import StreamServer
+from .trace import tracer
+
+
+def frame_url(url):
+    """endpoint on which frames are published for a command endpoint
+
+        tcp endpoints use the following port, ipc/inproc endpoints the
+        suffix ".frames" (see RPiCamProtocol::frameUrl in the plugin)
+    """
+
+    if url.startswith('tcp://'):
+        host, port = url[6:].rsplit(':', 1)
+        return 'tcp://{}:{}'.format(host, int(port) + 1)
+
+    return url + '.frames'
+
+
+class JobWorker(threading.Thread):
+    """Execute camera commands one after another in submission order
+
+        Commands that reconfigure the camera must not overlap and must be
+        applied in the order they were sent (e.g., Resolution before
+        Framerate), hence a single worker thread. Progress and completion
+        notices are handed back to the socket thread via an inproc socket
+        as zmq sockets must not be shared between threads.
+    """
+
+    def __init__(self, context, notify_url):
+
+        super(JobWorker, self).__init__()
+
+        self.context = context
+        self.notify_url = notify_url
+        self.queue = Queue.Queue()
+        self.daemon = True
+
+    def submit(self, job_id, func, envelope=None):
+        """queue func (job_id None: no job notices, only the reply)"""
+
+        self.queue.put((job_id, func, envelope))
+
+    def stop_running(self):
+
+        self.queue.put(None)
+
+    def run(self):
+
+        notify = self.context.socket(zmq.PUSH)
+        notify.connect(self.notify_url)
+
+        while True:
+
+            item = self.queue.get()
+            if item is None:
+                break
+
+            job_id, func, envelope = item
+
+            if job_id is None and envelope is None:
+                # internal task (e.g. refreshing query results): no notices
+                try:
+                    func()
+                except BaseException:
+                    traceback.print_exc()
+                continue
+
+            if job_id is not None:
+                notify.send_multipart(['running', str(job_id), '0', ''])
+
+            try:
+                result = func()
+                state = 'done'
+            except BaseException:
+                traceback.print_exc()
+                result = 'Failed'
+                state = 'failed'
+
+            if result is None:
+                result = ''
+
+            # (reply, data, ...): binary frames following the reply
+            data = []
+            if isinstance(result, (list, tuple)):
+                result, data = result[0], list(result[1:])
+
+            # (no job id: only the deferred reply, see _handle_job_notice)
+            job_id = '' if job_id is None else str(job_id)
+            frames = [state, job_id, str(len(data)), str(result)] + data
+            if envelope is not None:
+                frames.extend(envelope)
+            notify.send_multipart(frames, copy=False)
+
+        notify.close()
+
+
+class Notifier(object):
+    """Publish messages on the ZmqThread's pub socket from any thread
+
+        Each calling thread gets its own push socket (zmq sockets must not be
+        shared between threads); messages are forwarded by the ZmqThread.
+    """
+
+    def __init__(self, context, url):
+
+        self.context = context
+        self.url = url
+        self.local = threading.local()
+
+    def send(self, msg):
+
+        socket = getattr(self.local, 'socket', None)
+        if socket is None:
+            socket = self.context.socket(zmq.PUSH)
+            socket.connect(self.url)
+            self.local.socket = socket
+
+        try:
+            socket.send(msg, zmq.NOBLOCK)
+        except zmq.Again:
+            # never block the caller (e.g., the encoder thread)
+            pass
 
 
 class ZmqThread(threading.Thread):
     """Handle communication with an open-ephys plugin (or any other zmq client)
 
+        Commands arrive on a router socket so that cheap queries (status,
+        capabilities, telemetry, job state) are answered immediately while
+        camera commands are queued on a worker thread. Commands that may take
+        seconds (e.g., settling gains) are acknowledged with a job ID right
+        away; all other camera commands are answered once they have been
+        executed. Results of camera commands may contain binary frames
+        (e.g., the jpeg data of a snapshot) which are appended to the reply
+        without copying. Job progress and completion notices are published on a
+        separate pub socket ("Job <id> <state> <result>"), together with
+        messages from other threads sent via a Notifier (e.g., "Frame <index>
+        <pts> <ets>" for every recorded frame).
+
+        If a file_server is given, recorded files can be pulled over the same
+        socket (see files.py). Chunks are served directly; checksums of whole
+        files are computed on a separate worker so that they neither block
+        the socket nor delay camera commands.
+
+        Any number of clients can connect, but only one controls the camera:
+        camera commands take (or renew) an exclusive lease for the sending
+        client, which expires unless it is renewed ("Lease [<seconds>]
+        [<name>]", e.g. as heartbeat) and can be given up ("Release").
+        Commands of other clients are answered with "Leased <holder>
+        <remaining seconds>" without being executed. Further connections
+        of a client with the identity "<client identity>/<name>" (e.g. the
+        plugin's snapshot connection) share the client's lease. Queries and file
+        requests are always answered, and status and telemetry are
+        published once per second ("Status <json>", "Telemetry <json>"), so
+        that read-only clients can follow a camera without using the
+        command path at all.
     """
 
+    # commands that are acknowledged with a job ID before they are executed
+    JOB_COMMANDS = ['ResetGains', 'Resolution', 'Framerate', 'Lighting']
+
+    # commands that never touch the camera and are answered immediately
+    QUERY_COMMANDS = ['Status', 'Capabilities', 'Telemetry', 'Trace']
+
+    # queries answered from results computed on the worker thread (the
+    # camera must not be read while a command reconfigures it)
+    CACHED_QUERIES = ['Status', 'Capabilities', 'Telemetry']
+
+    # data retrieval (only ListFiles is answered immediately)
+    FILE_COMMANDS = ['ListFiles', 'ReadChunk', 'Checksum']
+
+    # seconds until the controlling client's lease expires
+    LEASE_TIMEOUT = 30.
+
+    # seconds between published status and telemetry messages
+    PUBLISH_INTERVAL = 1.
+
     def __init__(self, start_callback, stop_callback, close_callback,
-                 parameter_callback):
+                 parameter_callback, query_callback=None,
+                 file_server=None, port=5555, notify_port=5556,
+                 url=None, notify_url=None):
 
         super(ZmqThread, self).__init__()
 
@@ -39,12 +220,55 @@ class ZmqThread(threading.Thread):
         self.stop_callback = stop_callback
         self.close_callback = close_callback
         self.parameter_callback = parameter_callback
-
-        self.url = 'tcp://*:5555'
+        self.query_callback = query_callback
+        self.file_server = file_server
+
+        # ipc:// (or inproc://) endpoints can be used instead of tcp ports
+        # when the plugin runs on the same machine (or in the same process)
+        if url is None:
+            url = 'tcp://*:{}'.format(port)
+            if notify_url is None:
+                notify_url = 'tcp://*:{}'.format(notify_port)
+        elif notify_url is None:
+            notify_url = frame_url(url)
+
+        self.url = url
+        self.notify_url = notify_url
         self.context = zmq.Context()
-        self.socket = self.context.socket(zmq.REP)
+
+        self.socket = self.context.socket(zmq.ROUTER)
+        if hasattr(zmq, 'ROUTER_HANDOVER'):
+            # a client that reconnects with the same identity (e.g. after
+            # an error) keeps its lease; late replies to its old socket are
+            # discarded by the client (ZMQ_REQ_CORRELATE)
+            self.socket.setsockopt(zmq.ROUTER_HANDOVER, 1)
         self.socket.bind(self.url)
 
+        self.publisher = self.context.socket(zmq.PUB)
+        self.publisher.bind(self.notify_url)
+
+        self.worker_url = 'inproc://rpicamera-jobs'
+        self.worker_socket = self.context.socket(zmq.PULL)
+        self.worker_socket.bind(self.worker_url)
+        self.worker = JobWorker(self.context, self.worker_url)
+        self.file_worker = JobWorker(self.context, self.worker_url)
+
+        self.notice_url = 'inproc://rpicamera-notices'
+        self.notice_socket = self.context.socket(zmq.PULL)
+        self.notice_socket.bind(self.notice_url)
+
+        self.jobs = {}
+        self.next_job_id = 1
+
+        # latest query_callback results (see _refresh_queries)
+        self.query_cache = {}
+        self._refresh_pending = False
+
+        # identity and name of the controlling client
+        self.lease_holder = None
+        self.lease_name = None
+        self.lease_expiry = 0
+
         self.is_running = False
         self.daemon = True
 
@@ -52,98 +276,455 @@ class ZmqThread(threading.Thread):
 
         self.is_running = False
 
-    def run(self):
+    def create_notifier(self):
 
-        self.is_running = True
+        return Notifier(self.context, self.notice_url)
 
-        socket = self.socket
+    def _submit(self, func, envelope=None, worker=None):
 
-        while self.is_running:
+        if worker is None:
+            worker = self.worker
 
-            msg = socket.recv()
-            parts = msg.split()
-            cmd = parts[0]
-            if cmd == 'Start':
+        job_id = self.next_job_id
+        self.next_job_id += 1
 
-                experiment = 0
-                recording = 1
-                path = None
+        self.jobs[job_id] = 'queued'
+        worker.submit(job_id, func, envelope)
+        self.publisher.send('Job {} queued'.format(job_id))
 
-                for p in parts[1:]:
-                    name, value = p.split('=')
-                    if name == 'Experiment':
-                        experiment = int(value)
-                    elif name == 'Recording':
-                        recording = int(value)
-                    elif name == 'Path':
-                        path = value
+        return job_id
 
-                rec_path = self.start_callback(experiment, recording, path)
+    def _reply(self, envelope, msg):
 
-                if rec_path is None:
-                    rec_path = ''
+        self.socket.send_multipart(envelope + [msg])
 
-                socket.send(rec_path)
+    def _handle_file_command(self, envelope, msg):
 
-            elif cmd == 'Stop':
+        server = self.file_server
 
-                self.parameter_callback('Stop', None)
-                socket.send('Stopped')
+        if server is None:
+            self._reply(envelope, 'Not handled')
 
-            elif cmd == 'Close':
+        elif msg.split()[0] == 'Checksum':
+            self._submit(lambda: server.handle(msg)[0], envelope=envelope,
+                         worker=self.file_worker)
 
-                self.parameter_callback('Close', None)
-                socket.send('Closing')
-                break
+        elif msg.split()[0] == 'ReadChunk':
+            # read from the SD card without blocking the socket thread; the
+            # chunk follows the reply as a data frame (no job notices, as a
+            # transfer consists of many chunks)
+            self.file_worker.submit(None, lambda: server.handle(msg),
+                                    envelope)
+
+        else:
+            try:
+                frames = server.handle(msg)
+            except BaseException:
+                traceback.print_exc()
+                frames = ['Failed']
+
+            self.socket.send_multipart(envelope + frames)
+
+    def _handle_job_notice(self, frames):
+
+        state, job_id, num_data, result = [f.bytes for f in frames[:4]]
+        data = frames[4:4 + int(num_data)]
+        envelope = frames[4 + int(num_data):]
+
+        if job_id:
+            self.jobs[int(job_id)] = state
+            self.publisher.send('Job {} {} {}'.format(job_id, state,
+                                                      result).strip())
+
+            if state != 'running':
+                # the command may have changed the camera settings
+                self._refresh_queries()
+
+        if len(envelope) > 0:
+            # deferred reply for a command executed on the worker thread;
+            # data frames are passed on as they are
+            self.socket.send_multipart(envelope + [result] + data,
+                                       copy=False)
+
+        return state != 'running' and result == 'Closing'
+
+    def _parse_start(self, parts):
+
+        experiment = 0
+        recording = 1
+        path = None
+
+        for p in parts[1:]:
+            name, value = p.split('=')
+            if name == 'Experiment':
+                experiment = int(value)
+            elif name == 'Recording':
+                recording = int(value)
+            elif name == 'Path':
+                path = value
+
+        def func():
+            rec_path = self.start_callback(experiment, recording, path)
+            if rec_path is None:
+                rec_path = ''
+            return rec_path
+
+        return func
+
+    def _parse_command(self, parts):
+        """return a function executing the command (or None if unknown)"""
+
+        cmd = parts[0]
+        callback = self.parameter_callback
+
+        def call(name, value, reply):
+            def func():
+                callback(name, value)
+                return reply
+            return func
+
+        if cmd == 'Start':
+            return self._parse_start(parts)
+
+        elif cmd == 'Stop':
+            return call('Stop', None, 'Stopped')
+
+        elif cmd == 'Close':
+            return call('Close', None, 'Closing')
+
+        elif cmd == 'Resolution':
+            width = int(parts[1])
+            height = int(parts[2])
+            return call('Resolution', (width, height), 'Done')
+
+        elif cmd == 'Framerate':
+            return call('Framerate', float(parts[1]), 'Done')
+
+        elif cmd == 'FramerateDelta':
+            # fine adjustment by the plugin's phase lock (also while recording)
+            return call('FramerateDelta', float(parts[1]), 'Done')
+
+        elif cmd == 'ResetGains':
+            return call('ResetGains', None, 'Done')
+
+        elif cmd == 'Lighting':
+            return call('Lighting', parts[1], 'Done')
+
+        elif cmd == 'VFlip':
+            return call('VFlip', int(parts[1]) > 0, 'Done')
+
+        elif cmd == 'HFlip':
+            return call('HFlip', int(parts[1]) > 0, 'Done')
+
+        elif cmd == 'Zoom':
+            return call('Zoom', [float(p) for p in parts[1:]], 'Done')
+
+        elif cmd == 'Stream':
+            # width height bitrate (width 0: off)
+            return call('Stream', [int(p) for p in parts[1:4]], 'Done')
+
+        elif cmd == 'Rois':
+            # <name>:<x>,<y>,<w>,<h>,<width>,<height> ... (none: off)
+            rois = []
+            for p in parts[1:]:
+                name, values = p.split(':', 1)
+                values = values.split(',')
+                rois.append((name,
+                             tuple(float(v) for v in values[:4]),
+                             (int(values[4]), int(values[5]))))
+            return call('Rois', rois, 'Done')
+
+        elif cmd == 'Exposure':
+            # interval [x y w h] (interval 0: off)
+            region = [float(p) for p in parts[2:6]]
+            return call('Exposure',
+                        (int(parts[1]), region if len(region) == 4 else None),
+                        'Done')
+
+        elif cmd == 'ExposureControl':
+            # target max_saturation min_shutter max_shutter (target 0: off)
+            return call('ExposureControl',
+                        [float(p) for p in parts[1:5]], 'Done')
+
+        elif cmd == 'IntraPeriod':
+            # frames between key frames (0: default)
+            return call('IntraPeriod', int(parts[1]), 'Done')
+
+        elif cmd == 'RequestKeyframe':
+            # [Stream|Recording] (default: both)
+            target = parts[1] if len(parts) > 1 else None
+            def func():
+                count = callback('RequestKeyframe', target)
+                return 'Keyframe {}'.format(count or 0)
+            return func
+
+        elif cmd == 'Snapshot':
+            # reply: "Snapshot <camera timestamp> <unix time>" + jpeg data
+            def func():
+                return callback('Snapshot', None)
+            return func
+
+        return None
+
+    def _lease_info(self):
+
+        remaining = self.lease_expiry - time.time()
+        if self.lease_holder is None or remaining <= 0:
+            return None
+
+        return {'holder': self.lease_name, 'remaining': round(remaining, 1)}
+
+    @staticmethod
+    def _lease_identity(envelope):
+        """identity of the client a connection belongs to"""
+
+        identity = envelope[0] if len(envelope) > 0 else b''
+
+        # (identities generated by zmq start with a zero byte)
+        if not identity.startswith(b'\x00'):
+            identity = identity.split(b'/', 1)[0]
+
+        return identity
+
+    def _acquire_lease(self, identity, timeout=None, name=None):
+        """None if the client holds the lease (now), else the reply"""
+
+        now = time.time()
+
+        if (self.lease_holder is not None and self.lease_holder != identity
+                and now < self.lease_expiry):
+            return 'Leased {} {:.1f}'.format(self.lease_name,
+                                             self.lease_expiry - now)
+
+        if self.lease_holder != identity or name is not None:
+            if name is None:
+                name = 'client-' + ''.join('{:02x}'.format(c)
+                                           for c in bytearray(identity))
+            if self.lease_holder != identity:
+                print("Lease: controlled by", name)
+            self.lease_name = name
+
+        self.lease_holder = identity
+        self.lease_expiry = now + (self.LEASE_TIMEOUT if timeout is None
+                                   else timeout)
+
+        return None
+
+    def _handle_lease(self, envelope, parts):
+
+        identity = self._lease_identity(envelope)
+
+        if parts[0] == 'Release':
+            if self.lease_holder == identity:
+                print("Lease: released by", self.lease_name)
+                self.lease_holder = None
+                self.lease_name = None
+            return 'Released'
+
+        timeout = float(parts[1]) if len(parts) > 1 else None
+        name = '_'.join(parts[2:]) if len(parts) > 2 else None
+
+        denied = self._acquire_lease(identity, timeout, name)
+        if denied is not None:
+            return denied
+
+        return 'Lease {:g}'.format(self.lease_expiry - time.time())
+
+    def _update_queries(self):
+        """compute the cached query results (on the worker thread)"""
+
+        try:
+            for cmd in self.CACHED_QUERIES:
+                self.query_cache[cmd] = self.query_callback(cmd)
+        finally:
+            self._refresh_pending = False
+
+    def _refresh_queries(self):
+        """update the cached query results after the queued commands"""
+
+        if self.query_callback is not None and not self._refresh_pending:
+            self._refresh_pending = True
+            self.worker.submit(None, self._update_queries)
+
+    def _format_query(self, cmd, info):
+
+        if cmd == 'Status':
+            info = dict(info, lease=self._lease_info())
+        return json.dumps(info)
+
+    def _publish_status(self):
+
+        for cmd in ['Status', 'Telemetry']:
+            info = self.query_cache.get(cmd)
+            if info is not None:
+                self.publisher.send('{} {}'.format(
+                    cmd, self._format_query(cmd, info)))
+
+        self._refresh_queries()
 
-            elif cmd == 'Resolution':
+    def _handle_query(self, parts):
+        """reply to a query (None: has to be answered by the worker)"""
 
-                width = int(parts[1])
-                height = int(parts[2])
-                self.parameter_callback('Resolution', (width, height))
-                socket.send("Done")
+        cmd = parts[0]
 
-            elif cmd == 'Framerate':
+        if cmd == 'Job':
+            state = self.jobs.get(int(parts[1]), 'unknown')
+            return 'Job {} {}'.format(parts[1], state)
 
-                fps = float(parts[1])
-                self.parameter_callback('Framerate', fps)
-                socket.send("Done")
+        if cmd == 'Trace':
+            return tracer.format()
 
-            elif cmd == 'ResetGains':
+        if self.query_callback is not None:
+            info = self.query_cache.get(cmd)
+            if info is None:
+                # not computed yet (e.g. right after start-up)
+                return None
+            return self._format_query(cmd, info)
 
-                self.parameter_callback('ResetGains', None)
-                socket.send("Done")
+        return 'Not handled'
 
-            elif cmd == 'VFlip':
+    def _query_on_worker(self, cmd):
 
-                self.parameter_callback('VFlip', int(parts[1]) > 0)
-                socket.send("Done")
+        return self._format_query(cmd, self.query_callback(cmd))
 
-            elif cmd == 'HFlip':
+    def _with_config_version(self, version, func):
+        """record the client's settings version before executing func"""
 
-                self.parameter_callback('HFlip', int(parts[1]) > 0)
-                socket.send("Done")
+        callback = self.parameter_callback
 
-            elif cmd == 'Zoom':
+        def wrapped():
+            callback('ConfigVersion', version)
+            return func()
 
-                self.parameter_callback('Zoom', [float(p) for p in parts[1:]])
-                socket.send("Done")
+        return wrapped
+
+    def _handle_message(self, frames):
+
+        envelope, msg = frames[:-1], frames[-1]
+        parts = msg.split()
+
+        # version of the client's settings the command was sent with
+        config_version = None
+        if len(parts) > 1 and parts[-1].startswith('Cfg='):
+            config_version = parts.pop()[len('Cfg='):]
+
+        if len(parts) == 0:
+            self._reply(envelope, 'Not handled')
+
+        elif parts[0] in self.QUERY_COMMANDS or parts[0] == 'Job':
+            reply = self._handle_query(parts)
+            if reply is None:
+                cmd = parts[0]
+                self._submit(lambda: self._query_on_worker(cmd),
+                             envelope=envelope)
+            else:
+                self._reply(envelope, reply)
+
+        elif parts[0] in self.FILE_COMMANDS:
+            self._handle_file_command(envelope, msg)
+
+        elif parts[0] in ['Lease', 'Release']:
+            self._reply(envelope, self._handle_lease(envelope, parts))
+
+        else:
+            func = self._parse_command(parts)
+
+            if func is None:
+                self._reply(envelope, 'Not handled')
+                return
+
+            # camera commands only from the controlling client
+            denied = self._acquire_lease(self._lease_identity(envelope))
+            if denied is not None:
+                self._reply(envelope, denied)
+                return
+
+            if config_version is not None:
+                func = self._with_config_version(config_version, func)
+
+            # one span per command (from the start of its execution)
+            func = tracer.traced('command', parts[0], func)
+
+            if parts[0] in self.JOB_COMMANDS:
+                job_id = self._submit(func)
+                self._reply(envelope, 'Job {}'.format(job_id))
 
             else:
-                socket.send("Not handled")
+                self._submit(func, envelope=envelope)
+
+    def run(self):
+
+        self.is_running = True
+        self.worker.start()
+        self.file_worker.start()
+
+        poller = zmq.Poller()
+        poller.register(self.socket, zmq.POLLIN)
+        poller.register(self.worker_socket, zmq.POLLIN)
+        poller.register(self.notice_socket, zmq.POLLIN)
+
+        next_publish = time.time()
+
+        while self.is_running:
+
+            events = dict(poller.poll(250))
+
+            if time.time() >= next_publish:
+                next_publish = time.time() + self.PUBLISH_INTERVAL
+                self._publish_status()
+
+            if self.worker_socket in events:
+                frames = self.worker_socket.recv_multipart(copy=False)
+                if self._handle_job_notice(frames):
+                    break
+
+            if self.notice_socket in events:
+                self.publisher.send(self.notice_socket.recv())
+
+            if self.socket in events:
+                self._handle_message(self.socket.recv_multipart())
+
+        self.worker.stop_running()
+        self.file_worker.stop_running()
 
 
 class Controller(object):
 
-    def __init__(self, data_path, **kwargs):
+    def __init__(self, data_path, stream_port=5557, **kwargs):
 
         super(Controller, self).__init__()
 
         self.data_path = data_path
         self.closed = False
 
+        # optional low-resolution live stream (width, height, bitrate)
+        self.stream_port = stream_port
+        self.stream_settings = None
+        self.stream_server = None
+
+        # regions of interest recorded as separate files (see RoiWriter)
+        self.rois = []
+
+        # exposure statistics (see ExposureMonitor)
+        self.exposure_monitor = None
+
+        # exposure and write buffer notices for the plugin
+        self.notify_callback = None
+
+        # settings version of the plugin's last command (see ZmqThread)
+        self.config_version = None
+
+        # settled AWB gains and exposure per (sensor mode, lighting preset)
+        self.lighting = 'default'
+        self.warmup = 2.
+        self.fix_awb_gains = True
+        self.fix_exposure_speed = True
+        self._gains_cache = {}
+        self._gains_fixed = False
+
         try:
             self.camera = CameraGPIO(**kwargs)
+            self.camera.buffer_callback = self._publish_buffer
 
         except BaseException:
             traceback.print_exc()
@@ -153,6 +734,20 @@ class Controller(object):
 
         self.cleanup()
 
+    def set_frame_callback(self, callback):
+        """callback(index, pts, ets) called on the encoder thread per frame"""
+
+        if self.camera is not None:
+            self.camera.frame_callback = callback
+
+    def set_notify_callback(self, callback):
+        """callback(msg) with exposure and write buffer notices
+
+            Called on the encoder and writer threads.
+        """
+
+        self.notify_callback = callback
+
     @property
     def framerate(self):
 
@@ -162,8 +757,24 @@ class Controller(object):
     @framerate.setter
     def framerate(self, fps):
 
-        if self.camera is not None and not self.camera.recording:
-            self.camera.framerate = fps
+        if self.camera is not None and not self.camera.recording_video:
+            with self._stream_stopped():
+                self.camera.framerate = fps
+            self._restore_gains()
+
+    @property
+    def framerate_delta(self):
+
+        if self.camera is not None:
+            return float(self.camera.framerate_delta)
+
+    @framerate_delta.setter
+    def framerate_delta(self, delta):
+
+        if self.camera is not None:
+            # resolution is 1/256 Hz; larger changes are done via framerate
+            limit = .02 * float(self.camera.framerate)
+            self.camera.framerate_delta = max(-limit, min(limit, delta))
 
     @property
     def resolution(self):
@@ -174,8 +785,10 @@ class Controller(object):
     @resolution.setter
     def resolution(self, xy):
 
-        if self.camera is not None and not self.camera.recording:
-            self.camera.resolution = xy
+        if self.camera is not None and not self.camera.recording_video:
+            with self._stream_stopped():
+                self.camera.resolution = xy
+            self._restore_gains()
 
     @property
     def vflip(self):
@@ -186,7 +799,7 @@ class Controller(object):
     @vflip.setter
     def vflip(self, status):
 
-        if self.camera is not None and not self.camera.recording:
+        if self.camera is not None and not self.camera.recording_video:
             self.camera.vflip = status
 
     @property
@@ -198,7 +811,7 @@ class Controller(object):
     @hflip.setter
     def hflip(self, status):
 
-        if self.camera is not None and not self.camera.recording:
+        if self.camera is not None and not self.camera.recording_video:
             self.camera.hflip = status
 
     @property
@@ -214,11 +827,57 @@ class Controller(object):
             if len(coords) == 4 and min(coords) >= 0 and max(coords) <= 1:
                 self.camera.zoom = coords
 
+    def query(self, name):
+        """information returned for Status/Capabilities/Telemetry requests"""
+
+        cam = self.camera
+        info = {}
+
+        if cam is None or self.closed:
+            info['camera'] = 'not available'
+
+        elif name == 'Status':
+            info = {'recording': cam.recording_video,
+                    'previewing': cam.previewing,
+                    'width': cam.resolution.width,
+                    'height': cam.resolution.height,
+                    'framerate': float(cam.framerate),
+                    'framerate_delta': float(cam.framerate_delta),
+                    'lighting': self.lighting,
+                    'stream': self.stream_settings,
+                    'intra_period': cam.intra_period,
+                    'config_version': self.config_version,
+                    'rois': [r[0] for r in self.rois],
+                    'exposure': self._exposure_settings()}
+
+        elif name == 'Capabilities':
+            info = {'sensor': cam.revision,
+                    'max_width': cam.MAX_RESOLUTION.width,
+                    'max_height': cam.MAX_RESOLUTION.height,
+                    'max_framerate': float(cam.MAX_FRAMERATE),
+                    'gpio_strobe': cam.strobe_pin is not None}
+
+        elif name == 'Telemetry':
+            info = {'frame_count': cam.frame_count,
+                    'recording': cam.recording_video,
+                    'cached_gains': len(self._gains_cache),
+                    'stream_bytes': getattr(self.stream_server, 'size', 0),
+                    'write_buffer': cam.buffer_stats}
+
+        return info
+
     def cleanup(self):
 
         if self.camera is not None:
 
-            if self.camera.recording:
+            if self.camera.streaming:
+                print("Controller: stopping stream")
+                self.camera.stop_stream()
+
+            if self.camera.analysing:
+                self.camera.stop_analysis()
+
+            if self.camera.recording_video:
                 print("Controller: stopping recording ")
                 self.camera.stop_recording()
 
@@ -234,8 +893,269 @@ class Controller(object):
             del self.camera
             self.camera = None
 
+        if self.stream_server is not None:
+            self.stream_server.close()
+            self.stream_server = None
+
         self.closed = True
 
+    def _gains_key(self):
+
+        # with sensor_mode 0 the firmware picks the mode from resolution and
+        # frame rate, so both are part of the key
+        cam = self.camera
+        return (cam.sensor_mode,
+                tuple(cam.resolution),
+                float(cam.framerate),
+                self.lighting)
+
+    def _settle_gains(self, warmup):
+
+        self.camera.awb_mode = 'auto'
+        self.camera.exposure_mode = 'auto'
+
+        # a shutter time fixed by an earlier settle (or the exposure control)
+        # would otherwise limit auto exposure and end up in the cache
+        self.camera.shutter_speed = 0
+
+        # wait for camera to "warm up"
+        with tracer.span('camera', 'settle gains'):
+            time.sleep(warmup)
+
+        gains = {'awb_gains': self.camera.awb_gains,
+                 'shutter_speed': self.camera.exposure_speed,
+                 'analog_gain': self.camera.analog_gain,
+                 'digital_gain': self.camera.digital_gain}
+        self._apply_gains(gains)
+
+        return gains
+
+    def _apply_gains(self, gains):
+
+        if self.fix_awb_gains:
+            print("fixing awb gains:", gains['awb_gains'])
+            self.camera.awb_mode = 'off'
+            self.camera.awb_gains = gains['awb_gains']
+
+        if self.fix_exposure_speed:
+            self.camera.shutter_speed = gains['shutter_speed']
+
+            # analog/digital gains are only writable with picamera >= 1.13
+            # and recent firmware; otherwise they settle to the same values
+            for name in ['analog_gain', 'digital_gain']:
+                try:
+                    setattr(self.camera, name, gains[name])
+                except (AttributeError, picamera.PiCameraError):
+                    pass
+
+            self.camera.exposure_mode = 'off'
+
+    def _restore_gains(self):
+        """reapply cached gains after a mode switch (settle only once per mode)"""
+
+        if self.camera is None or not self._gains_fixed:
+            return
+
+        key = self._gains_key()
+        gains = self._gains_cache.get(key)
+
+        if gains is not None:
+            print("reapplying cached gains for", key)
+            self._apply_gains(gains)
+        else:
+            print("no cached gains for", key, "-> settling")
+            self._gains_cache[key] = self._settle_gains(self.warmup)
+
+    def _start_stream(self):
+
+        if self.camera is None or self.stream_settings is None:
+            return
+
+        width, height, bitrate = self.stream_settings
+
+        if self.stream_server is None:
+            self.stream_server = StreamServer(
+                self.stream_port,
+                connect_callback=self.camera.request_stream_key_frame)
+            print("Live stream on port", self.stream_port)
+
+        self.camera.start_stream(self.stream_server,
+                                 resize=(width, height),
+                                 bitrate=bitrate)
+
+    @contextlib.contextmanager
+    def _stream_stopped(self):
+        """the camera mode can only be changed with all encoders stopped"""
+
+        with tracer.span('camera', 'reconfigure'):
+            streaming = self.camera.streaming
+            if streaming:
+                self.camera.stop_stream()
+            analysing = self.camera.analysing
+            if analysing:
+                self.camera.stop_analysis()
+            try:
+                yield
+            finally:
+                if analysing:
+                    # frame size follows the new resolution
+                    self.camera.start_analysis()
+                if streaming:
+                    self._start_stream()
+
+    def set_stream(self, width, height, bitrate=500000):
+        """live stream in addition to the recording (width <= 0: off)"""
+
+        if self.camera is None:
+            return
+
+        self.camera.stop_stream()
+
+        if width <= 0 or height <= 0:
+            self.stream_settings = None
+        else:
+            self.stream_settings = (int(width), int(height), int(bitrate))
+            self._start_stream()
+
+    def set_intra_period(self, frames):
+        """frames between key frames (0: default)
+
+            Applied to the live stream right away and to the next recording.
+        """
+
+        if self.camera is None:
+            return
+
+        self.camera.intra_period = max(0, int(frames))
+
+        if self.camera.streaming:
+            self.camera.stop_stream()
+            self._start_stream()
+
+        if self.camera.recording_video:
+            print("Intra period applies to the next recording")
+
+    def request_key_frame(self, target=None):
+        """key frame of the stream and/or the recording ("Stream",
+        "Recording", None: both)"""
+
+        if self.camera is None:
+            return 0
+
+        return self.camera.request_key_frames(
+            stream=target in (None, 'Stream'),
+            recording=target in (None, 'Recording'))
+
+    def set_rois(self, rois):
+        """list of (name, (x, y, w, h), (width, height)) for the next recording
+
+            Coordinates are normalized and relative to the recorded image.
+        """
+
+        valid = []
+        for name, rect, size in rois:
+            name = ''.join(c for c in name if c.isalnum() or c in '-_')
+            x, y, w, h = [min(1., max(0., float(v))) for v in rect]
+            width, height = [int(v) for v in size]
+            if name and w > 0 and h > 0 and width > 0 and height > 0:
+                valid.append((name, (x, y, w, h), (width, height)))
+
+        self.rois = valid
+
+        if self.camera is not None and self.camera.recording_video:
+            print("Regions of interest will be used for the next recording")
+
+    def _publish_exposure(self, *summary):
+
+        if self.notify_callback is not None:
+            self.notify_callback(ExposureMonitor.format(*summary))
+
+    def _publish_buffer(self, stats):
+
+        if self.notify_callback is not None:
+            self.notify_callback(
+                'Buffer {fill} {high_water} {buffer_size} {stalls} '
+                '{max_write_time:.4f}'.format(**stats))
+
+    def _exposure_settings(self):
+
+        monitor = self.exposure_monitor
+        if monitor is None:
+            return None
+
+        return {'interval': monitor.interval,
+                'region': monitor.region,
+                'target': monitor.target,
+                'max_saturation': monitor.max_saturation,
+                'min_shutter': monitor.min_shutter,
+                'max_shutter': monitor.max_shutter}
+
+    def set_exposure_monitor(self, interval, region=None):
+        """exposure summary of every n-th frame (interval <= 0: off)
+
+            The region (normalized x, y, w, h relative to the recorded
+            image) restricts the statistics, e.g. to the eye.
+        """
+
+        if self.camera is None:
+            return
+
+        if interval <= 0:
+            self.exposure_monitor = None
+            self.camera.set_exposure_monitor(None)
+            return
+
+        if self.exposure_monitor is None:
+            self.exposure_monitor = ExposureMonitor(
+                self.camera, callback=self._publish_exposure)
+            self.exposure_monitor.interval = max(1, int(interval))
+            self.exposure_monitor.set_region(region)
+            self.camera.set_exposure_monitor(self.exposure_monitor)
+        else:
+            # picked up by the running monitor
+            self.exposure_monitor.interval = max(1, int(interval))
+            self.exposure_monitor.set_region(region)
+
+    def set_exposure_control(self, target, max_saturation=.01,
+                             min_shutter=100, max_shutter=0):
+        """bounded shutter control on top of the fixed gains (target 0: off)
+
+            Requires the exposure monitor and fixed exposure (see
+            start_preview); the settled shutter time is used as a start.
+        """
+
+        if self.exposure_monitor is None:
+            print("Exposure control requires the exposure monitor")
+            return
+
+        self.exposure_monitor.set_control(target=target,
+                                          max_saturation=max_saturation,
+                                          min_shutter=min_shutter,
+                                          max_shutter=max_shutter)
+
+    def snapshot(self, quality=90):
+        """still image via a spare splitter port (also while recording)
+
+            Returns the reply "Snapshot <camera timestamp> <unix time>" and
+            the jpeg data.
+        """
+
+        if self.camera is None:
+            return 'Failed'
+
+        output = io.BytesIO()
+        unix_time = time.time()
+        cam_time = self.camera.capture_snapshot(output, quality=quality)
+
+        return ('Snapshot {} {:.6f}'.format(cam_time, unix_time),
+                output.getvalue())
+
+    def set_lighting(self, preset):
+
+        if preset != self.lighting:
+            self.lighting = preset
+            self._restore_gains()
+
     def start_preview(self,
                       warmup=2.,
                       fix_awb_gains=True,
@@ -244,23 +1164,14 @@ class Controller(object):
 
         if self.camera is not None:
 
-            self.camera.awb_mode = 'auto'
-            self.camera.exposure_mode = 'auto'
+            self.warmup = warmup
+            self.fix_awb_gains = fix_awb_gains
+            self.fix_exposure_speed = fix_exposure_speed
 
             self.camera.start_preview(**kwargs)
 
-            # wait for camera to "warm up"
-            time.sleep(warmup)
-
-            if fix_awb_gains:
-                gains = self.camera.awb_gains
-                print("fixing awb gains:", gains)
-                self.camera.awb_mode = 'off'
-                self.camera.awb_gains = gains
-
-            if fix_exposure_speed:
-                self.camera.shutter_speed = self.camera.exposure_speed
-                self.camera.exposure_mode = 'off'
+            self._gains_cache[self._gains_key()] = self._settle_gains(warmup)
+            self._gains_fixed = fix_awb_gains or fix_exposure_speed
 
     def reset_gains(self,
                     warmup=2.,
@@ -269,13 +1180,19 @@ class Controller(object):
 
         if self.camera is not None:
 
-            if self.camera.recording:
+            if self.camera.recording_video:
                 self.camera.stop_recording()
 
             was_previewing = self.camera.previewing
             if self.camera.previewing:
                 self.camera.stop_preview()
 
+            # lighting has changed -> gains cached for other sensor modes
+            # using the same preset are stale as well
+            for key in list(self._gains_cache.keys()):
+                if key[-1] == self.lighting:
+                    del self._gains_cache[key]
+
             if was_previewing:
                 self.start_preview(warmup=warmup,
                                    fix_awb_gains=fix_awb_gains,
@@ -284,8 +1201,7 @@ class Controller(object):
     def start_recording(self, filename='rpicamera_video', experiment=0,
                         recording=1, path='None', quality=23):
 
-        # TODO: add network stream output
-        if self.camera is not None and not self.camera.recording:
+        if self.camera is not None and not self.camera.recording_video:
 
             rec_datetime = path.split(op.sep)[-1]
             name = '{}_experiment_{}_recording_{}'.format(rec_datetime,
@@ -309,7 +1225,16 @@ class Controller(object):
                       'video_path': video_path,
                       'width': self.camera.resolution.width,
                       'height': self.camera.resolution.height,
-                      'framerate': float(self.camera.framerate)}
+                      'framerate': float(self.camera.framerate),
+                      'intra_period': self.camera.intra_period,
+                      'config_version': self.config_version,
+                      'rois': [{'name': name,
+                                'rect': list(rect),
+                                'width': size[0],
+                                'height': size[1],
+                                'path': '{}_roi_{}.gray'.format(file_base,
+                                                                name)}
+                               for name, rect, size in self.rois]}
 
             with open(param_file, 'w') as f:
                 json.dump(params, f, indent=4,
@@ -320,6 +1245,12 @@ class Controller(object):
                                         format='h264',
                                         quality=quality)
 
+            try:
+                self.camera.start_rois(file_base, self.rois)
+            except BaseException:
+                # the main recording continues
+                traceback.print_exc()
+
         else:
             rec_path = None
 
@@ -327,7 +1258,7 @@ class Controller(object):
 
     def stop_recording(self):
 
-        if self.camera is not None and self.camera.recording:
+        if self.camera is not None and self.camera.recording_video:
 
             print("Controller: stopping recording")
             self.camera.stop_recording()
@@ -0,0 +1,150 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Author: Arne F. Meyer <arne.f.meyer@gmail.com>
+# License: GPLv3
+
+"""
+    Announce the camera host on the local network.
+
+    The open-ephys plugin ("Find" button) broadcasts a "Discover" datagram
+    to the discovery port and every host answers with
+
+        "Announce <port> <camera id> <sensor>"
+
+    The same message is broadcast periodically so that hosts can also be
+    found by listening on the discovery port (see discover()).
+"""
+
+from __future__ import print_function
+
+import select
+import socket
+import threading
+import time
+
+
+DISCOVERY_PORT = 5554
+
+
+def _create_socket(port=0):
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+    sock.bind(('', port))
+
+    return sock
+
+
+def parse_announcement(msg):
+    """(port, camera id, sensor) or None"""
+
+    fields = msg.decode('utf-8', 'replace').split()
+    if len(fields) < 2 or fields[0] != 'Announce':
+        return None
+
+    try:
+        port = int(fields[1])
+    except ValueError:
+        return None
+
+    camera_id = fields[2] if len(fields) > 2 else ''
+    sensor = fields[3] if len(fields) > 3 else ''
+
+    return port, camera_id, sensor
+
+
+class Announcer(threading.Thread):
+    """answer discovery requests and broadcast the host's command port"""
+
+    def __init__(self, port=5555, camera_id=None, sensor='unknown',
+                 interval=5., discovery_port=DISCOVERY_PORT):
+
+        super(Announcer, self).__init__()
+
+        if camera_id is None:
+            camera_id = socket.gethostname()
+
+        # ids and sensor names are sent as single tokens
+        self.message = 'Announce {} {} {}'.format(
+            port, '_'.join(camera_id.split()) or 'rpicamera',
+            '_'.join(str(sensor).split()) or 'unknown').encode('utf-8')
+
+        self.interval = interval
+        self.discovery_port = discovery_port
+        self.socket = _create_socket(discovery_port)
+
+        self.is_running = False
+        self.daemon = True
+
+    def stop_running(self):
+
+        self.is_running = False
+
+    def run(self):
+
+        self.is_running = True
+        next_announcement = 0
+
+        while self.is_running:
+
+            now = time.time()
+            if self.interval > 0 and now >= next_announcement:
+                try:
+                    self.socket.sendto(self.message,
+                                       ('<broadcast>', self.discovery_port))
+                except socket.error:
+                    # e.g. no network (yet)
+                    pass
+                next_announcement = now + self.interval
+
+            readable, _, _ = select.select([self.socket], [], [], .5)
+            if not readable:
+                continue
+
+            try:
+                msg, sender = self.socket.recvfrom(512)
+            except socket.error:
+                continue
+
+            # announcements of other hosts are received as well
+            if msg.strip() == b'Discover':
+                try:
+                    self.socket.sendto(self.message, sender)
+                except socket.error:
+                    pass
+
+        self.socket.close()
+
+
+def discover(timeout=1., discovery_port=DISCOVERY_PORT):
+    """list of (address, port, camera id, sensor) of hosts on the network"""
+
+    sock = _create_socket()
+    hosts = []
+
+    try:
+        sock.sendto(b'Discover', ('<broadcast>', discovery_port))
+
+        t_end = time.time() + timeout
+        while True:
+
+            remaining = t_end - time.time()
+            if remaining <= 0:
+                break
+
+            readable, _, _ = select.select([sock], [], [], remaining)
+            if not readable:
+                break
+
+            msg, sender = sock.recvfrom(512)
+            info = parse_announcement(msg)
+            if info is not None:
+                host = (sender[0],) + info
+                if host not in hosts:
+                    hosts.append(host)
+    finally:
+        sock.close()
+
+    return hosts
@@ -0,0 +1,169 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Author: Arne F. Meyer <arne.f.meyer@gmail.com>
+# License: GPLv3
+
+"""
+    Exposure statistics and a bounded shutter controller.
+
+    The monitor gets the luma plane of unencoded frames (see
+    camera.AnalysisOutput), computes a histogram of the metering region
+    every n-th frame and passes a summary to a callback. The host publishes
+    it as
+
+        "Exposure <frame> <mean> <saturated> <dark> <shutter> <analog gain>
+         <digital gain> <target> <bin 0> ... <bin 31>"
+
+    The optional controller only changes the shutter time (gains stay
+    fixed) and is deliberately slow: the mean has to leave a deadband
+    around the target, steps are limited and every change is followed by a
+    few updates without changes so that the effect can be measured first.
+"""
+
+from __future__ import print_function
+
+import numpy as np
+
+
+class ExposureMonitor(object):
+
+    BINS = 32
+    SATURATED = 250
+    DARK = 5
+
+    # at most ~160 x 120 pixels are used for the statistics
+    MAX_PIXELS = 20000
+
+    def __init__(self, camera=None, interval=1, region=None, callback=None):
+
+        self.camera = camera
+        self.callback = callback
+        self.interval = max(1, int(interval))
+        self.region = None
+        self.set_region(region)
+
+        self.target = 0
+        self.max_saturation = .01
+        self.min_shutter = 100
+        self.max_shutter = None
+        self.deadband = .1
+        self.max_step = .1
+        self.settle_updates = 3
+
+        self.count = 0
+        self.hold = 0
+
+    def set_region(self, region):
+        """normalized (x, y, w, h) of the metered part (None: whole image)"""
+
+        if region is None:
+            self.region = None
+        else:
+            x, y, w, h = [min(1., max(0., float(v))) for v in region]
+            self.region = (x, y, w, h) if w > 0 and h > 0 else None
+
+    def set_control(self, target=0, max_saturation=.01, min_shutter=100,
+                    max_shutter=None):
+        """keep the mean luma close to target (0: off) via the shutter time
+
+            The shutter time (usec) stays within [min_shutter, max_shutter]
+            and below the frame period. The exposure is reduced whenever
+            more than max_saturation of the pixels are saturated.
+        """
+
+        self.target = min(254., max(0., float(target)))
+        self.max_saturation = max(0., float(max_saturation))
+        self.min_shutter = max(1, int(min_shutter))
+        self.max_shutter = int(max_shutter) if max_shutter else None
+        self.hold = 0
+
+    def summarize(self, luma):
+        """(mean, saturated fraction, dark fraction, histogram)"""
+
+        height, width = luma.shape
+        if self.region is not None:
+            x, y, w, h = self.region
+            x0, y0 = int(x * width), int(y * height)
+            luma = luma[y0:max(y0 + 1, int((y + h) * height)),
+                        x0:max(x0 + 1, int((x + w) * width))]
+
+        step = int(np.ceil(np.sqrt(luma.size / float(self.MAX_PIXELS))))
+        if step > 1:
+            luma = luma[::step, ::step]
+
+        counts = np.bincount(luma.ravel(), minlength=256)
+        n = max(1, luma.size)
+
+        mean = np.dot(counts, np.arange(256)) / float(n)
+        saturated = counts[self.SATURATED:].sum() / float(n)
+        dark = counts[:self.DARK + 1].sum() / float(n)
+        hist = counts.reshape(self.BINS, -1).sum(axis=1)
+
+        return mean, saturated, dark, hist
+
+    def process(self, luma, pts, ets):
+
+        self.count += 1
+        if (self.count - 1) % self.interval:
+            return
+
+        mean, saturated, dark, hist = self.summarize(luma)
+
+        if self.target > 0 and self.camera is not None:
+            self._control(mean, saturated)
+
+        if self.callback is not None:
+            cam = self.camera
+            if cam is not None:
+                gains = (cam.exposure_speed, float(cam.analog_gain),
+                         float(cam.digital_gain))
+            else:
+                gains = (0, 0., 0.)
+            self.callback(self.count - 1, mean, saturated, dark,
+                          gains, self.target, hist)
+
+    def _control(self, mean, saturated):
+
+        cam = self.camera
+        if cam.exposure_mode != 'off':
+            # exposure is not fixed (auto exposure does the job)
+            return
+
+        if self.hold > 0:
+            self.hold -= 1
+            return
+
+        ratio = self.target / max(1., mean)
+        if saturated > self.max_saturation:
+            ratio = min(ratio, 1. - self.max_step)
+        elif abs(ratio - 1.) < self.deadband:
+            return
+        elif ratio > 1. and saturated > .5 * self.max_saturation:
+            # no brighter exposure close to the saturation limit (otherwise
+            # the two rules would alternate)
+            return
+
+        max_shutter = int(1e6 / float(cam.framerate))
+        if self.max_shutter is not None:
+            max_shutter = min(max_shutter, self.max_shutter)
+
+        current = cam.shutter_speed or cam.exposure_speed
+        ratio = min(1. + self.max_step, max(1. - self.max_step, ratio))
+        shutter = int(min(max_shutter, max(self.min_shutter,
+                                           current * ratio)))
+
+        if shutter != current:
+            cam.shutter_speed = shutter
+            self.hold = self.settle_updates
+
+    @staticmethod
+    def format(frame, mean, saturated, dark, gains, target, hist):
+        """message published on the host's pub socket"""
+
+        shutter, analog_gain, digital_gain = gains
+        fmt = 'Exposure {} {:.2f} {:.5f} {:.5f} {} {:.3f} {:.3f} {:g} {}'
+
+        return fmt.format(frame, mean, saturated, dark, shutter, analog_gain,
+                          digital_gain, target,
+                          ' '.join(str(int(c)) for c in hist))
@@ -0,0 +1,120 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Author: Arne F. Meyer <arne.f.meyer@gmail.com>
+# License: GPLv3
+
+"""
+    Serve recorded files to the open-ephys plugin.
+
+    The plugin pulls the files of a recording over its command connection
+    (see ZmqThread) instead of a separate scp step:
+
+        "ListFiles <dir>"                  -> JSON list of {name, size}
+        "ReadChunk <offset> <size> <file>" -> ["Chunk <offset> <n> <crc>", data]
+        "Checksum <length> <file>"         -> CRC-32 (hex) of the first
+                                              <length> bytes (-1: all)
+
+    Transfers are resumable: the client checks the CRC of a partially copied
+    file against the same range on the RPi and continues at its end. Only
+    files below the data root can be accessed.
+"""
+
+from __future__ import print_function
+
+import io
+import json
+import os
+import os.path as op
+import zlib
+
+
+MAX_CHUNK_SIZE = 4 * 1024 * 1024
+CHECKSUM_BLOCK_SIZE = 1024 * 1024
+
+
+def crc32(data, value=0):
+
+    # zlib.crc32 returns a signed value on python 2
+    return zlib.crc32(data, value) & 0xffffffff
+
+
+class FileServer(object):
+
+    def __init__(self, root):
+
+        self.root = op.realpath(op.expanduser(root))
+
+    def _resolve(self, path):
+
+        path = op.realpath(op.expanduser(path))
+        if path != self.root and not path.startswith(self.root + op.sep):
+            raise ValueError('not in data path: {}'.format(path))
+
+        return path
+
+    def list_files(self, path):
+
+        path = self._resolve(path)
+
+        files = []
+        for name in sorted(os.listdir(path)):
+            f = op.join(path, name)
+            if op.isfile(f):
+                files.append({'name': name, 'size': op.getsize(f)})
+
+        return files
+
+    def read_chunk(self, path, offset, size):
+
+        path = self._resolve(path)
+        size = max(0, min(size, MAX_CHUNK_SIZE))
+
+        with io.open(path, 'rb') as f:
+            f.seek(offset)
+            data = f.read(size)
+
+        return data, crc32(data)
+
+    def checksum(self, path, length=-1):
+
+        path = self._resolve(path)
+
+        value = 0
+        with io.open(path, 'rb') as f:
+            remaining = length
+            while remaining != 0:
+                n = CHECKSUM_BLOCK_SIZE
+                if remaining > 0:
+                    n = min(n, remaining)
+
+                data = f.read(n)
+                if len(data) == 0:
+                    break
+
+                value = crc32(data, value)
+                if remaining > 0:
+                    remaining -= len(data)
+
+        return '{:08x}'.format(value)
+
+    def handle(self, msg):
+        """return the reply frames for a file command"""
+
+        cmd = msg.split(None, 1)[0]
+
+        if cmd == 'ListFiles':
+            path = msg.split(None, 1)[1]
+            return [json.dumps(self.list_files(path))]
+
+        elif cmd == 'ReadChunk':
+            _, offset, size, path = msg.split(None, 3)
+            data, crc = self.read_chunk(path, int(offset), int(size))
+            header = 'Chunk {} {} {:08x}'.format(offset, len(data), crc)
+            return [header, data]
+
+        elif cmd == 'Checksum':
+            _, length, path = msg.split(None, 2)
+            return [self.checksum(path, int(length))]
+
+        return ['Not handled']
@@ -0,0 +1,276 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Author: Arne F. Meyer <arne.f.meyer@gmail.com>
+# License: GPLv3
+
+"""
+    Index of open-ephys recordings with RPi camera data.
+
+    Scanning a data tree means opening every kwik/nwb/binary/openephys event
+    file, which is slow for thousands of sessions. The index stores the
+    RPiCam RecPath events of each event file together with the video,
+    timestamp and parameter files found in its recording directory in a
+    small sqlite database (by default in the root of the data tree).
+
+    Updates are incremental: only event files that are new, or whose size or
+    modification time (or that of their recording directory) have changed,
+    are parsed again; these are read in parallel by a process pool.
+
+    Example:
+
+        index = SessionIndex('/data/experiments')
+        index.update()
+        for s in index.sessions(address='192.168.0.10'):
+            print(s['recording_path'], s['remote_path'], s['videos'])
+"""
+
+from __future__ import print_function
+
+import os
+import os.path as op
+import sqlite3
+import traceback
+
+from . import util
+
+
+INDEX_FILE = '.rpicamera_index.sqlite'
+SCHEMA_VERSION = 1
+
+SCHEMA = [
+    """CREATE TABLE IF NOT EXISTS event_files (
+           id INTEGER PRIMARY KEY,
+           filepath TEXT UNIQUE,
+           format TEXT,
+           recording_path TEXT,
+           mtime REAL,
+           size INTEGER,
+           dir_mtime REAL)""",
+    """CREATE TABLE IF NOT EXISTS sessions (
+           event_file_id INTEGER,
+           address TEXT,
+           remote_path TEXT)""",
+    """CREATE TABLE IF NOT EXISTS videos (
+           event_file_id INTEGER,
+           video TEXT,
+           timestamps TEXT,
+           parameters TEXT)""",
+    "CREATE INDEX IF NOT EXISTS sessions_file ON sessions (event_file_id)",
+    "CREATE INDEX IF NOT EXISTS sessions_address ON sessions (address)",
+    "CREATE INDEX IF NOT EXISTS videos_file ON videos (event_file_id)",
+]
+
+
+def _message_file(event_file):
+    """the file that actually contains the messages of an event file"""
+
+    if event_file['format'] == 'openephys':
+        return op.join(event_file['recording_path'], 'messages.events')
+
+    return event_file['filepath']
+
+
+def _signature(event_file):
+
+    st = os.stat(_message_file(event_file))
+    dir_mtime = op.getmtime(event_file['recording_path'])
+
+    return st.st_mtime, st.st_size, dir_mtime
+
+
+def _scan_event_file(event_file):
+    """parse one event file (runs in a worker process)"""
+
+    try:
+        signature = _signature(event_file)
+    except OSError:
+        # deleted in the meantime
+        return event_file, None, [], []
+
+    try:
+        messages = util.load_messages_from_event_file(event_file)
+        remote_data = util.parse_messages(messages, verbose=False)
+        videos = util.get_video_files(event_file['recording_path'],
+                                      recursive=True)
+
+    except BaseException:
+        # unreadable files are indexed without sessions (and parsed again
+        # once they change)
+        traceback.print_exc()
+        return event_file, signature, [], []
+
+    return event_file, signature, remote_data, videos
+
+
+class SessionIndex(object):
+
+    def __init__(self, root, index_file=None, workers=4):
+
+        self.root = op.abspath(op.expanduser(root))
+        self.workers = workers
+
+        if index_file is None:
+            index_file = op.join(self.root, INDEX_FILE)
+        self.index_file = index_file
+
+        self.db = sqlite3.connect(index_file)
+        self._create_schema()
+
+    def _create_schema(self):
+
+        version = self.db.execute('PRAGMA user_version').fetchone()[0]
+        if version != SCHEMA_VERSION:
+            for table in ['event_files', 'sessions', 'videos']:
+                self.db.execute('DROP TABLE IF EXISTS ' + table)
+
+        for stmt in SCHEMA:
+            self.db.execute(stmt)
+
+        self.db.execute('PRAGMA user_version = {}'.format(SCHEMA_VERSION))
+        self.db.commit()
+
+    def close(self):
+
+        if self.db is not None:
+            self.db.close()
+            self.db = None
+
+    def _remove(self, file_id):
+
+        self.db.execute('DELETE FROM sessions WHERE event_file_id = ?',
+                        (file_id,))
+        self.db.execute('DELETE FROM videos WHERE event_file_id = ?',
+                        (file_id,))
+        self.db.execute('DELETE FROM event_files WHERE id = ?', (file_id,))
+
+    def _insert(self, event_file, signature, remote_data, videos):
+
+        mtime, size, dir_mtime = signature
+        cur = self.db.execute(
+            'INSERT INTO event_files (filepath, format, recording_path, '
+            'mtime, size, dir_mtime) VALUES (?, ?, ?, ?, ?, ?)',
+            (event_file['filepath'], event_file['format'],
+             event_file['recording_path'], mtime, size, dir_mtime))
+        file_id = cur.lastrowid
+
+        self.db.executemany(
+            'INSERT INTO sessions (event_file_id, address, remote_path) '
+            'VALUES (?, ?, ?)',
+            [(file_id, d['address'], d['path']) for d in remote_data])
+
+        self.db.executemany(
+            'INSERT INTO videos (event_file_id, video, timestamps, '
+            'parameters) VALUES (?, ?, ?, ?)',
+            [(file_id, v['video'], v['timestamps'], v['parameters'])
+             for v in videos])
+
+    def update(self, verbose=False):
+        """rescan new and modified event files; returns number of scanned files"""
+
+        known = {}
+        for row in self.db.execute('SELECT id, filepath, mtime, size, '
+                                   'dir_mtime FROM event_files'):
+            known[row[1]] = (row[0], tuple(row[2:]))
+
+        event_files = util.get_event_files(self.root, verbose=False)
+
+        changed = []
+        for ef in event_files:
+            entry = known.pop(ef['filepath'], None)
+            try:
+                signature = _signature(ef)
+            except OSError:
+                continue
+
+            if entry is None or entry[1] != signature:
+                changed.append(ef)
+
+        # event files that have been deleted (or changed)
+        for file_id, _ in known.values():
+            self._remove(file_id)
+
+        if self.workers > 1 and len(changed) > 1:
+            from multiprocessing import Pool
+
+            pool = Pool(processes=min(self.workers, len(changed)))
+            try:
+                results = pool.map(_scan_event_file, changed)
+            finally:
+                pool.close()
+                pool.join()
+        else:
+            results = [_scan_event_file(ef) for ef in changed]
+
+        for event_file, signature, remote_data, videos in results:
+
+            row = self.db.execute('SELECT id FROM event_files WHERE '
+                                  'filepath = ?',
+                                  (event_file['filepath'],)).fetchone()
+            if row is not None:
+                self._remove(row[0])
+
+            if signature is not None:
+                self._insert(event_file, signature, remote_data, videos)
+
+            if verbose:
+                print("indexed {} ({} sessions, {} videos)".format(
+                    event_file['filepath'], len(remote_data), len(videos)))
+
+        self.db.commit()
+
+        return len(changed)
+
+    def sessions(self, address=None, recording_path=None):
+        """all RPiCam recordings (optionally filtered)
+
+            Each session is a dict with the address of the RPi, the remote
+            recording path, the local recording path and event file, and the
+            local video files belonging to the session.
+        """
+
+        query = ('SELECT e.id, e.filepath, e.format, e.recording_path, '
+                 's.address, s.remote_path FROM sessions s '
+                 'JOIN event_files e ON s.event_file_id = e.id')
+        conditions = []
+        args = []
+
+        if address is not None:
+            conditions.append('s.address = ?')
+            args.append(address)
+
+        if recording_path is not None:
+            conditions.append('e.recording_path = ?')
+            args.append(op.abspath(recording_path))
+
+        if len(conditions) > 0:
+            query += ' WHERE ' + ' AND '.join(conditions)
+        query += ' ORDER BY e.recording_path'
+
+        videos = {}
+        for row in self.db.execute('SELECT event_file_id, video, '
+                                   'timestamps, parameters FROM videos'):
+            videos.setdefault(row[0], []).append({'video': row[1],
+                                                  'timestamps': row[2],
+                                                  'parameters': row[3]})
+
+        result = []
+        for file_id, filepath, fmt, rec_path, address, remote_path \
+                in self.db.execute(query, args):
+
+            # with multiple cameras, copied files are in a directory named
+            # after the remote recording directory
+            local = videos.get(file_id, [])
+            name = op.basename(remote_path)
+            matching = [v for v in local if name and name in v['video']]
+            if len(matching) > 0:
+                local = matching
+
+            result.append({'event_file': filepath,
+                           'format': fmt,
+                           'recording_path': rec_path,
+                           'address': address,
+                           'remote_path': remote_path,
+                           'videos': local})
+
+        return result
\ No newline at end of file
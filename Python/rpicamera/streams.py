@@ -7,8 +7,18 @@
 from __future__ import print_function
 
 from io import FileIO
+import os
 import socket
 import subprocess
+import threading
+import time
+
+try:
+    import Queue
+except ImportError:
+    import queue as Queue
+
+from .trace import tracer
 
 
 class FileOutput(FileIO):
@@ -26,6 +36,205 @@ class FileOutput(FileIO):
         super(FileOutput, self).flush()
 
 
+class BufferedFileOutput(object):
+    """Write-behind file output that keeps SD card stalls from the encoder
+
+        write() is called on the encoder thread and only copies the data
+        into a preallocated ring buffer. A writer thread writes whole chunks
+        (aligned to the chunk size in the file) and extends the file in
+        large preallocated steps, so that the card's garbage collection
+        pauses are absorbed by the buffer. The encoder only blocks if the
+        buffer runs full, which is counted as a stall. Buffer statistics
+        are passed to status_callback(stats) every status_interval seconds
+        and when the file is closed.
+    """
+
+    def __init__(self, path, buffer_size=64 << 20, chunk_size=1 << 20,
+                 preallocate=128 << 20, status_callback=None,
+                 status_interval=1.):
+
+        # the ring consists of whole chunks
+        self.chunk_size = chunk_size
+        self.buffer_size = max(2, buffer_size // chunk_size) * chunk_size
+        self.preallocate = preallocate
+        self.status_callback = status_callback
+        self.status_interval = status_interval
+
+        self.path = path
+        self.fd = os.open(path, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644)
+
+        self.buffer = bytearray(self.buffer_size)
+        self.view = memoryview(self.buffer)
+
+        # total number of bytes put into the ring (head) and written (tail)
+        self.head = 0
+        self.tail = 0
+        self.allocated = 0
+
+        self.high_water = 0
+        self.stalls = 0
+        self.stall_time = 0.
+        self.max_write_time = 0.
+
+        self.lock = threading.Lock()
+        self.data_ready = threading.Condition(self.lock)
+        self.space_ready = threading.Condition(self.lock)
+        self.flushing = False
+        self.closed = False
+
+        self.thread = threading.Thread(target=self._run)
+        self.thread.daemon = True
+        self.thread.start()
+
+    @property
+    def size(self):
+
+        return self.head
+
+    def get_stats(self):
+
+        with self.lock:
+            return {'fill': self.head - self.tail,
+                    'high_water': self.high_water,
+                    'buffer_size': self.buffer_size,
+                    'stalls': self.stalls,
+                    'stall_time': self.stall_time,
+                    'max_write_time': self.max_write_time,
+                    'bytes_written': self.tail}
+
+    def write(self, s):
+
+        data = memoryview(s)
+        if data.ndim != 1 or data.itemsize != 1:
+            data = data.cast('B')
+        n = len(data)
+        offset = 0
+
+        with self.lock:
+            while offset < n:
+
+                free = self.buffer_size - (self.head - self.tail)
+                if free == 0:
+                    # the card is slower than the encoder for too long
+                    self.stalls += 1
+                    t0 = time.time()
+                    self.data_ready.notify()
+                    self.space_ready.wait()
+                    self.stall_time += time.time() - t0
+                    continue
+
+                pos = self.head % self.buffer_size
+                k = min(free, n - offset, self.buffer_size - pos)
+                self.view[pos:pos + k] = data[offset:offset + k]
+                self.head += k
+                offset += k
+
+            fill = self.head - self.tail
+            self.high_water = max(self.high_water, fill)
+            if fill >= self.chunk_size:
+                self.data_ready.notify()
+
+        return n
+
+    def _next_block(self):
+        # caller holds the lock; (position, size) of the next write
+
+        fill = self.head - self.tail
+        if not self.flushing:
+            fill -= fill % self.chunk_size
+
+        pos = self.tail % self.buffer_size
+        return pos, min(fill, self.buffer_size - pos)
+
+    def _write_block(self, pos, k):
+
+        end = self.tail + k
+        if self.preallocate > 0 and end > self.allocated:
+            fallocate = getattr(os, 'posix_fallocate', None)
+            if fallocate is not None:
+                size = self.allocated + max(self.preallocate, k)
+                try:
+                    fallocate(self.fd, self.allocated, size - self.allocated)
+                    self.allocated = size
+                except OSError:
+                    # e.g. not supported by the file system
+                    self.preallocate = 0
+
+        t0 = time.time()
+        block = self.view[pos:pos + k]
+        while len(block) > 0:
+            block = block[os.write(self.fd, block):]
+        duration = time.time() - t0
+
+        tracer.add('disk', 'write', t0 * 1e6, duration * 1e6, k)
+
+        return duration
+
+    def _run(self):
+
+        next_status = time.time() + self.status_interval
+
+        while True:
+
+            with self.lock:
+                pos, k = self._next_block()
+                while k == 0 and not self.closed:
+                    if self.flushing:
+                        self.flushing = False
+                        self.space_ready.notify_all()
+                    self.data_ready.wait(self.status_interval)
+                    pos, k = self._next_block()
+                    if time.time() >= next_status:
+                        break
+
+                if k == 0 and self.closed:
+                    break
+
+            if k > 0:
+                # the encoder keeps filling the rest of the ring meanwhile
+                duration = self._write_block(pos, k)
+
+                with self.lock:
+                    self.tail += k
+                    self.max_write_time = max(self.max_write_time, duration)
+                    self.space_ready.notify_all()
+
+            if time.time() >= next_status:
+                next_status = time.time() + self.status_interval
+                if self.status_callback is not None:
+                    self.status_callback(self.get_stats())
+
+    def flush(self):
+        """write all buffered data (blocks the caller)"""
+
+        with self.lock:
+            self.flushing = True
+            self.data_ready.notify()
+            while self.flushing and self.tail < self.head:
+                self.space_ready.wait()
+            self.flushing = False
+
+    def close(self):
+
+        if self.closed:
+            return
+
+        with tracer.span('disk', 'flush'):
+            with self.lock:
+                self.flushing = True
+                self.closed = True
+                self.data_ready.notify()
+            self.thread.join()
+
+        # drop the preallocated space behind the data
+        os.ftruncate(self.fd, self.tail)
+        os.fsync(self.fd)
+        os.close(self.fd)
+
+        if self.status_callback is not None:
+            self.status_callback(self.get_stats())
+
+
 class NetworkStreamOutput(object):
     """https://wiki.python.org/moin/TcpCommunication"""
 
@@ -122,3 +331,158 @@ class NetworkStreamWriter(object):
 
         if self.verbose:
             print(" total # bytes received:", n_bytes)
+
+
+class StreamServer(object):
+    """Serve a live h264 stream to any number of TCP clients
+
+        Used as picamera output: write() is called on the encoder thread and
+        only hands the data to per-client queues. Each client has its own
+        sender thread; clients that cannot keep up (full queue) are
+        disconnected instead of blocking the encoder, and so are clients
+        that do not take any data for send_timeout seconds (e.g. gone
+        without closing the connection). New clients get
+        data from the next key frame on (the connect callback requests one),
+        so that they can start decoding right away. The stream can be
+        viewed using, e.g., "ffplay -f h264 tcp://<address>:<port>" or
+        "vlc tcp/h264://<address>:<port>".
+    """
+
+    def __init__(self, port=5557, max_queued=100, connect_callback=None,
+                 send_timeout=5.):
+
+        self.port = port
+        self.max_queued = max_queued
+        self.send_timeout = send_timeout
+        self.connect_callback = connect_callback
+
+        self.clients = []
+        self.joining = []
+        self.lock = threading.Lock()
+        self.size = 0
+
+        self.server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.server.bind(('', port))
+        self.server.listen(4)
+
+        self.closed = False
+        self.thread = threading.Thread(target=self._accept)
+        self.thread.daemon = True
+        self.thread.start()
+
+    def _accept(self):
+
+        while not self.closed:
+
+            try:
+                conn, addr = self.server.accept()
+            except socket.error:
+                break
+
+            print("Stream: client connected", addr)
+
+            tracer.instant('stream', 'client connected')
+
+            queue = Queue.Queue(maxsize=self.max_queued)
+            with self.lock:
+                self.joining.append(queue)
+
+            t = threading.Thread(target=self._send, args=(conn, queue))
+            t.daemon = True
+            t.start()
+
+            if self.connect_callback is not None:
+                # e.g., request a key frame so that the client can start
+                # decoding right away
+                self.connect_callback()
+
+    def _remove(self, queue):
+
+        with self.lock:
+            if queue in self.clients:
+                self.clients.remove(queue)
+            if queue in self.joining:
+                self.joining.remove(queue)
+
+    def _stop_sender(self, queue):
+
+        # make room for the stop marker (never block the caller)
+        try:
+            queue.get_nowait()
+        except Queue.Empty:
+            pass
+
+        try:
+            queue.put_nowait(None)
+        except Queue.Full:
+            pass
+
+    def _send(self, conn, queue):
+
+        # a blocked sendall would never see the stop marker
+        conn.settimeout(self.send_timeout)
+
+        try:
+            while True:
+                data = queue.get()
+                if data is None:
+                    break
+                conn.sendall(data)
+
+        except socket.timeout:
+            print("Stream: client not responding, disconnecting")
+
+        except socket.error:
+            pass
+
+        finally:
+            self._remove(queue)
+            conn.close()
+
+    @staticmethod
+    def is_key_frame(s):
+        """data starts with a sequence parameter set (written in front of
+        every key frame with inline headers)"""
+
+        head = bytearray(s[:5])
+        return (len(head) == 5 and head[:4] == b'\x00\x00\x00\x01'
+                and head[4] & 0x1f == 7)
+
+    def write(self, s):
+
+        self.size += len(s)
+
+        with self.lock:
+            if self.joining and self.is_key_frame(s):
+                tracer.instant('stream', 'key frame', len(self.joining))
+                self.clients.extend(self.joining)
+                self.joining = []
+            clients = list(self.clients)
+
+        for queue in clients:
+            try:
+                queue.put_nowait(bytes(s))
+            except Queue.Full:
+                print("Stream: dropping slow client")
+                self._remove(queue)
+                self._stop_sender(queue)
+
+        return len(s)
+
+    def flush(self):
+
+        pass
+
+    def close(self):
+
+        self.closed = True
+        self.server.close()
+
+        with self.lock:
+            clients = self.clients + self.joining
+            self.clients = []
+            self.joining = []
+
+        for queue in clients:
+            self._stop_sender(queue)
@@ -0,0 +1,197 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Author: Arne F. Meyer <arne.f.meyer@gmail.com>
+# License: GPLv3
+
+"""
+    Binary frame timestamp log.
+
+    File layout (little endian):
+
+        header (128 bytes):
+            magic       8s   b'RPICAMTS'
+            version     u4
+            header size u4
+            record size u4
+            camera id   32s  (e.g., host name)
+            clock mode  8s   (picamera clock_mode, 'raw' or 'reset')
+            framerate   f8
+            width       u4
+            height      u4
+            (zero padding)
+
+        records (16 bytes each):
+            pts         i8   frame presentation timestamp (usec, -1: invalid)
+            ets         i8   camera clock when the frame was written (usec)
+
+    All records have the same size, so a file that has been truncated (e.g.,
+    power loss) can still be read up to the last complete record.
+"""
+
+from __future__ import print_function
+
+import io
+import os
+import struct
+import threading
+
+
+MAGIC = b'RPICAMTS'
+VERSION = 1
+HEADER_SIZE = 128
+HEADER_STRUCT = struct.Struct('<8sIII32s8sdII')
+RECORD_STRUCT = struct.Struct('<qq')
+RECORD_SIZE = RECORD_STRUCT.size
+
+
+def _to_bytes(s):
+
+    if not isinstance(s, bytes):
+        s = s.encode('utf-8')
+    return s
+
+
+def _from_bytes(b):
+
+    return b.rstrip(b'\0').decode('utf-8')
+
+
+def read_header(path):
+    """return the header of a binary timestamp file as dict"""
+
+    with open(path, 'rb') as f:
+        data = f.read(HEADER_SIZE)
+
+    if len(data) < HEADER_STRUCT.size:
+        raise ValueError('truncated timestamp file header: {}'.format(path))
+
+    values = HEADER_STRUCT.unpack_from(data)
+    if values[0] != MAGIC:
+        raise ValueError('not a binary timestamp file: {}'.format(path))
+
+    header = {'version': values[1],
+              'header_size': values[2],
+              'record_size': values[3],
+              'camera_id': _from_bytes(values[4]),
+              'clock_mode': _from_bytes(values[5]),
+              'framerate': values[6],
+              'width': values[7],
+              'height': values[8]}
+
+    n_bytes = os.path.getsize(path) - header['header_size']
+    header['num_records'] = max(0, n_bytes // header['record_size'])
+
+    return header
+
+
+class TimestampWriter(object):
+    """Append timestamp records without formatting or I/O on the caller's thread
+
+        Records are packed into a preallocated buffer; full buffers (and,
+        every flush_interval seconds, the partially filled one) are written
+        by a background thread. Buffers are recycled.
+    """
+
+    def __init__(self, path,
+                 camera_id='',
+                 clock_mode='raw',
+                 framerate=30.,
+                 resolution=(640, 480),
+                 buffer_records=4096,
+                 flush_interval=0.5):
+
+        self.path = path
+        self.flush_interval = flush_interval
+        self.buffer_records = buffer_records
+
+        self.file = io.open(path, 'wb')
+
+        header = bytearray(HEADER_SIZE)
+        HEADER_STRUCT.pack_into(header, 0,
+                                MAGIC, VERSION, HEADER_SIZE, RECORD_SIZE,
+                                _to_bytes(camera_id)[:32],
+                                _to_bytes(clock_mode)[:8],
+                                float(framerate),
+                                int(resolution[0]), int(resolution[1]))
+        self.file.write(header)
+
+        self.lock = threading.Lock()
+        self.buffer = self._new_buffer()
+        self.count = 0
+        self.full = []
+        self.free = [self._new_buffer()]
+
+        self.num_records = 0
+        self.closed = False
+        self.wakeup = threading.Event()
+
+        self.thread = threading.Thread(target=self._run)
+        self.thread.daemon = True
+        self.thread.start()
+
+    def _new_buffer(self):
+
+        return bytearray(self.buffer_records * RECORD_SIZE)
+
+    def _swap(self):
+        # caller holds the lock
+
+        self.full.append((self.buffer, self.count))
+        if len(self.free) > 0:
+            self.buffer = self.free.pop()
+        else:
+            self.buffer = self._new_buffer()
+        self.count = 0
+
+    def write(self, pts, ets):
+
+        if pts is None:
+            pts = -1
+
+        with self.lock:
+            RECORD_STRUCT.pack_into(self.buffer, self.count * RECORD_SIZE,
+                                    pts, ets)
+            self.count += 1
+            self.num_records += 1
+
+            if self.count == self.buffer_records:
+                self._swap()
+                self.wakeup.set()
+
+    def _drain(self):
+
+        with self.lock:
+            if self.count > 0:
+                self._swap()
+            pending = self.full
+            self.full = []
+
+        for buf, n in pending:
+            self.file.write(memoryview(buf)[:n * RECORD_SIZE])
+
+        with self.lock:
+            self.free.extend([buf for buf, _ in pending])
+
+        if len(pending) > 0:
+            self.file.flush()
+
+    def _run(self):
+
+        while not self.closed:
+            self.wakeup.wait(self.flush_interval)
+            self.wakeup.clear()
+            self._drain()
+
+    def close(self):
+
+        if self.closed:
+            return
+
+        self.closed = True
+        self.wakeup.set()
+        self.thread.join()
+
+        self._drain()
+        os.fsync(self.file.fileno())
+        self.file.close()
@@ -0,0 +1,84 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Author: Arne F. Meyer <arne.f.meyer@gmail.com>
+# License: GPLv3
+
+"""
+    Timeline of commands, camera reconfigurations and recording steps.
+
+    Spans and instant events are kept in a bounded buffer (the oldest are
+    dropped) and returned to the plugin on request ("Trace"):
+
+        "Trace <host time>"
+        "<start> <duration> <value> <category> <name>"
+        ...
+
+    All times are wall clock usec since the epoch, the same reference as the
+    plugin's trace (Trace.h). The plugin estimates the clock offset from the
+    host time and the round trip of the request and merges both timelines
+    into one Chrome trace file.
+"""
+
+from __future__ import print_function
+
+import collections
+import contextlib
+import time
+
+
+def now():
+    """wall clock time in usec"""
+
+    return int(time.time() * 1e6)
+
+
+class Tracer(object):
+
+    def __init__(self, capacity=8192):
+
+        # (appending to a deque is thread-safe)
+        self.events = collections.deque(maxlen=capacity)
+
+    def add(self, category, name, start, duration=0, value=-1):
+
+        self.events.append((int(start), int(duration), int(value),
+                            '_'.join(category.split()), name))
+
+    def instant(self, category, name, value=-1):
+
+        self.add(category, name, now(), 0, value)
+
+    @contextlib.contextmanager
+    def span(self, category, name, value=-1):
+
+        start = now()
+        try:
+            yield
+        finally:
+            self.add(category, name, start, now() - start, value)
+
+    def traced(self, category, name, func):
+        """func wrapped in a span"""
+
+        def wrapper(*args, **kwargs):
+            with self.span(category, name):
+                return func(*args, **kwargs)
+
+        return wrapper
+
+    def clear(self):
+
+        self.events.clear()
+
+    def format(self):
+        """reply to the plugin's "Trace" request"""
+
+        lines = ['Trace {}'.format(now())]
+        lines.extend('{} {} {} {} {}'.format(*e) for e in list(self.events))
+
+        return '\n'.join(lines)
+
+
+# shared by the controller, the camera and the host script
+tracer = Tracer()
@@ -19,6 +19,8 @@ import platform
 import subprocess
 import traceback
 
+from . import timestamps as rpts
+
 
 # -----------------------------------------------------------------------------
 # Loading/reading of video data
@@ -48,7 +50,10 @@ def get_video_files(path, absolute=False, recursive=False):
                 # each file belonging to this recording should have the same
                 # base name
                 basename = op.splitext(video_file)[0]
-                ts_file = basename + '_timestamps.csv'
+                ts_file = basename + '_timestamps.bin'
+                if not op.exists(ts_file):
+                    # text format written by older versions
+                    ts_file = basename + '_timestamps.csv'
                 param_file = basename + '_params.json'
                 if op.exists(ts_file) and op.exists(param_file):
                     dd = {'video': video_file,
@@ -59,16 +64,64 @@ def get_video_files(path, absolute=False, recursive=False):
     return rec_files
 
 
+def load_timestamps(path):
+    """memory-map a binary timestamp file (*_timestamps.bin)
+
+        Returns the header (dict) and an array with fields 'pts' and 'ets'.
+        Truncated files are read up to the last complete record.
+    """
+
+    header = rpts.read_header(path)
+    dtype = np.dtype([('pts', '<i8'), ('ets', '<i8')])
+
+    if header['num_records'] > 0:
+        ts = np.memmap(path, dtype=dtype, mode='r',
+                       offset=header['header_size'],
+                       shape=(header['num_records'],))
+    else:
+        ts = np.zeros((0,), dtype=dtype)
+
+    return header, ts
+
+
+def load_roi(path):
+    """memory-map the frames of a region of interest (*_roi_<name>.gray)
+
+        Returns the timestamp file header, the timestamps (see
+        load_timestamps) and an array of shape (frames, height, width).
+    """
+
+    header, ts = load_timestamps(op.splitext(path)[0] + '_timestamps.bin')
+    shape = (header['height'], header['width'])
+
+    num_frames = op.getsize(path) // (shape[0] * shape[1])
+    if num_frames > 0:
+        frames = np.memmap(path, dtype=np.uint8, mode='r',
+                           shape=(num_frames,) + shape)
+    else:
+        frames = np.zeros((0,) + shape, dtype=np.uint8)
+
+    return header, ts[:num_frames], frames
+
+
 def read_timestamp_deltas(path):
 
     if op.isfile(path):
         files = [path]
     elif op.isdir(path):
-        files = glob.glob(op.join(path, '*timestamps.txt'))
+        files = glob.glob(op.join(path, '*timestamps.bin')) + \
+            glob.glob(op.join(path, '*timestamps.csv')) + \
+            glob.glob(op.join(path, '*timestamps.txt'))
     else:
         raise ValueError('given path neither file nor directory')
 
-    if len(files) > 0:
+    if len(files) > 0 and files[0].endswith('.bin'):
+        _, ts = load_timestamps(files[0])
+
+        dts = (ts['ets'] - ts['pts']) / 1000000.  # usec -> sec
+        dts[ts['pts'] < 0] = -1
+
+    elif len(files) > 0:
         ts_file = files[0]
 
         try:
@@ -108,6 +161,36 @@ def read_timestamp_deltas(path):
     return dts
 
 
+def read_frame_table(path):
+    """memory-map the frame table written by the plugin (*_frames.bin)
+
+        Returns a record array with fields frame_index, sample_number, pts
+        (RPi clock, usec) and flags (1: matched strobe pulse, 2: interpolated,
+        4: frame index read from barcode) and the sample rate.
+    """
+
+    header = np.dtype([('magic', 'S8'),
+                       ('version', '<u4'),
+                       ('record_size', '<u4'),
+                       ('sample_rate', '<f8'),
+                       ('num_records', '<i8')])
+    record = np.dtype([('frame_index', '<i8'),
+                       ('sample_number', '<i8'),
+                       ('pts', '<i8'),
+                       ('flags', '<i4'),
+                       ('reserved', '<i4')])
+
+    hdr = np.fromfile(path, dtype=header, count=1)[0]
+    if hdr['magic'] != b'RPICAMFT' or hdr['record_size'] != record.itemsize:
+        raise ValueError('not a frame table file: {}'.format(path))
+
+    table = np.memmap(path, dtype=record, mode='r',
+                      offset=header.itemsize,
+                      shape=(int(hdr['num_records']),))
+
+    return table, float(hdr['sample_rate'])
+
+
 def interpolate_missing_timestamps(ts, deltas, fps=30):
     """simple interpolation of missing timestamps (not multiple in a row)"""
 
@@ -256,10 +339,9 @@ def get_event_files(path, verbose=True):
 def load_messages_from_event_file(event_file):
     """parse remote path and address from a kwik or binary format event file"""
 
-    import h5py
-
     if event_file['format'] == 'kwik':
         # kwik event file
+        import h5py
         with h5py.File(event_file['filepath'], 'r') as f:
             messages = \
                 f['event_types']['Messages']['events']['user_data']['Text']
@@ -270,6 +352,7 @@ def load_messages_from_event_file(event_file):
                     for msg in np.load(event_file['filepath']).tolist()]
     elif event_file['format'] == 'nwb':
         # nwb event file
+        import h5py
         with h5py.File(event_file['filepath'], 'r') as f:
             eventEntries = f['acquisition']['timeseries']['recording1']['events']
             textEntires = [i for i in eventEntries.keys() if i.startswith('text') ]
@@ -294,33 +377,52 @@ def load_messages_from_event_file(event_file):
     return messages
 
 
-def parse_messages(messages):
+def parse_messages(messages, verbose=True):
+    """address and recording path of each RecPath event
+
+        Region (ROI=) events and all other messages are skipped:
+
+        >>> data = parse_messages(
+        ...     ['RPiCam Address=10.0.0.2 Cfg=3 RecPath=/rec/x',
+        ...      'RPiCam Address=10.0.0.2 Cfg=3 ROI=eye RoiPath=/rec/x '
+        ...      'Rect=0.1,0.2,0.3,0.4 Size=64x64',
+        ...      'RPiCam Address=10.0.0.2 Cfg=3 Frame=17'], verbose=False)
+        >>> print(len(data), data[0]['address'], data[0]['path'])
+        1 10.0.0.2 /rec/x
+    """
 
     remote_data = []
 
     for msg in messages:
 
-        msg = msg.decode('utf-8')
+        if isinstance(msg, bytes):
+            msg = msg.decode('utf-8', 'ignore')
         parts = msg.split()
 
-        if parts[0] == 'RPiCam':
+        # skip other RPiCam messages (e.g., frame index barcodes, regions)
+        if len(parts) > 0 and parts[0] == 'RPiCam' and 'RecPath=' in msg \
+                and 'ROI=' not in msg:
 
             i1 = msg.find('Address=')
             i2 = msg.find('RecPath=')
 
-            remote_address = msg[i1+len('Address='):i2-1]
+            # other fields (e.g. "Cfg=<version>") may follow the address
+            remote_address = msg[i1+len('Address='):i2].split(' ')[0]
             remote_address = ''.join(e for e in remote_address
                                      if e.isdigit() or e == '.')
             remote_address = ''.join(e[:min(len(e), 3)] + '.'
                                      for e in remote_address.split('.'))
             remote_address = remote_address[:-1]
-            print("address:", remote_address)
+            if verbose:
+                print("address:", remote_address)
 
-            remote_path = msg[i2+len('RecPath='):]
+            # (fields may follow the path as well)
+            remote_path = msg[i2+len('RecPath='):].split(' ')[0]
             remote_path = ''.join(e for e in remote_path
                                   if e.isalnum() or
                                   e in ['/', '-', '_'])
-            print("remote path:", remote_path)
+            if verbose:
+                print("remote path:", remote_path)
 
             remote_data.append({'address': remote_address,
                                 'path': remote_path})
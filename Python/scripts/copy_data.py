@@ -8,7 +8,9 @@
     Copy camera data from RPi to the recording computer
 
     The script recursively searches for event files created using the
-    open-ephys plugin-GUI and copies RPi camera data (*.{h264,txt,json}).
+    open-ephys plugin-GUI and copies RPi camera data (*.{h264,bin,csv,json}).
+    Event files are looked up in a session index (see rpicamera/index.py)
+    so that only new or modified event files have to be parsed.
     Currently works on Linux-based systems (e.g., Ubuntu) and with data
     recorded in kwik and binary format. See file "rpicamera/utils.py"
     for details.
@@ -24,9 +26,21 @@ import sys
 
 try:
     import rpicamera.util as rpu
+    from rpicamera.index import SessionIndex
 except ImportError:
     sys.path.append(op.join(op.split(__file__)[0], '..'))
     import rpicamera.util as rpu
+    from rpicamera.index import SessionIndex
+
+
+def get_sessions(path, workers=4):
+
+    index = SessionIndex(path, workers=workers)
+    index.update()
+    sessions = index.sessions()
+    index.close()
+
+    return sessions
 
 
 def copy_data(path=None,
@@ -43,25 +57,20 @@ def copy_data(path=None,
     if not op.exists(path):
         os.makedirs(path)
 
-    for f in rpu.get_event_files(path):
+    for dd in get_sessions(path):
 
-        messages = rpu.load_messages_from_event_file(f)
-        remote_data = rpu.parse_messages(messages)
+        if address is not None:
+            remote_address = address
+        else:
+            remote_address = dd['address']
 
-        for dd in remote_data:
-
-            if address is not None:
-                remote_address = address
-            else:
-                remote_address = dd['address']
-
-            try:
-                rpu.scp(user, remote_address,
-                        op.join(dd['path'], '*.{h264,csv,json}'),
-                        f['recording_path'],
-                        verbose=verbose)
-            except BaseException:
-                traceback.print_exc()
+        try:
+            rpu.scp(user, remote_address,
+                    op.join(dd['remote_path'], '*.{h264,bin,csv,json}'),
+                    dd['recording_path'],
+                    verbose=verbose)
+        except BaseException:
+            traceback.print_exc()
 
 
 def copy_func(args):
@@ -90,23 +99,18 @@ def copy_data_parallel(path=None,
         os.makedirs(path)
 
     all_data = []
-    for f in rpu.get_event_files(path):
-
-        messages = rpu.load_messages_from_event_file(f)
-        remote_data = rpu.parse_messages(messages)
-
-        for dd in remote_data:
+    for dd in get_sessions(path, workers=workers):
 
-            if address is not None:
-                remote_address = address
-            else:
-                remote_address = dd['address']
+        if address is not None:
+            remote_address = address
+        else:
+            remote_address = dd['address']
 
-            all_data.append((user,
-                             remote_address,
-                             op.join(dd['path'], '*.{h264,csv,json}'),
-                             f['recording_path'],
-                             verbose))
+        all_data.append((user,
+                         remote_address,
+                         op.join(dd['remote_path'], '*.{h264,bin,csv,json}'),
+                         dd['recording_path'],
+                         verbose))
 
     pool = Pool(processes=workers)
     pool.map(copy_func, all_data)
@@ -122,7 +126,7 @@ if __name__ == '__main__':
     parser.add_argument('-a', '--address',
                         help='IP address', default=None)
     parser.add_argument('-p', '--parallel', action='store_true')
-    parser.add_argument('-w', '--workers', default=4)
+    parser.add_argument('-w', '--workers', default=4, type=int)
     parser.add_argument('-v', '--verbose', action='store_true')
 
     args = vars(parser.parse_args())
@@ -0,0 +1,66 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Author: Arne F. Meyer <arne.f.meyer@gmail.com>
+# License: GPLv3
+
+"""
+    Build/update the index of recordings with RPi camera data and list them
+
+    The index is stored in the data path (".rpicamera_index.sqlite") and
+    updated incrementally, i.e. only new or modified event files are parsed.
+    See file "rpicamera/index.py" for details.
+"""
+
+from __future__ import print_function
+
+import os.path as op
+import argparse
+import json
+import sys
+
+try:
+    from rpicamera.index import SessionIndex
+except ImportError:
+    sys.path.append(op.join(op.split(__file__)[0], '..'))
+    from rpicamera.index import SessionIndex
+
+
+def index_data(path=None,
+               address=None,
+               workers=4,
+               as_json=False,
+               verbose=False):
+
+    assert path is not None
+
+    index = SessionIndex(path, workers=workers)
+    n = index.update(verbose=verbose)
+    sessions = index.sessions(address=address)
+    index.close()
+
+    if as_json:
+        print(json.dumps(sessions, indent=4))
+
+    else:
+        print("{} event files updated, {} sessions".format(n, len(sessions)))
+        for s in sessions:
+            print("{}: {} {} ({} videos)".format(s['recording_path'],
+                                                 s['address'],
+                                                 s['remote_path'],
+                                                 len(s['videos'])))
+
+
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser()
+
+    parser.add_argument("path", help='data path')
+    parser.add_argument('-a', '--address',
+                        help='only list sessions of this RPi', default=None)
+    parser.add_argument('-w', '--workers', default=4, type=int)
+    parser.add_argument('-j', '--json', dest='as_json', action='store_true')
+    parser.add_argument('-v', '--verbose', action='store_true')
+
+    args = vars(parser.parse_args())
+    index_data(**args)
@@ -17,7 +17,8 @@
 
         - *.h264: the video data in h264 format
         - *_info.json: a json file with video parameters, e.g., resolution
-        - *_timestamps.txt: a text file (csv) with frame/TTL timestamps
+        - *_timestamps.bin: a binary file with frame/TTL timestamps (see
+                            rpicamera/timestamps.py)
 
 """
 
@@ -31,9 +32,13 @@ import time
 
 try:
     from rpicamera.controller import Controller, ZmqThread
+    from rpicamera.discovery import Announcer
+    from rpicamera.files import FileServer
 except ImportError:
     sys.path.append(op.join(op.split(__file__)[0], '..'))
     from rpicamera.controller import Controller, ZmqThread
+    from rpicamera.discovery import Announcer
+    from rpicamera.files import FileServer
 
 
 def run_plugin(output=None,
@@ -44,6 +49,8 @@ def run_plugin(output=None,
                quality=23,
                strobe_pin=11,
                zoom=(0, 0, 1, 1),
+               endpoint=None,
+               announce=True,
                **kwargs):
 
     if output is None:
@@ -86,6 +93,10 @@ def run_plugin(output=None,
             print("Setting frame rate to: {} Hz".format(value)),
             controller.framerate = value
 
+        elif name == 'FramerateDelta':
+            # frequent (phase lock) -> not printed
+            controller.framerate_delta = value
+
         elif name == 'Resolution':
             print("Setting resolution to: {}".format(value)),
             controller.resolution = value
@@ -98,6 +109,10 @@ def run_plugin(output=None,
             print("Setting hflip to: {}".format(value)),
             controller.hflip = value
 
+        elif name == 'Lighting':
+            print("Setting lighting preset to: {}".format(value))
+            controller.set_lighting(value)
+
         elif name == 'ResetGains':
             print("Resetting camera gains")
             controller.reset_gains()
@@ -114,10 +129,67 @@ def run_plugin(output=None,
             print("Setting zoom to:", value)
             controller.zoom = value
 
+        elif name == 'Stream':
+            print("Setting live stream to:", value)
+            controller.set_stream(*value)
+
+        elif name == 'Rois':
+            print("Setting regions of interest to:", value)
+            controller.set_rois(value)
+
+        elif name == 'Exposure':
+            print("Setting exposure monitor to:", value)
+            controller.set_exposure_monitor(*value)
+
+        elif name == 'ExposureControl':
+            print("Setting exposure control to:", value)
+            controller.set_exposure_control(*value)
+
+        elif name == 'IntraPeriod':
+            print("Setting intra period to:", value)
+            controller.set_intra_period(value)
+
+        elif name == 'RequestKeyframe':
+            # (joining clients) -> not printed
+            return controller.request_key_frame(value)
+
+        elif name == 'ConfigVersion':
+            # tag of every command -> not printed
+            controller.config_version = value
+
+        elif name == 'Snapshot':
+            print("Taking snapshot")
+            return controller.snapshot()
+
     print("Starting ZMQ thread")
-    thread = ZmqThread(start_cam, stop_cam, close_cam, set_parameter)
+    # recorded files can be pulled by the plugin (see rpicamera/files.py)
+    thread = ZmqThread(start_cam, stop_cam, close_cam, set_parameter,
+                       query_callback=controller.query,
+                       file_server=FileServer(output),
+                       url=endpoint)
+
+    # frame info is published so that the plugin can match strobe pulses
+    notifier = thread.create_notifier()
+
+    def publish_frame(index, pts, ets):
+        notifier.send('Frame {} {} {}'.format(index, pts, ets))
+
+    controller.set_frame_callback(publish_frame)
+
+    # exposure summaries (see rpicamera/exposure.py) and write buffer
+    # statistics for the plugin's display
+    controller.set_notify_callback(notifier.send)
     thread.start()
 
+    # let the plugin find this host (only for network endpoints)
+    announcer = None
+    if announce and (endpoint is None or endpoint.startswith('tcp://')):
+        port = 5555 if endpoint is None else int(endpoint.rsplit(':', 1)[1])
+        sensor = controller.query('Capabilities').get('sensor', 'unknown')
+        print("Announcing camera (port {}, sensor {})".format(port, sensor))
+        announcer = Announcer(port=port, sensor=sensor)
+        announcer.start()
+
     while not controller.closed:
 
         try:
@@ -127,6 +199,9 @@ def run_plugin(output=None,
             controller.close()
             sys.exit(0)  # workaround for stopping (daemon) zmq thread
 
+    if announcer is not None:
+        announcer.stop_running()
+
     thread.join()
 
 
@@ -141,6 +216,11 @@ def run_standalone(output=None,
                    update_interval=5,
                    verbose=True,
                    zoom=(0, 0, 1, 1),
+                   barcode_interval=0,
+                   barcode_bits=16,
+                   strobe_delay=0,
+                   write_buffer=64,
+                   intra_period=0,
                    **kwargs):
     """run camera in standalone mode (i.e. without open-ephys plugin)
 
@@ -164,7 +244,12 @@ def run_standalone(output=None,
                             framerate=framerate,
                             resolution=(width, height),
                             strobe_pin=strobe_pin,
-                            zoom=zoom)
+                            zoom=zoom,
+                            barcode_interval=barcode_interval,
+                            barcode_bits=barcode_bits,
+                            strobe_delay=strobe_delay,
+                            write_buffer=write_buffer,
+                            intra_period=intra_period)
 
     print("Starting preview and warming up camera for 2 seconds")
     controller.start_preview(warmup=2., fix_awb_gains=True)
@@ -235,6 +320,18 @@ class ParserCreator(object):
                             help='video file base name')
         parser.add_argument('--strobe-pin', '-p', default=11, type=int,
                             help='GPIO strobe pin')
+        parser.add_argument('--barcode-interval', '-b', default=0, type=int,
+                            help='send a frame index barcode after every'
+                                 ' n-th strobe pulse (default: 0 = off)')
+        parser.add_argument('--barcode-bits', default=16, type=int,
+                            help='number of barcode bits (default: 16; must'
+                                 ' fit into a frame, e.g. 12 for 90 fps)')
+        parser.add_argument('--strobe-delay', default=0, type=float,
+                            help='send each strobe pulse this many ms after'
+                                 ' the sensor timestamp of its frame instead'
+                                 ' of in the encoder callback (default: 0 ='
+                                 ' callback; must exceed the callback'
+                                 ' latency)')
         parser.add_argument('--quality', '-q', default=23, type=int,
                             help='video quality: 1 (good) <= q <= 40 (bad)'
                                  ' (default: 23)')
@@ -244,6 +341,13 @@ class ParserCreator(object):
         parser.add_argument('--hflip', '-H', action="store_true",
                             default=False,
                             help='apply horizontal flip to camera image')
+        parser.add_argument('--write-buffer', default=64, type=float,
+                            help='write-behind buffer of the video file in'
+                                 ' MB (default: 64, 0: off)')
+        parser.add_argument('--intra-period', default=0, type=int,
+                            help='frames between key frames of the'
+                                 ' recording and the live stream'
+                                 ' (default: 0 = encoder default)')
         parser.add_argument('--zoom', '-z', default=(0, 0, 1, 1),
                             type=float, nargs=4,
                             help='camera zoom (aka ROI):'
@@ -270,6 +374,15 @@ class ParserCreator(object):
         p = self._add_sub_parser('plugin',
                                  'zmq-based server for open-ephys plugin')
 
+        p.add_argument('--endpoint', '-e', default=None,
+                       help='zmq command endpoint instead of tcp port 5555,'
+                            ' e.g. ipc:///tmp/rpicam (frames are published'
+                            ' on <endpoint>.frames)')
+        p.add_argument('--no-announce', dest='announce',
+                       action='store_false', default=True,
+                       help='do not answer discovery requests of the plugin'
+                            ' (UDP port 5554)')
+
         p.set_defaults(func=run_plugin)
 
     def parse(self, args=None):
@@ -0,0 +1,309 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2015 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <cmath>
+#include <cstdlib>
+#include "BarcodeDecoder.h"
+
+
+BarcodeDecoder::BarcodeDecoder()
+	: sampleRate(30000.), framePulseWidth(0.001), bitShortWidth(0.0002), bitLongWidth(0.0005), numBits(16), period(0)
+{
+	updateThresholds();
+	reset();
+}
+
+
+void BarcodeDecoder::setPulseWidths(double frame, double bitShort, double bitLong)
+{
+	framePulseWidth = frame;
+	bitShortWidth = bitShort;
+	bitLongWidth = bitLong;
+	updateThresholds();
+}
+
+
+void BarcodeDecoder::setSampleRate(double fs)
+{
+	if (period > 0)
+	{
+		period *= fs / sampleRate;
+	}
+	sampleRate = fs;
+	updateThresholds();
+}
+
+
+void BarcodeDecoder::setNumBits(int n)
+{
+	if (n > 0 && n < 63)
+	{
+		numBits = n;
+	}
+}
+
+
+void BarcodeDecoder::setNominalFramerate(double fps)
+{
+	if (fps > 0)
+	{
+		period = sampleRate / fps;
+	}
+}
+
+
+void BarcodeDecoder::updateThresholds()
+{
+	// thresholds halfway between the nominal widths
+	frameThreshold = 0.5 * (bitLongWidth + framePulseWidth) * sampleRate;
+	bitThreshold = 0.5 * (bitShortWidth + bitLongWidth) * sampleRate;
+}
+
+
+void BarcodeDecoder::reset()
+{
+	risingEdge = 0;
+	high = false;
+
+	hasPending = false;
+	barcodeValue = 0;
+	barcodeCount = 0;
+
+	lastPulseSample = -1;
+
+	hasAnchor = false;
+	anchorFromBarcode = false;
+	anchorSample = 0;
+	anchorIndex = 0;
+
+	hasCandidate = false;
+	candidateSample = 0;
+	candidateIndex = 0;
+
+	numRejected = 0;
+
+	pulses.clear();
+}
+
+
+void BarcodeDecoder::addEdge(int64_t sampleNumber, bool state)
+{
+	if (state && !high)
+	{
+		risingEdge = sampleNumber;
+		high = true;
+	}
+	else if (!state && high)
+	{
+		high = false;
+		handlePulse(risingEdge, sampleNumber - risingEdge);
+	}
+}
+
+
+void BarcodeDecoder::handlePulse(int64_t onset, int64_t width)
+{
+	if (width >= frameThreshold)
+	{
+		finishPending();
+
+		pending.sampleNumber = onset;
+		pending.frameIndex = -1;
+		pending.fromBarcode = false;
+		hasPending = true;
+		barcodeValue = 0;
+		barcodeCount = 0;
+
+		// track the frame period; intervals spanning dropped pulses (or
+		// glitches) are ignored
+		if (lastPulseSample >= 0)
+		{
+			double interval = double(onset - lastPulseSample);
+			if (period <= 0)
+			{
+				period = interval;
+			}
+			else if (interval > 0.5 * period && interval < 1.5 * period)
+			{
+				period += 0.05 * (interval - period);
+			}
+		}
+		lastPulseSample = onset;
+	}
+	else if (hasPending && barcodeCount <= numBits)
+	{
+		// data bits followed by the parity bit
+		barcodeValue = (barcodeValue << 1) | (width >= bitThreshold ? 1 : 0);
+		barcodeCount++;
+
+		if (barcodeCount == numBits + 1)
+		{
+			int64_t value = barcodeValue >> 1;
+			if (parityBit(value) == (barcodeValue & 1))
+			{
+				handleBarcode(value);
+			}
+			else
+			{
+				numRejected++;
+			}
+
+			finishPending();
+		}
+	}
+}
+
+
+void BarcodeDecoder::handleBarcode(int64_t value)
+{
+	int64_t sample = pending.sampleNumber;
+
+	if (!anchorFromBarcode)
+	{
+		// first barcode: indices counted so far are arbitrary anyway
+		pending.frameIndex = hasAnchor ? unwrapIndex(value, inferIndex(sample)) : value;
+	}
+	else
+	{
+		int64_t predicted = inferIndex(sample);
+		int64_t index = unwrapIndex(value, predicted);
+
+		if (std::llabs(index - predicted) > MAX_BARCODE_DEVIATION)
+		{
+			bool confirmed = false;
+
+			if (hasCandidate && period > 0)
+			{
+				// the last implausible barcode may have been right
+				int64_t expected = candidateIndex + (int64_t) std::llround((sample - candidateSample) / period);
+				index = unwrapIndex(value, expected);
+				confirmed = std::llabs(index - expected) <= MAX_BARCODE_DEVIATION;
+			}
+
+			if (!confirmed)
+			{
+				// keep the inferred index until the next barcode decides
+				hasCandidate = true;
+				candidateSample = sample;
+				candidateIndex = unwrapIndex(value, predicted);
+				numRejected++;
+				return;
+			}
+		}
+
+		pending.frameIndex = index;
+	}
+
+	pending.fromBarcode = true;
+	hasCandidate = false;
+
+	hasAnchor = true;
+	anchorFromBarcode = true;
+	anchorSample = sample;
+	anchorIndex = pending.frameIndex;
+}
+
+
+int64_t BarcodeDecoder::unwrapIndex(int64_t value, int64_t predicted) const
+{
+	// the barcode only holds the lower bits of the frame index
+	int64_t modulus = int64_t(1) << numBits;
+	int64_t diff = (value - predicted) % modulus;
+	if (diff < 0)
+	{
+		diff += modulus;
+	}
+	if (diff >= modulus / 2)
+	{
+		diff -= modulus;
+	}
+
+	return predicted + diff;
+}
+
+
+int BarcodeDecoder::parityBit(int64_t value)
+{
+	int parity = 0;
+	for (uint64_t v = (uint64_t) value; v != 0; v &= v - 1)
+	{
+		parity ^= 1;
+	}
+
+	return parity;
+}
+
+
+int64_t BarcodeDecoder::inferIndex(int64_t sampleNumber) const
+{
+	if (period <= 0)
+	{
+		return anchorIndex;
+	}
+
+	return anchorIndex + (int64_t) std::llround((sampleNumber - anchorSample) / period);
+}
+
+
+void BarcodeDecoder::finishPending()
+{
+	if (!hasPending)
+	{
+		return;
+	}
+
+	if (pending.frameIndex < 0)
+	{
+		if (!hasAnchor)
+		{
+			// no barcode seen yet -> count from the first pulse
+			hasAnchor = true;
+			anchorSample = pending.sampleNumber;
+			anchorIndex = 0;
+		}
+		pending.frameIndex = inferIndex(pending.sampleNumber);
+	}
+
+	pulses.push_back(pending);
+	hasPending = false;
+}
+
+
+void BarcodeDecoder::flush()
+{
+	finishPending();
+}
+
+
+bool BarcodeDecoder::popPulse(FramePulse& pulse)
+{
+	if (pulses.empty())
+	{
+		return false;
+	}
+
+	pulse = pulses.front();
+	pulses.pop_front();
+
+	return true;
+}
@@ -0,0 +1,147 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __BARCODEDECODER_H__
+#define __BARCODEDECODER_H__
+
+#include <cstdint>
+#include <deque>
+
+
+/**
+
+  A strobe pulse assigned to a camera frame
+
+*/
+
+struct FramePulse
+{
+	int64_t sampleNumber;	// rising edge of the frame pulse
+	int64_t frameIndex;		// frame index on the RPi (encoder frame count)
+	bool fromBarcode;		// index was read from a barcode (not inferred)
+};
+
+
+/**
+
+  Decodes the strobe signal generated by the rpicamera host
+
+  Every frame produces a pulse; optionally, every n-th frame pulse is
+  followed by a barcode with one pulse per bit (MSB first) and an even
+  parity bit, whose widths encode the bit values (see StrobeGenerator in
+  camera.py). Pulses are classified by their width.
+
+  Frame indices between barcodes are inferred from the time elapsed since
+  the last barcode and the (continuously updated) frame period, so a
+  dropped pulse never shifts the indices of subsequent frames.
+
+  A barcode with a parity error is ignored. A barcode that differs from
+  the inferred index by more than MAX_BARCODE_DEVIATION frames is only
+  accepted once the next barcode confirms it; until then frames keep
+  their inferred indices, so a single misread bit never moves the indices.
+
+*/
+
+class BarcodeDecoder
+{
+public:
+	BarcodeDecoder();
+
+	/** Pulse widths in seconds; must match the host settings. */
+	void setPulseWidths(double frame, double bitShort, double bitLong);
+	void setSampleRate(double fs);
+	void setNumBits(int n);
+	void setNominalFramerate(double fps);
+
+	int getNumBits() const { return numBits; }
+
+	/** Even parity bit sent after the data bits of a barcode. */
+	static int parityBit(int64_t value);
+
+	/** Barcodes ignored so far (parity errors and unconfirmed jumps). */
+	int64_t getNumRejected() const { return numRejected; }
+
+	/** Forget all state (e.g., when the host restarts its frame counter). */
+	void reset();
+
+	/** Feed one edge of the strobe TTL line. */
+	void addEdge(int64_t sampleNumber, bool state);
+
+	/** Complete the last pulse without waiting for its barcode. */
+	void flush();
+
+	/** Retrieve the next completed frame pulse; returns false if none. */
+	bool popPulse(FramePulse& pulse);
+
+	/** Samples per frame as currently estimated from the pulse train. */
+	double getFramePeriod() const { return period; }
+
+private:
+	void updateThresholds();
+	void finishPending();
+	void handlePulse(int64_t onset, int64_t width);
+	void handleBarcode(int64_t value);
+	int64_t inferIndex(int64_t sampleNumber) const;
+	int64_t unwrapIndex(int64_t value, int64_t predicted) const;
+
+	// largest accepted difference between barcode and inferred index
+	static const int64_t MAX_BARCODE_DEVIATION = 2;
+
+	double sampleRate;
+	double framePulseWidth;
+	double bitShortWidth;
+	double bitLongWidth;
+	int numBits;
+
+	// width thresholds in samples
+	double frameThreshold;
+	double bitThreshold;
+
+	int64_t risingEdge;
+	bool high;
+
+	bool hasPending;
+	FramePulse pending;
+	int64_t barcodeValue;
+	int barcodeCount;
+
+	double period;
+	int64_t lastPulseSample;
+
+	bool hasAnchor;
+	bool anchorFromBarcode;
+	int64_t anchorSample;
+	int64_t anchorIndex;
+
+	// implausible barcode waiting for confirmation by the next one
+	bool hasCandidate;
+	int64_t candidateSample;
+	int64_t candidateIndex;
+
+	int64_t numRejected;
+
+	std::deque<FramePulse> pulses;
+};
+
+
+#endif  // __BARCODEDECODER_H__
@@ -0,0 +1,161 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <iostream>
+#include "CameraClient.h"
+
+
+const int POLL_INTERVAL = 100;
+
+
+CameraClient::CameraClient(void* ctx)
+	: context(ctx), socket(NULL), aborted(false)
+{
+}
+
+
+CameraClient::~CameraClient()
+{
+	close();
+}
+
+
+void CameraClient::setUrl(const std::string& u)
+{
+	if (u != url)
+	{
+		close();
+		url = u;
+	}
+}
+
+
+void CameraClient::close()
+{
+	if (socket != NULL)
+	{
+		zmq_close(socket);
+		socket = NULL;
+	}
+}
+
+
+bool CameraClient::open()
+{
+	if (socket != NULL)
+	{
+		return true;
+	}
+
+	if (url.empty())
+	{
+		return false;
+	}
+
+	socket = zmq_socket(context, ZMQ_REQ);
+
+	// don't block the context on exit if the host is gone
+	int linger = 0;
+	zmq_setsockopt(socket, ZMQ_LINGER, &linger, sizeof(int));
+
+	if (!identity.empty())
+	{
+		zmq_setsockopt(socket, ZMQ_IDENTITY, identity.data(), identity.size());
+	}
+
+	// a timed-out request must not leave its late reply for the next one
+	int on = 1;
+	zmq_setsockopt(socket, ZMQ_REQ_CORRELATE, &on, sizeof(int));
+	zmq_setsockopt(socket, ZMQ_REQ_RELAXED, &on, sizeof(int));
+
+	if (zmq_connect(socket, url.c_str()) != 0)
+	{
+		std::cout << "RPiCam failed to connect to " << url << ": " << zmq_strerror(zmq_errno()) << "\n";
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+
+bool CameraClient::request(const std::string& msg, std::vector<ZmqFrame>& reply, int timeout)
+{
+	reply.clear();
+
+	if (aborted || !open())
+	{
+		return false;
+	}
+
+	if (zmq_send(socket, msg.data(), msg.size(), 0) < 0)
+	{
+		close();
+		return false;
+	}
+
+	zmq_pollitem_t item = { socket, 0, ZMQ_POLLIN, 0 };
+	for (int waited = 0; (timeout < 0 || waited < timeout) && !aborted; waited += POLL_INTERVAL)
+	{
+		if (zmq_poll(&item, 1, POLL_INTERVAL) > 0)
+		{
+			break;
+		}
+	}
+
+	if (!(item.revents & ZMQ_POLLIN))
+	{
+		// (the socket stays usable, see ZMQ_REQ_RELAXED)
+		return false;
+	}
+
+	int more = 1;
+	while (more)
+	{
+		reply.emplace_back();
+		if (zmq_msg_recv(reply.back().get(), socket, 0) < 0)
+		{
+			reply.clear();
+			close();
+			return false;
+		}
+		more = zmq_msg_more(reply.back().get());
+	}
+
+	return true;
+}
+
+
+bool CameraClient::request(const std::string& msg, std::string& reply, int timeout)
+{
+	std::vector<ZmqFrame> frames;
+
+	if (!request(msg, frames, timeout) || frames.empty())
+	{
+		reply.clear();
+		return false;
+	}
+
+	reply = frames[0].str();
+	return true;
+}
@@ -0,0 +1,122 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __CAMERACLIENT_H__
+#define __CAMERACLIENT_H__
+
+#include <zmq.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+
+/**
+
+  One frame of a multipart zmq message
+
+  Owns the zmq message so that received data can be used (and handed on)
+  without copying it. Move-only.
+
+*/
+
+class ZmqFrame
+{
+public:
+	ZmqFrame() { zmq_msg_init(&msg); }
+	~ZmqFrame() { zmq_msg_close(&msg); }
+
+	ZmqFrame(ZmqFrame&& other) noexcept { zmq_msg_init(&msg); zmq_msg_move(&msg, &other.msg); }
+	ZmqFrame& operator=(ZmqFrame&& other) noexcept { zmq_msg_move(&msg, &other.msg); return *this; }
+
+	ZmqFrame(const ZmqFrame&) = delete;
+	ZmqFrame& operator=(const ZmqFrame&) = delete;
+
+	const void* data() const { return zmq_msg_data(const_cast<zmq_msg_t*>(&msg)); }
+	size_t size() const { return zmq_msg_size(const_cast<zmq_msg_t*>(&msg)); }
+	std::string str() const { return std::string(static_cast<const char*>(data()), size()); }
+
+	zmq_msg_t* get() { return &msg; }
+
+private:
+	zmq_msg_t msg;
+};
+
+
+/**
+
+  Request/reply connection to the command port of the rpicamera host
+
+  The req socket is kept open after a timeout: it may send the next
+  request without the last reply (ZMQ_REQ_RELAXED), and replies are matched
+  to their request (ZMQ_REQ_CORRELATE), so a late reply to a timed-out
+  request is discarded instead of being read as the reply to the next one.
+  The socket is only reopened after an error. Replies are polled in short
+  intervals so that waiting can be aborted from another thread (see
+  abort()).
+
+  @see RPiCamProtocol
+
+*/
+
+class CameraClient
+{
+public:
+	CameraClient(void* context);
+	~CameraClient();
+
+	/** Connects on the next request; an empty url disconnects. */
+	void setUrl(const std::string& url);
+	std::string getUrl() const { return url; }
+
+	/** Identity of the socket, so that the host recognizes the client (e.g.,
+		as holder of the command lease). */
+	void setIdentity(const std::string& id) { identity = id; }
+	std::string getIdentity() const { return identity; }
+	bool isConnected() const { return !url.empty(); }
+
+	/** Send a request and wait for the reply (timeout in ms, -1: no timeout).
+		Returns false on timeout, error or abort. */
+	bool request(const std::string& msg, std::string& reply, int timeout = -1);
+
+	/** Same for multipart replies; frames are received without copying. */
+	bool request(const std::string& msg, std::vector<ZmqFrame>& reply, int timeout = -1);
+
+	/** Stop waiting for the current (and any further) reply. */
+	void abort() { aborted = true; }
+	void resetAbort() { aborted = false; }
+
+	void close();
+
+private:
+	bool open();
+
+	void* context;
+	void* socket;
+	std::string url;
+	std::string identity;
+	std::atomic<bool> aborted;
+};
+
+
+#endif  // __CAMERACLIENT_H__
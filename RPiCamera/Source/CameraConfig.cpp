@@ -0,0 +1,50 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "CameraConfig.h"
+
+#include <algorithm>
+
+
+CameraConfigStore::CameraConfigStore(const CameraConfig& initial)
+	: current(std::make_shared<const CameraConfig>(initial))
+{
+}
+
+
+CameraConfigStore::Snapshot CameraConfigStore::get() const
+{
+	return std::atomic_load(&current);
+}
+
+
+void CameraConfigStore::publish(const Snapshot& config)
+{
+	retired.push_back(std::atomic_load(&current));
+	std::atomic_store(&current, config);
+
+	// (a replaced snapshot can no longer be loaded, only the remaining
+	// holders keep it)
+	retired.erase(std::remove_if(retired.begin(), retired.end(),
+		[](const Snapshot& s) { return s.use_count() == 1; }), retired.end());
+}
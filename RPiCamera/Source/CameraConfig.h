@@ -0,0 +1,110 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __CAMERACONFIG_H__
+#define __CAMERACONFIG_H__
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "RPiCamProtocol.h"
+
+
+/** Camera settings of the plugin at one point in time */
+
+struct CameraConfig
+{
+	int64_t version;	// incremented by every change
+	int width;
+	int height;
+	int framerate;
+	bool vflip;
+	bool hflip;
+	int zoom[4];		// percent: left, bottom, width, height
+	bool recording;
+	std::vector<RoiSettings> rois;	// recorded as separate files
+};
+
+
+/**
+
+  Versioned snapshots of the camera settings
+
+  A change copies the current settings, modifies the copy and publishes it
+  with std::atomic_store; readers (e.g. the processing thread) take a
+  reference with std::atomic_load and keep a consistent snapshot for as
+  long as they hold it. A published snapshot is never modified.
+
+  Replaced snapshots are kept until no reader holds them any more and are
+  then released by the next change, so that the processing thread never
+  frees one. Writers are serialized by a mutex.
+
+  The version is sent with every command ("Cfg=<version>") and written
+  into the recorded events, so that every frame can be related to the
+  settings in force when it was recorded.
+
+  @see RPiCam
+
+*/
+
+class CameraConfigStore
+{
+public:
+	typedef std::shared_ptr<const CameraConfig> Snapshot;
+
+	CameraConfigStore(const CameraConfig& initial);
+
+	/** The current settings. */
+	Snapshot get() const;
+	int64_t getVersion() const { return get()->version; }
+
+	/** Apply a change to a copy of the current settings and publish it with
+		the next version; returns the published settings. */
+	template <typename Function>
+	Snapshot update(Function change)
+	{
+		std::lock_guard<std::mutex> guard(writeLock);
+
+		std::shared_ptr<CameraConfig> config = std::make_shared<CameraConfig>(*get());
+		change(*config);
+		config->version++;
+		publish(config);
+
+		return config;
+	}
+
+private:
+	void publish(const Snapshot& config);
+
+	Snapshot current;
+	std::vector<Snapshot> retired;
+	std::mutex writeLock;
+
+	CameraConfigStore(const CameraConfigStore&) = delete;
+	CameraConfigStore& operator=(const CameraConfigStore&) = delete;
+};
+
+
+#endif  // __CAMERACONFIG_H__
@@ -0,0 +1,129 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "CameraDiscovery.h"
+#include "CameraClient.h"
+#include "RPiCamProtocol.h"
+
+#include <thread>
+#include <vector>
+
+
+Array<DiscoveredCamera> CameraDiscovery::find(void* context, int timeout)
+{
+	Array<DiscoveredCamera> cameras;
+
+	DatagramSocket socket(true);
+	if (!socket.bindToPort(0))
+	{
+		std::cout << "RPiCam could not open discovery socket\n";
+		return cameras;
+	}
+
+	std::string msg = RPiCamProtocol::discover();
+	if (socket.write("255.255.255.255", RPiCamProtocol::DISCOVERY_PORT, msg.data(), (int) msg.size()) < 0)
+	{
+		std::cout << "RPiCam could not send discovery request\n";
+		return cameras;
+	}
+
+	// collect announcements until the timeout
+	const double deadline = Time::getMillisecondCounterHiRes() + timeout;
+	char buffer[512];
+
+	for (;;)
+	{
+		int remaining = (int) (deadline - Time::getMillisecondCounterHiRes());
+		if (remaining <= 0 || socket.waitUntilReady(true, remaining) != 1)
+		{
+			break;
+		}
+
+		String sender;
+		int senderPort = 0;
+		int n = socket.read(buffer, sizeof(buffer), false, sender, senderPort);
+
+		CameraAnnouncement announcement;
+		if (n <= 0 || !RPiCamProtocol::parseAnnouncement(std::string(buffer, n), announcement))
+		{
+			continue;
+		}
+
+		bool known = false;
+		for (int i = 0; i < cameras.size(); i++)
+		{
+			known |= cameras[i].address == sender && cameras[i].port == announcement.port;
+		}
+
+		if (!known)
+		{
+			DiscoveredCamera camera;
+			camera.address = sender;
+			camera.port = announcement.port;
+			camera.cameraId = announcement.cameraId;
+			camera.sensor = announcement.sensor;
+			camera.roundTrip = -1;
+			cameras.add(camera);
+		}
+	}
+
+	// probe all command ports at the same time
+	std::vector<std::thread> threads;
+	for (int i = 0; i < cameras.size(); i++)
+	{
+		threads.push_back(std::thread(&CameraDiscovery::probe, context, std::ref(cameras.getReference(i)), timeout));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+
+	struct CameraIdComparator
+	{
+		static int compareElements(const DiscoveredCamera& a, const DiscoveredCamera& b)
+		{
+			int c = a.cameraId.compareNatural(b.cameraId);
+			return c != 0 ? c : a.address.compareNatural(b.address);
+		}
+	};
+	CameraIdComparator comparator;
+	cameras.sort(comparator);
+
+	return cameras;
+}
+
+
+void CameraDiscovery::probe(void* context, DiscoveredCamera& camera, int timeout)
+{
+	CameraClient client(context);
+	client.setUrl(RPiCamProtocol::tcpUrl(camera.address.toStdString(), camera.port));
+
+	double t0 = Time::getMillisecondCounterHiRes();
+	std::string reply;
+	if (client.request(RPiCamProtocol::status(), reply, timeout))
+	{
+		camera.roundTrip = Time::getMillisecondCounterHiRes() - t0;
+	}
+
+	client.close();
+}
@@ -0,0 +1,64 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __CAMERADISCOVERY_H__
+#define __CAMERADISCOVERY_H__
+
+#include <ProcessorHeaders.h>
+
+
+struct DiscoveredCamera
+{
+	String address;
+	int port;
+	String cameraId;
+	String sensor;
+	double roundTrip;	// ms for a "Status" request (< 0: command port not reachable)
+};
+
+
+/**
+
+  Finds rpicamera hosts on the local network
+
+  A "Discover" datagram is broadcast to the hosts' discovery port and all
+  announcements received within the timeout are collected. The command
+  port of every host is then probed in parallel (one thread and zmq socket
+  per host), so finding many cameras takes a single timeout instead of one
+  blocking connection attempt per camera.
+
+  @see RPiCam, RPiCamProtocol
+
+*/
+
+class CameraDiscovery
+{
+public:
+	static Array<DiscoveredCamera> find(void* context, int timeout);
+
+private:
+	static void probe(void* context, DiscoveredCamera& camera, int timeout);
+};
+
+
+#endif  // __CAMERADISCOVERY_H__
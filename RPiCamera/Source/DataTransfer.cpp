@@ -0,0 +1,531 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2015 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "DataTransfer.h"
+
+
+const int CHUNK_SIZE = 1024 * 1024;
+const int CHUNK_TIMEOUT = 10000;
+const int CHECKSUM_TIMEOUT = 300000;	// whole files are read on the RPi
+const int LIST_TIMEOUT = 5000;
+const int MAX_CHUNK_ATTEMPTS = 3;
+const int MAX_JOB_ATTEMPTS = 10;
+const int RETRY_INTERVAL = 5000;
+const int QUEUE_VERSION = 1;
+
+
+static juce::uint32 crc32(const void* data, size_t size, juce::uint32 value)
+{
+	// same polynomial as zlib.crc32
+	static juce::uint32 table[256];
+	static bool initialized = false;
+
+	if (!initialized)
+	{
+		for (juce::uint32 i = 0; i < 256; i++)
+		{
+			juce::uint32 c = i;
+			for (int k = 0; k < 8; k++)
+			{
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			table[i] = c;
+		}
+		initialized = true;
+	}
+
+	const juce::uint8* p = static_cast<const juce::uint8*>(data);
+	value = ~value;
+	for (size_t i = 0; i < size; i++)
+	{
+		value = table[(value ^ p[i]) & 0xff] ^ (value >> 8);
+	}
+
+	return ~value;
+}
+
+
+static String getLocalChecksum(const File& file, juce::int64 length)
+{
+	FileInputStream in(file);
+	if (in.failedToOpen())
+	{
+		return String();
+	}
+
+	HeapBlock<char> block(CHUNK_SIZE);
+	juce::uint32 value = 0;
+	juce::int64 remaining = length < 0 ? in.getTotalLength() : length;
+
+	while (remaining > 0)
+	{
+		int n = in.read(block, (int) jmin((juce::int64) CHUNK_SIZE, remaining));
+		if (n <= 0)
+		{
+			break;
+		}
+		value = crc32(block, n, value);
+		remaining -= n;
+	}
+
+	return String::toHexString((int) value).paddedLeft('0', 8);
+}
+
+
+DataTransfer::DataTransfer(void* ctx)
+	: Thread("RPiCam data transfer"), client(ctx),
+	  bytesDone(0), bytesTotal(0), paused(0), maxRate(0), rateStart(0), rateBytes(0)
+{
+	// build the crc table before the thread can use it
+	crc32(NULL, 0, 0);
+}
+
+
+DataTransfer::~DataTransfer()
+{
+	// requests are polled in short intervals and can be aborted
+	signalThreadShouldExit();
+	client.abort();
+	stopThread(2000);
+}
+
+
+void DataTransfer::setUrl(const String& u)
+{
+	// (jobs added before keep the port they were added with)
+	const ScopedLock sl(lock);
+	url = u;
+}
+
+
+void DataTransfer::add(const String& remoteDir, const File& localDir)
+{
+	TransferJob job;
+	job.remoteDir = remoteDir;
+	job.localDir = localDir;
+	job.attempts = 0;
+
+	{
+		const ScopedLock sl(lock);
+		job.url = url;
+		jobs.add(job);
+		saveQueue();
+	}
+
+	notify();
+}
+
+
+void DataTransfer::setQueueFile(const File& file)
+{
+	{
+		const ScopedLock sl(lock);
+
+		if (file == queueFile)
+		{
+			return;
+		}
+		queueFile = file;
+
+		// {"version": 1, "jobs": [{"url", "remote", "local", "attempts"}, ...]}
+		var saved = JSON::parse(file);
+		var list = saved["jobs"];
+
+		for (int i = 0; i < list.size(); i++)
+		{
+			String local = list[i]["local"].toString();
+			if (list[i]["remote"].toString().isEmpty() || !File::isAbsolutePath(local))
+			{
+				continue;
+			}
+
+			TransferJob job;
+			job.url = list[i]["url"].toString();
+			job.remoteDir = list[i]["remote"].toString();
+			job.localDir = File(local);
+			job.attempts = (int) list[i]["attempts"];
+
+			bool queued = false;
+			for (int j = 0; j < jobs.size() && !queued; j++)
+			{
+				queued = jobs[j].url == job.url && jobs[j].remoteDir == job.remoteDir && jobs[j].localDir == job.localDir;
+			}
+
+			if (!queued)
+			{
+				std::cout << "RPiCam resuming copy of " << job.remoteDir.toStdString() << " to " << job.localDir.getFullPathName().toStdString() << "\n";
+				jobs.add(job);
+			}
+		}
+
+		saveQueue();
+	}
+
+	notify();
+}
+
+
+void DataTransfer::saveQueue()
+{
+	// (called with the lock held; the file is small)
+	if (queueFile == File())
+	{
+		return;
+	}
+
+	if (jobs.size() == 0)
+	{
+		queueFile.deleteFile();
+		return;
+	}
+
+	var list;
+	for (int i = 0; i < jobs.size(); i++)
+	{
+		DynamicObject::Ptr job = new DynamicObject();
+		job->setProperty("url", jobs[i].url);
+		job->setProperty("remote", jobs[i].remoteDir);
+		job->setProperty("local", jobs[i].localDir.getFullPathName());
+		job->setProperty("attempts", jobs[i].attempts);
+		list.append(var(job.get()));
+	}
+
+	DynamicObject::Ptr queue = new DynamicObject();
+	queue->setProperty("version", QUEUE_VERSION);
+	queue->setProperty("jobs", list);
+
+	queueFile.getParentDirectory().createDirectory();
+	if (!queueFile.replaceWithText(JSON::toString(var(queue.get()))))
+	{
+		std::cout << "RPiCam could not write " << queueFile.getFullPathName().toStdString() << "\n";
+	}
+}
+
+
+void DataTransfer::setPaused(bool state)
+{
+	paused = state ? 1 : 0;
+	notify();
+}
+
+
+void DataTransfer::setMaxRate(int kBytesPerSecond)
+{
+	maxRate = jmax(0, kBytesPerSecond);
+}
+
+
+String DataTransfer::getStatus()
+{
+	const ScopedLock sl(lock);
+
+	if (jobs.size() == 0)
+	{
+		return status;
+	}
+
+	String s = paused.get() ? "Paused" : "Copying";
+	if (bytesTotal > 0)
+	{
+		s += " " + String((int) (100 * bytesDone / bytesTotal)) + "%";
+	}
+	if (jobs.size() > 1)
+	{
+		s += " (" + String(jobs.size()) + ")";
+	}
+
+	return s;
+}
+
+
+bool DataTransfer::request(const String& msg, std::vector<ZmqFrame>& reply, int timeout)
+{
+	if (jobUrl != clientUrl)
+	{
+		client.setUrl(jobUrl.toStdString());
+		clientUrl = jobUrl;
+	}
+
+	// chunks are verified and written straight from the received messages
+	return client.request(msg.toStdString(), reply, timeout) && !reply.empty();
+}
+
+
+String DataTransfer::getRemoteChecksum(const String& remotePath, juce::int64 length)
+{
+	std::vector<ZmqFrame> reply;
+	if (!request("Checksum " + String(length) + " " + remotePath, reply, CHECKSUM_TIMEOUT))
+	{
+		return String();
+	}
+
+	String s = String(reply[0].str()).trim();
+	return s.length() == 8 ? s : String();
+}
+
+
+void DataTransfer::throttle(juce::int64 numBytes)
+{
+	int rate = maxRate.get();
+	rateBytes += numBytes;
+
+	if (rate > 0)
+	{
+		double expected = 1000. * rateBytes / (rate * 1024.);
+		double elapsed = Time::getMillisecondCounterHiRes() - rateStart;
+
+		if (expected > elapsed)
+		{
+			Thread::wait((int) (expected - elapsed));
+		}
+	}
+}
+
+
+bool DataTransfer::transferFile(const String& remotePath, const File& localFile, juce::int64 size)
+{
+	juce::int64 offset = localFile.existsAsFile() ? localFile.getSize() : 0;
+
+	if (offset > size)
+	{
+		localFile.deleteFile();
+		offset = 0;
+	}
+
+	// resume only if the part copied so far is identical
+	if (offset > 0)
+	{
+		String remote = getRemoteChecksum(remotePath, offset);
+		if (remote.isEmpty())
+		{
+			return false;
+		}
+
+		if (remote != getLocalChecksum(localFile, offset))
+		{
+			localFile.deleteFile();
+			offset = 0;
+		}
+	}
+
+	{
+		const ScopedLock sl(lock);
+		bytesDone += offset;
+	}
+
+	if (offset < size)
+	{
+		// appends to an existing file
+		FileOutputStream out(localFile);
+		if (out.failedToOpen())
+		{
+			std::cout << "RPiCam could not open " << localFile.getFullPathName().toStdString() << "\n";
+			return false;
+		}
+
+		std::vector<ZmqFrame> reply;
+		int attempts = 0;
+
+		while (offset < size)
+		{
+			if (threadShouldExit() || paused.get())
+			{
+				return false;
+			}
+
+			String msg = "ReadChunk " + String(offset) + " " + String(CHUNK_SIZE) + " " + remotePath;
+			if (!request(msg, reply, CHUNK_TIMEOUT) || reply.size() != 2)
+			{
+				return false;
+			}
+
+			// "Chunk <offset> <size> <crc>"
+			StringArray header = StringArray::fromTokens(String(reply[0].str()), false);
+			const ZmqFrame& chunk = reply[1];
+
+			bool valid = header.size() == 4 && header[0] == "Chunk"
+				&& header[1].getLargeIntValue() == offset
+				&& header[2].getIntValue() == (int) chunk.size()
+				&& (juce::uint32) header[3].getHexValue64() == crc32(chunk.data(), chunk.size(), 0);
+
+			if (!valid)
+			{
+				if (++attempts >= MAX_CHUNK_ATTEMPTS)
+				{
+					return false;
+				}
+				continue;
+			}
+
+			if (chunk.size() == 0)
+			{
+				// file is smaller than listed
+				break;
+			}
+
+			attempts = 0;
+			out.write(chunk.data(), chunk.size());
+			offset += chunk.size();
+
+			{
+				const ScopedLock sl(lock);
+				bytesDone += chunk.size();
+			}
+
+			throttle(chunk.size());
+		}
+
+		out.flush();
+	}
+
+	String remote = getRemoteChecksum(remotePath, -1);
+	if (remote.isEmpty())
+	{
+		return false;
+	}
+
+	if (remote != getLocalChecksum(localFile, -1))
+	{
+		std::cout << "RPiCam checksum mismatch for " << localFile.getFullPathName().toStdString() << "\n";
+		localFile.deleteFile();
+		return false;
+	}
+
+	return true;
+}
+
+
+bool DataTransfer::transferJob(const TransferJob& job)
+{
+	std::vector<ZmqFrame> reply;
+	if (!request("ListFiles " + job.remoteDir, reply, LIST_TIMEOUT))
+	{
+		return false;
+	}
+
+	var files = JSON::parse(String(reply[0].str()));
+	if (!files.isArray())
+	{
+		std::cout << "RPiCam could not list files in " << job.remoteDir.toStdString() << ": " << reply[0].str() << "\n";
+		return false;
+	}
+
+	juce::int64 total = 0;
+	for (int i = 0; i < files.size(); i++)
+	{
+		total += (juce::int64) files[i]["size"];
+	}
+
+	{
+		const ScopedLock sl(lock);
+		bytesDone = 0;
+		bytesTotal = total;
+	}
+
+	if (!job.localDir.createDirectory())
+	{
+		std::cout << "RPiCam could not create " << job.localDir.getFullPathName().toStdString() << "\n";
+		return false;
+	}
+
+	rateStart = Time::getMillisecondCounterHiRes();
+	rateBytes = 0;
+
+	for (int i = 0; i < files.size(); i++)
+	{
+		String name = File::createLegalFileName(files[i]["name"].toString());
+		juce::int64 size = (juce::int64) files[i]["size"];
+
+		if (!transferFile(job.remoteDir + "/" + name, job.localDir.getChildFile(name), size))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void DataTransfer::run()
+{
+	while (!threadShouldExit())
+	{
+		TransferJob job;
+		bool pending = false;
+		{
+			const ScopedLock sl(lock);
+			if (jobs.size() > 0 && !paused.get())
+			{
+				job = jobs[0];
+				pending = true;
+			}
+		}
+
+		if (!pending)
+		{
+			wait(500);
+			continue;
+		}
+
+		// jobs without a port (none connected when added) use the current one
+		if (job.url.isEmpty())
+		{
+			const ScopedLock sl(lock);
+			job.url = url;
+		}
+		jobUrl = job.url;
+
+		std::cout << "RPiCam copying " << job.remoteDir.toStdString() << " to " << job.localDir.getFullPathName().toStdString() << "\n";
+
+		if (transferJob(job))
+		{
+			const ScopedLock sl(lock);
+			jobs.remove(0);
+			status = "Copied";
+			saveQueue();
+		}
+		else if (!paused.get() && !threadShouldExit())
+		{
+			bool failed = false;
+			{
+				const ScopedLock sl(lock);
+				if (++jobs.getReference(0).attempts >= MAX_JOB_ATTEMPTS)
+				{
+					jobs.remove(0);
+					status = "Copy failed";
+					failed = true;
+				}
+				saveQueue();
+			}
+
+			if (failed)
+			{
+				std::cout << "RPiCam giving up copying " << job.remoteDir.toStdString() << "\n";
+			}
+
+			wait(RETRY_INTERVAL);
+		}
+	}
+
+	client.close();
+}
@@ -0,0 +1,117 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __DATATRANSFER_H__
+#define __DATATRANSFER_H__
+
+#include <ProcessorHeaders.h>
+#include "CameraClient.h"
+
+
+struct TransferJob
+{
+	String url;		// command port of the RPi the files are on
+	String remoteDir;
+	File localDir;
+	int attempts;
+};
+
+
+/**
+
+  Copies the files of finished recordings from the RPi
+
+  Runs on its own thread with its own zmq socket (connected to the RPi's
+  command port) and pulls files in chunks ("ListFiles", "ReadChunk" and
+  "Checksum", see Python/rpicamera/files.py). Every chunk is verified
+  using its CRC-32; partially copied files are resumed after checking the
+  CRC of the existing part and complete files are verified against the
+  CRC of the file on the RPi. Transfers are paused while recording and
+  can be rate limited.
+
+  Pending jobs are kept in a JSON file (see setQueueFile) and resumed when
+  the GUI is started again, from the RPi they were added for.
+
+  @see RPiCam
+
+*/
+
+class DataTransfer : public Thread
+{
+public:
+	DataTransfer(void* context);
+	~DataTransfer();
+
+	void setUrl(const String& url);
+
+	/** Copy all files in remoteDir (on the RPi) to localDir. */
+	void add(const String& remoteDir, const File& localDir);
+
+	/** Keep the pending jobs in this file; jobs saved in it are added. */
+	void setQueueFile(const File& file);
+
+	void setPaused(bool state);
+
+	/** Maximum transfer rate in kB/s (0: unlimited). */
+	void setMaxRate(int kBytesPerSecond);
+	int getMaxRate() { return maxRate.get(); }
+
+	/** Short description of the transfer state (empty if idle). */
+	String getStatus();
+
+	void run() override;
+
+private:
+	bool request(const String& msg, std::vector<ZmqFrame>& reply, int timeout);
+	void saveQueue();
+
+	bool transferJob(const TransferJob& job);
+	bool transferFile(const String& remotePath, const File& localFile, juce::int64 size);
+	String getRemoteChecksum(const String& remotePath, juce::int64 length);
+	void throttle(juce::int64 numBytes);
+
+	CameraClient client;
+
+	// port the client is connected to and port of the current job (only
+	// used on the thread)
+	String clientUrl;
+	String jobUrl;
+
+	CriticalSection lock;
+	String url;
+	Array<TransferJob> jobs;
+	File queueFile;
+	String status;
+	juce::int64 bytesDone;
+	juce::int64 bytesTotal;
+
+	Atomic<int> paused;
+	Atomic<int> maxRate;
+	double rateStart;
+	juce::int64 rateBytes;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DataTransfer);
+};
+
+
+#endif  // __DATATRANSFER_H__
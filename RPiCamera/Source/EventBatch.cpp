@@ -0,0 +1,113 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "EventBatch.h"
+
+#include <cstring>
+
+
+EventBatch::EventBatch(size_t capacity, size_t maxLength)
+	: events(capacity), text(new char[capacity * maxLength]), maxTextLength(maxLength), numEvents(0), numDropped(0)
+{
+	for (size_t i = 0; i < capacity; i++)
+	{
+		events[i].text = &text[i * maxLength];
+		events[i].length = 0;
+	}
+}
+
+
+BatchedEvent* EventBatch::next(int64_t sampleNumber, int64_t softwareTime)
+{
+	if (numEvents == events.size())
+	{
+		numDropped++;
+		return nullptr;
+	}
+
+	BatchedEvent* event = &events[numEvents++];
+	event->sampleNumber = sampleNumber;
+	event->softwareTime = softwareTime;
+	event->length = 0;
+
+	return event;
+}
+
+
+bool EventBatch::add(int64_t sampleNumber, int64_t softwareTime, const char* s, size_t length)
+{
+	BatchedEvent* event = next(sampleNumber, softwareTime);
+	if (event == nullptr)
+	{
+		return false;
+	}
+
+	event->length = length < maxTextLength ? length : maxTextLength;
+	memcpy(event->text, s, event->length);
+
+	return true;
+}
+
+
+bool EventBatch::add(int64_t sampleNumber, int64_t softwareTime, const std::string& s)
+{
+	return add(sampleNumber, softwareTime, s.data(), s.size());
+}
+
+
+bool EventBatch::addFrame(int64_t sampleNumber, int64_t softwareTime, const std::string& prefix, int64_t frameIndex)
+{
+	BatchedEvent* event = next(sampleNumber, softwareTime);
+	if (event == nullptr)
+	{
+		return false;
+	}
+
+	char* dst = event->text;
+	size_t n = prefix.size() < maxTextLength ? prefix.size() : maxTextLength;
+	memcpy(dst, prefix.data(), n);
+
+	// digits are written backwards into a small buffer
+	char digits[24];
+	size_t numDigits = 0;
+	uint64_t value = frameIndex < 0 ? 0 - (uint64_t) frameIndex : (uint64_t) frameIndex;
+	do
+	{
+		digits[numDigits++] = (char) ('0' + value % 10);
+		value /= 10;
+	}
+	while (value > 0);
+
+	if (frameIndex < 0 && n < maxTextLength)
+	{
+		dst[n++] = '-';
+	}
+	while (numDigits > 0 && n < maxTextLength)
+	{
+		dst[n++] = digits[--numDigits];
+	}
+
+	event->length = n;
+
+	return true;
+}
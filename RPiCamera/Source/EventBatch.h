@@ -0,0 +1,95 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __EVENTBATCH_H__
+#define __EVENTBATCH_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+struct BatchedEvent
+{
+	int64_t sampleNumber;
+	int64_t softwareTime;
+	char* text;		// slot of the batch, not null-terminated
+	size_t length;
+};
+
+
+/**
+
+  Text events collected during one processing block
+
+  Events are formatted into preallocated slots of fixed size, so adding
+  them never allocates; the events of a block are emitted together at its
+  end (see RPiCam::emitEvents). Events that do not fit are counted as
+  dropped, texts longer than the slot size are truncated.
+
+  Only collecting the events is allocation-free: emitting them still
+  creates one TextEvent (with its own copy of the text and the metadata)
+  per event, as the event API of the GUI offers no way to reuse one.
+
+  @see RPiCam
+
+*/
+
+class EventBatch
+{
+public:
+	EventBatch(size_t capacity = 1024, size_t maxTextLength = 256);
+
+	void clear() { numEvents = 0; }
+
+	bool add(int64_t sampleNumber, int64_t softwareTime, const char* text, size_t length);
+	bool add(int64_t sampleNumber, int64_t softwareTime, const std::string& text);
+
+	/** "<prefix><frame index>", e.g. "RPiCam Address=... Frame=123" */
+	bool addFrame(int64_t sampleNumber, int64_t softwareTime, const std::string& prefix, int64_t frameIndex);
+
+	size_t size() const { return numEvents; }
+	bool empty() const { return numEvents == 0; }
+	const BatchedEvent& operator[](size_t i) const { return events[i]; }
+
+	size_t getCapacity() const { return events.size(); }
+	int64_t getNumDropped() const { return numDropped; }
+
+private:
+	BatchedEvent* next(int64_t sampleNumber, int64_t softwareTime);
+
+	std::vector<BatchedEvent> events;
+	std::unique_ptr<char[]> text;
+	size_t maxTextLength;
+	size_t numEvents;
+	int64_t numDropped;
+
+	// events point into the text buffer
+	EventBatch(const EventBatch&) = delete;
+	EventBatch& operator=(const EventBatch&) = delete;
+};
+
+
+#endif  // __EVENTBATCH_H__
@@ -0,0 +1,409 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2015 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include "FrameMatcher.h"
+
+
+FrameMatcher::FrameMatcher()
+	: sampleRate(30000.), framePeriodUs(1e6 / 30.), tolerance(0.5), forgetting(0.999)
+{
+	reset();
+}
+
+
+void FrameMatcher::reset()
+{
+	frames.clear();
+	pendingPulses.clear();
+	ptsLookup.clear();
+	numMatched = 0;
+	numDropped = 0;
+
+	ptsOrigin = 0;
+	sampleOrigin = 0;
+	fitWeight = 0;
+	meanX = 0;
+	meanY = 0;
+	covXX = 0;
+	covXY = 0;
+	numFitPoints = 0;
+}
+
+
+void FrameMatcher::setNominalFramerate(double fps)
+{
+	if (fps > 0)
+	{
+		framePeriodUs = 1e6 / fps;
+	}
+}
+
+
+void FrameMatcher::addFrame(int64_t frameIndex, int64_t pts)
+{
+	if (frameIndex < 0)
+	{
+		return;
+	}
+
+	ensureFrame(frameIndex);
+
+	FrameTableEntry& entry = frames[frameIndex];
+	if (entry.pts < 0 && pts >= 0)
+	{
+		entry.pts = pts;
+
+		// the encoder's pts increase monotonically -> append in most cases
+		std::pair<int64_t, int64_t> item(pts, frameIndex);
+		if (ptsLookup.empty() || ptsLookup.back() < item)
+		{
+			ptsLookup.push_back(item);
+		}
+		else
+		{
+			ptsLookup.insert(std::lower_bound(ptsLookup.begin(), ptsLookup.end(), item), item);
+		}
+	}
+
+	while (!pendingPulses.empty() && matchPulse(pendingPulses.front()))
+	{
+		pendingPulses.pop_front();
+	}
+}
+
+
+void FrameMatcher::ensureFrame(int64_t frameIndex)
+{
+	while ((int64_t) frames.size() <= frameIndex)
+	{
+		FrameTableEntry e = { (int64_t) frames.size(), -1, -1, 0, 0 };
+		frames.push_back(e);
+	}
+}
+
+
+void FrameMatcher::addPulse(const FramePulse& pulse)
+{
+	if (!pendingPulses.empty() || !matchPulse(pulse))
+	{
+		pendingPulses.push_back(pulse);
+
+		// no frame information (or a pulse that never matches) must not
+		// grow the queue without limit
+		while (pendingPulses.size() > MAX_PENDING_PULSES)
+		{
+			pendingPulses.pop_front();
+			numDropped++;
+		}
+	}
+}
+
+
+bool FrameMatcher::barcodeFits(const FramePulse& pulse, double pts) const
+{
+	// the barcode's frame must have been streamed with a pts close to the
+	// one predicted for the pulse
+	if (pulse.frameIndex < 0 || pulse.frameIndex >= (int64_t) frames.size())
+	{
+		return false;
+	}
+
+	const FrameTableEntry& entry = frames[pulse.frameIndex];
+
+	return entry.pts >= 0 && std::fabs(entry.pts - pts) <= tolerance * framePeriodUs;
+}
+
+
+bool FrameMatcher::matchPulse(const FramePulse& pulse)
+{
+	if (!fitReady())
+	{
+		// bootstrapping: trust the decoder's frame index
+		if (pulse.frameIndex >= (int64_t) frames.size())
+		{
+			return false;
+		}
+		assign(pulse.frameIndex, pulse);
+		return true;
+	}
+
+	double pts = predictPts(pulse.sampleNumber);
+	double maxDeviation = tolerance * framePeriodUs;
+
+	if (ptsLookup.empty() || pts > ptsLookup.back().first + maxDeviation)
+	{
+		// frame info not streamed yet
+		return false;
+	}
+
+	if (pulse.fromBarcode)
+	{
+		if (barcodeFits(pulse, pts))
+		{
+			assign(pulse.frameIndex, pulse);
+			return true;
+		}
+
+		// implausible barcode -> matched like any other pulse
+		FramePulse unchecked = pulse;
+		unchecked.fromBarcode = false;
+		return matchPulse(unchecked);
+	}
+
+	std::vector<std::pair<int64_t, int64_t> >::const_iterator it;
+	it = std::lower_bound(ptsLookup.begin(), ptsLookup.end(), std::pair<int64_t, int64_t>((int64_t) pts, -1));
+
+	std::vector<std::pair<int64_t, int64_t> >::const_iterator best = ptsLookup.end();
+	if (it != ptsLookup.end())
+	{
+		best = it;
+	}
+	if (it != ptsLookup.begin())
+	{
+		std::vector<std::pair<int64_t, int64_t> >::const_iterator prev = it - 1;
+		if (best == ptsLookup.end() || std::fabs(prev->first - pts) < std::fabs(best->first - pts))
+		{
+			best = prev;
+		}
+	}
+
+	if (best != ptsLookup.end() && std::fabs(best->first - pts) <= maxDeviation)
+	{
+		assign(best->second, pulse);
+	}
+	else
+	{
+		numDropped++;
+	}
+
+	// pulses without a matching frame (glitches) are dropped
+	return true;
+}
+
+
+void FrameMatcher::assign(int64_t frameIndex, const FramePulse& pulse)
+{
+	FrameTableEntry& entry = frames[frameIndex];
+
+	if (entry.flags & FrameTableEntry::MATCHED)
+	{
+		return;
+	}
+
+	entry.sampleNumber = pulse.sampleNumber;
+	entry.flags |= FrameTableEntry::MATCHED;
+	if (pulse.fromBarcode)
+	{
+		entry.flags |= FrameTableEntry::BARCODE;
+	}
+	numMatched++;
+
+	if (entry.pts >= 0)
+	{
+		updateFit(entry.pts, entry.sampleNumber);
+	}
+}
+
+
+void FrameMatcher::updateFit(int64_t pts, int64_t sampleNumber)
+{
+	if (numFitPoints == 0)
+	{
+		ptsOrigin = double(pts);
+		sampleOrigin = double(sampleNumber);
+	}
+
+	double x = pts - ptsOrigin;
+	double y = sampleNumber - sampleOrigin;
+
+	// exponentially weighted (co)variance update
+	fitWeight = forgetting * fitWeight + 1.;
+	double dx = x - meanX;
+	meanX += dx / fitWeight;
+	meanY += (y - meanY) / fitWeight;
+	covXX = forgetting * covXX + dx * (x - meanX);
+	covXY = forgetting * covXY + dx * (y - meanY);
+
+	numFitPoints++;
+}
+
+
+bool FrameMatcher::fitReady() const
+{
+	return numFitPoints >= 2 && covXX > 0;
+}
+
+
+double FrameMatcher::getSlope() const
+{
+	if (fitReady())
+	{
+		return covXY / covXX;
+	}
+
+	return sampleRate / 1e6;
+}
+
+
+double FrameMatcher::predictPts(int64_t sampleNumber) const
+{
+	double b = getSlope();
+	double a = meanY - b * meanX;
+
+	return (sampleNumber - sampleOrigin - a) / b + ptsOrigin;
+}
+
+
+void FrameMatcher::finish(std::vector<FrameTableEntry>& table)
+{
+	// pulses still waiting for frame info (e.g., no frame stream available);
+	// their indices have to advance with their sample numbers, starting
+	// from the last matched frame, so a bogus index cannot pad the table
+	double samplesPerFrame = framePeriodUs * sampleRate / 1e6;
+	int64_t lastIndex = -1;
+	int64_t lastSample = 0;
+	for (int64_t i = (int64_t) frames.size() - 1; i >= 0; i--)
+	{
+		if (frames[i].flags & FrameTableEntry::MATCHED)
+		{
+			lastIndex = i;
+			lastSample = frames[i].sampleNumber;
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < pendingPulses.size(); i++)
+	{
+		const FramePulse& pulse = pendingPulses[i];
+		if (pulse.frameIndex < 0)
+		{
+			continue;
+		}
+
+		if (lastIndex >= 0)
+		{
+			double expected = (pulse.sampleNumber - lastSample) / samplesPerFrame;
+			if (pulse.frameIndex <= lastIndex || std::fabs((pulse.frameIndex - lastIndex) - expected) > 2.)
+			{
+				numDropped++;
+				continue;
+			}
+		}
+
+		ensureFrame(pulse.frameIndex);
+		assign(pulse.frameIndex, pulse);
+		lastIndex = pulse.frameIndex;
+		lastSample = pulse.sampleNumber;
+	}
+	pendingPulses.clear();
+
+	// fill in frames without pulse from the closest matched frames
+	int64_t n = (int64_t) frames.size();
+	std::vector<int64_t> prevMatched(n, -1);
+	int64_t last = -1;
+	for (int64_t i = 0; i < n; i++)
+	{
+		if (frames[i].flags & FrameTableEntry::MATCHED)
+		{
+			last = i;
+		}
+		prevMatched[i] = last;
+	}
+
+	int64_t next = -1;
+	double slope = getSlope();
+
+	for (int64_t i = n - 1; i >= 0; i--)
+	{
+		FrameTableEntry& entry = frames[i];
+
+		if (entry.flags & FrameTableEntry::MATCHED)
+		{
+			next = i;
+			continue;
+		}
+
+		int64_t prev = prevMatched[i];
+		if (prev < 0 && next < 0)
+		{
+			continue;
+		}
+
+		const FrameTableEntry* p = prev >= 0 ? &frames[prev] : nullptr;
+		const FrameTableEntry* q = next >= 0 ? &frames[next] : nullptr;
+		bool usePts = entry.pts >= 0 && (p == nullptr || p->pts >= 0) && (q == nullptr || q->pts >= 0);
+		double sample;
+
+		if (p != nullptr && q != nullptr)
+		{
+			double t = usePts ? double(entry.pts - p->pts) / double(q->pts - p->pts)
+							  : double(i - prev) / double(next - prev);
+			sample = p->sampleNumber + t * (q->sampleNumber - p->sampleNumber);
+		}
+		else
+		{
+			const FrameTableEntry* r = p != nullptr ? p : q;
+			sample = usePts ? r->sampleNumber + slope * (entry.pts - r->pts)
+							: r->sampleNumber + samplesPerFrame * (i - r->frameIndex);
+		}
+
+		entry.sampleNumber = (int64_t) std::llround(sample);
+		entry.flags |= FrameTableEntry::INTERPOLATED;
+	}
+
+	table.swap(frames);
+	reset();
+}
+
+
+bool FrameMatcher::writeTable(const std::string& path, const std::vector<FrameTableEntry>& table, double sampleRate)
+{
+	std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		return false;
+	}
+
+	char magic[8];
+	std::memcpy(magic, "RPICAMFT", 8);
+	uint32_t version = 1;
+	uint32_t recordSize = sizeof(FrameTableEntry);
+	int64_t numRecords = (int64_t) table.size();
+
+	out.write(magic, sizeof(magic));
+	out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+	out.write(reinterpret_cast<const char*>(&recordSize), sizeof(recordSize));
+	out.write(reinterpret_cast<const char*>(&sampleRate), sizeof(sampleRate));
+	out.write(reinterpret_cast<const char*>(&numRecords), sizeof(numRecords));
+
+	if (!table.empty())
+	{
+		out.write(reinterpret_cast<const char*>(&table[0]), table.size() * sizeof(FrameTableEntry));
+	}
+
+	return out.good();
+}
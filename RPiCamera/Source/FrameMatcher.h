@@ -0,0 +1,148 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __FRAMEMATCHER_H__
+#define __FRAMEMATCHER_H__
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BarcodeDecoder.h"
+
+
+/**
+
+  One row of the frame table written at the end of a recording
+
+*/
+
+struct FrameTableEntry
+{
+	enum Flags
+	{
+		MATCHED = 1,		// sample number of a strobe pulse
+		INTERPOLATED = 2,	// no pulse -> estimated from neighbouring frames
+		BARCODE = 4			// frame index confirmed by a barcode
+	};
+
+	int64_t frameIndex;
+	int64_t sampleNumber;
+	int64_t pts;			// presentation timestamp on the RPi (usec)
+	int32_t flags;
+	int32_t reserved;
+};
+
+
+/**
+
+  Online matching of strobe pulses to the frames streamed by the RPi
+
+  The mapping from the RPi's frame timestamps (pts) to sample numbers is
+  tracked by a linear fit with exponential forgetting, so slow drift
+  between both clocks is followed. Each pulse is assigned to the frame
+  whose pts is closest to the pts predicted for the pulse; pulses carrying a
+  barcode are assigned directly if the barcode's frame agrees with the
+  prediction (and matched like other pulses otherwise). Pulses that arrive
+  before the frame information are held back until the frame has been
+  streamed, but at most MAX_PENDING_PULSES of them (oldest are dropped).
+
+  The resulting table can be written as a flat binary file:
+
+	char[8]  magic ("RPICAMFT")
+	uint32   version
+	uint32   record size (bytes)
+	double   sample rate
+	int64    number of records
+
+  followed by one FrameTableEntry per frame (little endian).
+
+*/
+
+class FrameMatcher
+{
+public:
+	FrameMatcher();
+
+	void reset();
+	void setSampleRate(double fs) { sampleRate = fs; }
+	void setNominalFramerate(double fps);
+
+	/** Max. deviation (in frame periods) for a pulse to be matched. */
+	void setTolerance(double periods) { tolerance = periods; }
+
+	/** Frame info streamed by the RPi (indices must increase). */
+	void addFrame(int64_t frameIndex, int64_t pts);
+
+	/** Strobe pulse decoded from the TTL line. */
+	void addPulse(const FramePulse& pulse);
+
+	int64_t getNumMatched() const { return numMatched; }
+	int64_t getNumDropped() const { return numDropped; }
+	int64_t getNumFrames() const { return (int64_t) frames.size(); }
+
+	/** Interpolate unmatched frames and hand over the table. */
+	void finish(std::vector<FrameTableEntry>& table);
+
+	static bool writeTable(const std::string& path, const std::vector<FrameTableEntry>& table, double sampleRate);
+
+private:
+	// ~45 s at 90 fps without frame information
+	static const size_t MAX_PENDING_PULSES = 4096;
+
+	bool matchPulse(const FramePulse& pulse);
+	bool barcodeFits(const FramePulse& pulse, double pts) const;
+	void ensureFrame(int64_t frameIndex);
+	void assign(int64_t frameIndex, const FramePulse& pulse);
+	bool fitReady() const;
+	double predictPts(int64_t sampleNumber) const;
+	double getSlope() const;
+	void updateFit(int64_t pts, int64_t sampleNumber);
+
+	double sampleRate;
+	double framePeriodUs;
+	double tolerance;
+
+	std::vector<FrameTableEntry> frames;	// indexed by frame index
+	std::deque<FramePulse> pendingPulses;
+	int64_t numMatched;
+	int64_t numDropped;
+
+	// exponentially weighted linear fit of sample number vs. pts; both are
+	// taken relative to the first matched frame to keep the numbers small
+	double forgetting;
+	double ptsOrigin;
+	double sampleOrigin;
+	double fitWeight;
+	double meanX, meanY;
+	double covXX, covXY;
+	int numFitPoints;
+
+	// (pts, frame index) of all frames with a valid pts, sorted by pts
+	std::vector<std::pair<int64_t, int64_t> > ptsLookup;
+};
+
+
+#endif  // __FRAMEMATCHER_H__
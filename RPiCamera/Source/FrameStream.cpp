@@ -0,0 +1,193 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <zmq.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "FrameStream.h"
+
+
+// must be a power of two
+const size_t FRAME_FIFO_SIZE = 8192;
+
+
+FrameStream::FrameStream(void* ctx)
+	: context(ctx), running(false), buffer(FRAME_FIFO_SIZE), mask(FRAME_FIFO_SIZE - 1),
+	  readIndex(0), writeIndex(0), numDropped(0), numExposures(0), hasWriteBuffer(false)
+{
+}
+
+
+FrameStream::~FrameStream()
+{
+	disconnect();
+}
+
+
+void FrameStream::connect(const std::string& u)
+{
+	disconnect();
+
+	url = u;
+	readIndex = 0;
+	writeIndex = 0;
+	numDropped = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(statusLock);
+		numExposures = 0;
+		hasWriteBuffer = false;
+	}
+
+	running = true;
+	thread = std::thread(&FrameStream::run, this);
+}
+
+
+void FrameStream::disconnect()
+{
+	// the receive timeout below bounds the time needed to exit
+	running = false;
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+}
+
+
+int FrameStream::read(StreamedFrame* dest, int maxFrames)
+{
+	size_t r = readIndex.load(std::memory_order_relaxed);
+	size_t w = writeIndex.load(std::memory_order_acquire);
+	size_t n = std::min(w - r, (size_t) maxFrames);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		dest[i] = buffer[(r + i) & mask];
+	}
+
+	readIndex.store(r + n, std::memory_order_release);
+
+	return (int) n;
+}
+
+
+int64_t FrameStream::getExposure(ExposureSummary& summary)
+{
+	std::lock_guard<std::mutex> lock(statusLock);
+
+	if (numExposures > 0)
+	{
+		summary = exposure;
+	}
+
+	return numExposures;
+}
+
+
+bool FrameStream::getWriteBuffer(WriteBufferStatus& status)
+{
+	std::lock_guard<std::mutex> lock(statusLock);
+
+	if (hasWriteBuffer)
+	{
+		status = writeBuffer;
+	}
+
+	return hasWriteBuffer;
+}
+
+
+void FrameStream::write(const StreamedFrame& frame)
+{
+	size_t w = writeIndex.load(std::memory_order_relaxed);
+	size_t r = readIndex.load(std::memory_order_acquire);
+
+	if (w - r >= buffer.size())
+	{
+		// frames are dropped if the processing thread falls behind
+		numDropped++;
+		return;
+	}
+
+	buffer[w & mask] = frame;
+	writeIndex.store(w + 1, std::memory_order_release);
+}
+
+
+void FrameStream::run()
+{
+	void* socket = zmq_socket(context, ZMQ_SUB);
+
+	int timeout = 100;
+	zmq_setsockopt(socket, ZMQ_RCVTIMEO, &timeout, sizeof(int));
+	zmq_setsockopt(socket, ZMQ_SUBSCRIBE, "Frame ", 6);
+	zmq_setsockopt(socket, ZMQ_SUBSCRIBE, "Exposure ", 9);
+	zmq_setsockopt(socket, ZMQ_SUBSCRIBE, "Buffer ", 7);
+
+	if (zmq_connect(socket, url.c_str()) != 0)
+	{
+		std::cout << "RPiCam failed to subscribe to " << url << ": " << zmq_strerror(zmq_errno()) << "\n";
+		zmq_close(socket);
+		return;
+	}
+
+	// exposure summaries include the histogram
+	char msg[1024];
+	StreamedFrame frame;
+	ExposureSummary summary;
+	WriteBufferStatus status;
+
+	while (running)
+	{
+		int size = zmq_recv(socket, msg, sizeof(msg), 0);
+		if (size < 0)
+		{
+			continue;  // timeout
+		}
+
+		size_t length = std::min((size_t) size, sizeof(msg));
+		if (RPiCamProtocol::parseFrame(msg, length, frame))
+		{
+			// for latency measurements (see rpicam_event_latency)
+			frame.received = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count();
+			write(frame);
+		}
+		else if (RPiCamProtocol::parseExposure(msg, length, summary))
+		{
+			std::lock_guard<std::mutex> lock(statusLock);
+			exposure = summary;
+			numExposures++;
+		}
+		else if (RPiCamProtocol::parseWriteBuffer(msg, length, status))
+		{
+			std::lock_guard<std::mutex> lock(statusLock);
+			writeBuffer = status;
+			hasWriteBuffer = true;
+		}
+	}
+
+	zmq_close(socket);
+}
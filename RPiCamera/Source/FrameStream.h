@@ -0,0 +1,99 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __FRAMESTREAM_H__
+#define __FRAMESTREAM_H__
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RPiCamProtocol.h"
+
+
+/**
+
+  Receives the "Frame <index> <pts> <ets>" messages published by the RPi
+
+  The zmq subscriber lives on its own thread; frames are handed to the
+  processing thread through a lock-free single-reader/single-writer fifo.
+  Only the latest exposure summary and write buffer status are kept (for
+  display by the editor).
+
+  @see RPiCam
+
+*/
+
+class FrameStream
+{
+public:
+	FrameStream(void* context);
+	~FrameStream();
+
+	void connect(const std::string& url);
+	void disconnect();
+
+	/** Read up to maxFrames frames; returns the number of frames read. */
+	int read(StreamedFrame* dest, int maxFrames);
+
+	/** Frames lost because the processing thread fell behind. */
+	int64_t getNumDropped() const { return numDropped; }
+
+	/** Latest exposure summary; returns the number of summaries received (0: none). */
+	int64_t getExposure(ExposureSummary& summary);
+
+	/** Latest write buffer status; returns false if none was received. */
+	bool getWriteBuffer(WriteBufferStatus& status);
+
+private:
+	void run();
+	void write(const StreamedFrame& frame);
+
+	void* context;
+	std::string url;
+
+	std::thread thread;
+	std::atomic<bool> running;
+
+	// indices increase monotonically; (index & mask) is the buffer slot
+	std::vector<StreamedFrame> buffer;
+	size_t mask;
+	std::atomic<size_t> readIndex;
+	std::atomic<size_t> writeIndex;
+	std::atomic<int64_t> numDropped;
+
+	std::mutex statusLock;
+	ExposureSummary exposure;
+	int64_t numExposures;
+	WriteBufferStatus writeBuffer;
+	bool hasWriteBuffer;
+
+	FrameStream(const FrameStream&) = delete;
+	FrameStream& operator=(const FrameStream&) = delete;
+};
+
+
+#endif  // __FRAMESTREAM_H__
@@ -49,7 +49,7 @@ extern "C" EXPORT int getPluginInfo(int index, Plugin::PluginInfo* info)
 	case 0:
 		info->type = Plugin::PLUGIN_TYPE_PROCESSOR;
 		info->processor.name = "RPiCamera";
-		info->processor.type = Plugin::SourceProcessor;
+		info->processor.type = Plugin::FilterProcessor;
 		info->processor.creator = &(Plugin::createProcessor<RPiCam>);
 		break;
 	default:
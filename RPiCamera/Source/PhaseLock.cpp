@@ -0,0 +1,135 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "PhaseLock.h"
+
+#include <cmath>
+
+
+PhaseLock::PhaseLock()
+	: sampleRate(30000.), framerate(30.), targetPhase(0), tolerance(0.001),
+	  kp(0.5), ki(0.1), updateInterval(0.5), maxCorrection(0.01),
+	  resolution(1. / 256)
+{
+	reset();
+}
+
+
+void PhaseLock::setGains(double p, double i)
+{
+	kp = p;
+	ki = i;
+}
+
+
+void PhaseLock::reset()
+{
+	integral = 0;
+	residual = 0;
+	correction = 0;
+	restart();
+}
+
+
+void PhaseLock::restart()
+{
+	lastUpdate = -1;
+	numErrors = 0;
+	errorSum = 0;
+	firstError = 0;
+	phaseError = 0;
+	numUpdates = 0;
+}
+
+
+double PhaseLock::wrap(double samples, double period) const
+{
+	double x = std::fmod(samples, period);
+	if (x < 0)
+	{
+		x += period;
+	}
+	return x >= 0.5 * period ? x - period : x;
+}
+
+
+bool PhaseLock::addPulse(int64_t sampleNumber)
+{
+	if (sampleRate <= 0 || framerate <= 0)
+	{
+		return false;
+	}
+
+	const double period = sampleRate / framerate;
+	double error = wrap(sampleNumber - targetPhase * sampleRate, period);
+
+	if (numErrors == 0)
+	{
+		firstError = error;
+		if (lastUpdate < 0)
+		{
+			lastUpdate = sampleNumber;
+		}
+	}
+
+	// jitter around +-period/2 must not average out to zero
+	errorSum += firstError + wrap(error - firstError, period);
+	numErrors++;
+
+	if (sampleNumber - lastUpdate < updateInterval * sampleRate)
+	{
+		return false;
+	}
+
+	double dt = (sampleNumber - lastUpdate) / sampleRate;
+	phaseError = wrap(errorSum / numErrors, period) / sampleRate;
+	lastUpdate = sampleNumber;
+	errorSum = 0;
+	numErrors = 0;
+
+	// late frames (positive error) -> run faster until they are in phase
+	const double limit = maxCorrection * framerate;
+	double candidate = integral + ki * phaseError * dt;
+	double output = framerate * (kp * phaseError + candidate);
+
+	if (output > limit || output < -limit)
+	{
+		// no integration while saturated
+		output = output > limit ? limit : -limit;
+	}
+	else
+	{
+		integral = candidate;
+	}
+
+	correction = output;
+	if (resolution > 0)
+	{
+		correction = std::floor((output + residual) / resolution + 0.5) * resolution;
+		residual += output - correction;
+	}
+
+	numUpdates++;
+
+	return true;
+}
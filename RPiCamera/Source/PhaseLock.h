@@ -0,0 +1,123 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __PHASELOCK_H__
+#define __PHASELOCK_H__
+
+#include <cstdint>
+
+
+/**
+
+  Software phase-locked loop for the camera frame timing
+
+  The phase of the strobe pulses relative to the acquisition clock (sample
+  number modulo the nominal frame period, minus the target phase) is
+  averaged over an update interval and fed to a PI controller. Its output
+  is a fine adjustment of the camera frame rate (Hz, see "FramerateDelta")
+  which makes the camera catch up or fall back until its frames occur at
+  the target phase; the integral part compensates the frequency offset of
+  the camera clock. Cameras locked to the same target phase are exposed
+  in step with each other.
+
+  With gains kp (1/s) and ki (1/s^2), phase errors decay with a time
+  constant of about 1/kp; with the defaults, a camera running 100 ppm off
+  locks within a few seconds. In steady state the correction averages to
+  -offset * frame rate (e.g. +0.003 Hz for a camera 100 ppm slow at 30 fps).
+
+  The RPi applies the adjustment in steps of 1/256 Hz, coarser than the
+  offset of a typical camera clock. The correction is therefore rounded
+  to this resolution and the rounding error is carried over to the next
+  update, so that the applied steps average to the controller output.
+
+  @see RPiCam
+
+*/
+
+class PhaseLock
+{
+public:
+	PhaseLock();
+
+	void setSampleRate(double fs) { sampleRate = fs; }
+	void setNominalFramerate(double fps) { framerate = fps; }
+
+	/** Phase of the frames relative to sample 0 (seconds). */
+	void setTargetPhase(double seconds) { targetPhase = seconds; }
+	void setTolerance(double seconds) { tolerance = seconds; }
+	void setGains(double kp, double ki);
+	void setUpdateInterval(double seconds) { updateInterval = seconds; }
+
+	/** Step of the frame rate adjustment on the RPi (Hz; 0: continuous). */
+	void setResolution(double hz) { resolution = hz; }
+
+	/** Limit of the correction (fraction of the frame rate). */
+	void setMaxCorrection(double fraction) { maxCorrection = fraction; }
+
+	/** Forget everything, e.g. after the frame rate was changed. */
+	void reset();
+
+	/** Restart measuring but keep the correction (new recording). */
+	void restart();
+
+	/** Rising edge of a frame pulse; true if the correction was updated. */
+	bool addPulse(int64_t sampleNumber);
+
+	/** Frame rate adjustment (Hz, a multiple of the resolution). */
+	double getCorrection() const { return correction; }
+
+	/** Mean phase error of the last interval (seconds, -period/2 ... period/2). */
+	double getPhaseError() const { return phaseError; }
+
+	bool isLocked() const { return numUpdates > 0 && phaseError < tolerance && phaseError > -tolerance; }
+	int64_t getNumUpdates() const { return numUpdates; }
+
+private:
+	double wrap(double samples, double period) const;
+
+	double sampleRate;
+	double framerate;
+	double targetPhase;
+	double tolerance;
+	double kp;
+	double ki;
+	double updateInterval;
+	double maxCorrection;
+	double resolution;
+
+	// current interval (errors relative to the first one to avoid wrapping)
+	int64_t windowStart;
+	int64_t lastUpdate;
+	double firstError;
+	double errorSum;
+	int64_t numErrors;
+
+	double integral;
+	double residual;	// rounding error not applied yet (Hz)
+	double correction;
+	double phaseError;
+	int64_t numUpdates;
+};
+
+
+#endif  // __PHASELOCK_H__
@@ -22,12 +22,26 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdio.h>
+#include <fstream>
+#include <algorithm>
+#include <functional>
 #include "RPiCam.h"
 #include "RPiCamEditor.h"
 
 
 //const int MAX_MESSAGE_LENGTH = 64000;
 const int MAX_MESSAGE_LENGTH = 16000;
+const int MAX_FRAMES_PER_BLOCK = 1024;
+const int MAX_EVENTS_PER_BLOCK = 256;
+const int MAX_EVENT_TEXT_LENGTH = 1024;
+const int SNAPSHOT_TIMEOUT = 5000;
+const int DISCOVERY_TIMEOUT = 1000;	// for announcements and again for probing all hosts
+const int TRACE_TIMEOUT = 2000;
+const int LEASE_SECONDS = 30;
+const int LEASE_INTERVAL = 10000;	// ms between renewals
+const int LEASE_TIMEOUT = 200;
+const int PHASE_LOCK_INTERVAL = 100;	// ms between checks for a new correction
+const int PHASE_LOCK_TIMEOUT = 200;	// reply to a FramerateDelta request
 
 
 #ifdef WIN32
@@ -37,6 +51,24 @@ const int MAX_MESSAGE_LENGTH = 16000;
 #endif
 
 
+/** Runs a function on the pool of background jobs of the processor. */
+class FunctionJob : public ThreadPoolJob
+{
+public:
+	FunctionJob(const String& name, const std::function<void()>& f)
+		: ThreadPoolJob(name), function(f) {}
+
+	JobStatus runJob() override
+	{
+		function();
+		return jobHasFinished;
+	}
+
+private:
+	std::function<void()> function;
+};
+
+
 String generateDateString()
 {
     // adapted from RecordNode.cpp
@@ -94,26 +126,80 @@ String generateDateString()
 }
 
 
+static CameraConfig defaultConfig()
+{
+	CameraConfig c;
+	c.version = 0;
+	c.width = 640;
+	c.height = 480;
+	c.framerate = 30;
+	c.vflip = false;
+	c.hflip = false;
+	c.zoom[0] = 0;
+	c.zoom[1] = 0;
+	c.zoom[2] = 100;
+	c.zoom[3] = 100;
+	c.recording = false;
+	return c;
+}
+
+
 RPiCam::RPiCam()
-    : GenericProcessor("RPiCamera"), address(""), port(5555), context(NULL), socket(NULL), rpiRecPath(""), sendRecPathEvent(false), width(640), height(480), framerate(30), vflip(false), hflip(false), isRecording(false), zoom{0, 0, 100, 100}
+    : GenericProcessor("RPiCamera"), context(NULL), nextLease(0), port(5555), address(""), sendRecPathEvent(false), rpiRecPath(""),
+	  config(defaultConfig()), streamWidth(0), streamHeight(0), streamBitrate(500), intraPeriod(0),
+	  exposureInterval(0), exposureTarget(0), exposureMaxSaturation(0.01), exposureMinShutter(100), exposureMaxShutter(0),
+	  phaseLockEnabled(false), phaseTarget(0), phaseTolerance(1.0), framerateDeltaPending(false),
+	  strobeSourceNode(-1), strobeSubProcessor(-1), strobeChannel(0), resetDecoder(true), experimentNumber(0), recordingNumber(0), copyData(false), backgroundJobs(2),
+	  replayBarcodeInterval(0), replayStartPending(false), traceAfterRecording(false), firstFramePending(false),
+	  events(MAX_EVENTS_PER_BLOCK, MAX_EVENT_TEXT_LENGTH), framePrefix("RPiCam Address= Cfg=0 Frame=")
 
 {
-    setProcessorType(PROCESSOR_TYPE_SOURCE);
+    // filter (not source) so that strobe TTLs from upstream can be decoded
+    setProcessorType(PROCESSOR_TYPE_FILTER);
 
     createContext();
 
+    client = new CameraClient(context);
+
+	// the host keeps the lease of this client across reconnects
+	clientName = "RPiCam-" + SystemStats::getComputerName().replaceCharacter(' ', '_')
+		+ "-" + String::toHexString(Random::getSystemRandom().nextInt());
+	client->setIdentity(clientName.toStdString());
+
+	snapshotClient = new CameraClient(context);
+	snapshotClient->setIdentity(clientName.toStdString() + "/snapshot");
+
+    frameStream = new FrameStream(context);
+    streamedFrames.malloc(MAX_FRAMES_PER_BLOCK);
+
+	// the value is updated for every emitted event
+	juce::int64 zero = 0;
+	softwareTimestamp = new MetaDataValue(MetaDataDescriptor::INT64, 1, &zero);
+	eventMetaData.add(softwareTimestamp);
+
+    transfer = new DataTransfer(context);
+    transfer->startThread();
+
+	// phase lock corrections and lease renewal
+	startTimer(PHASE_LOCK_INTERVAL);
+
 	if (!address.isEmpty())
   	{
   	    openSocket();
   	}
-
-    sendSampleCount = false;
 }
 
 
 RPiCam::~RPiCam()
 {
-	sendMessage(String("Close"), 1000);
+	stopTimer();
+
+	// (a running search cannot be aborted)
+	snapshotClient->abort();
+	backgroundJobs.removeAllJobs(true, 3 * DISCOVERY_TIMEOUT);
+	snapshotClient->close();
+
+	sendMessage(RPiCamProtocol::close(), 1000);
     closeSocket();
 }
 
@@ -137,7 +223,7 @@ void RPiCam::setPort(int p, bool connect, bool update)
 	{
 		port = p;
 
-		if (connect || socket != NULL)
+		if (connect || client->isConnected())
 		{
 			closeSocket();
 			openSocket();
@@ -158,7 +244,9 @@ void RPiCam::setAddress(String s, bool connect, bool update)
 	{
 		address = s;
 
-		if (connect || socket != NULL)
+		updateFramePrefix();
+
+		if (connect || client->isConnected())
 		{
 			closeSocket();
 			openSocket();
@@ -173,96 +261,368 @@ void RPiCam::setAddress(String s, bool connect, bool update)
 }
 
 
+void RPiCam::updateFramePrefix()
+{
+	// frame events carry the settings version as well
+	std::string prefix = ("RPiCam Address=" + address + " Cfg=" + String((juce::int64) config.getVersion()) + " Frame=").toStdString();
+
+	const ScopedLock sl(lock);
+	framePrefix = prefix;
+}
+
+
 void RPiCam::setResolution(int w, int h)
 {
-	width = w;
-	height = h;
+	CameraConfigStore::Snapshot c = config.update([&](CameraConfig& c) { c.width = w; c.height = h; });
+	updateFramePrefix();
 
-	if (!isRecording)
+	if (!c->recording)
 	{
-		String msg("Resolution");
-		msg += String(" ") + String(width);
-		msg += String(" ") + String(height);
-		sendMessage(msg, 1000);
+		sendMessage(RPiCamProtocol::resolution(c->width, c->height), 1000);
 	}
 }
 
 
 void RPiCam::setFramerate(int fps)
 {
-	framerate = fps;
+	CameraConfigStore::Snapshot c = config.update([&](CameraConfig& c) { c.framerate = fps; });
+	updateFramePrefix();
+
+	{
+		// the RPi resets its fine adjustment as well
+		const ScopedLock sl(lock);
+		phaseLock.reset();
+	}
 
-	if (!isRecording)
+	if (!c->recording)
 	{
-		String msg("Framerate ");
-		msg += String(framerate);
-		sendMessage(msg, 1000);
+		sendMessage(RPiCamProtocol::framerate(c->framerate), 1000);
 	}
 }
 
 
 void RPiCam::setVflip(bool status)
 {
-	vflip = status;
-	if (!isRecording)
+	CameraConfigStore::Snapshot c = config.update([&](CameraConfig& c) { c.vflip = status; });
+	updateFramePrefix();
+
+	if (!c->recording)
 	{
-		sendMessage("VFlip " + String(status), 1000);
+		sendMessage(RPiCamProtocol::vflip(status), 1000);
 	}
 }
 
 void RPiCam::setHflip(bool status)
 {
-	hflip = status;
-	if (!isRecording)
+	CameraConfigStore::Snapshot c = config.update([&](CameraConfig& c) { c.hflip = status; });
+	updateFramePrefix();
+
+	if (!c->recording)
 	{
-		sendMessage("HFlip " + String(status), 1000);
+		sendMessage(RPiCamProtocol::hflip(status), 1000);
 	}
 }
 
 
 void RPiCam::setZoom(int z[4])
 {
-	zoom[0] = z[0];
-	zoom[1] = z[1];
-	zoom[2] = z[2];
-	zoom[3] = z[3];
+	CameraConfigStore::Snapshot c = config.update([&](CameraConfig& c) { std::copy(z, z + 4, c.zoom); });
+	updateFramePrefix();
 
-	String msg("Zoom ");
-	for (int i=0; i<4; i++)
-	{
-		// convert from percent to normalized coordinates
-		msg += String(zoom[i]/100., 2);
-		if (i < 3)
-			msg += " ";
-	}
-	sendMessage(msg, 1000);
+	// (converted from percent to normalized coordinates)
+	sendMessage(RPiCamProtocol::zoom(c->zoom), 1000);
 }
 
 void RPiCam::getZoom(int *z)
 {
-	z[0] = zoom[0];
-	z[1] = zoom[1];
-	z[2] = zoom[2];
-	z[3] = zoom[3];
+	// (all four values of the same snapshot)
+	CameraConfigStore::Snapshot c = config.get();
+	std::copy(c->zoom, c->zoom + 4, z);
 }
 
 
 void RPiCam::sendCameraParameters()
 {
-	if (!isRecording)
+	CameraConfigStore::Snapshot c = config.get();
+	if (!c->recording)
 	{
-		setResolution(width, height);
-		setFramerate(framerate);
+		setResolution(c->width, c->height);
+		setFramerate(c->framerate);
+		setIntraPeriod(intraPeriod);
+		setStream(streamWidth, streamHeight, streamBitrate);
+		setRois(c->rois);
+		setExposureControl(exposureTarget, exposureMaxSaturation, exposureMinShutter, exposureMaxShutter);
 	}
 }
 
 
 void RPiCam::resetGains()
 {
-	if (!isRecording)
+	if (!config.get()->recording)
+	{
+		sendMessage(RPiCamProtocol::resetGains(), 1000);
+	}
+}
+
+
+void RPiCam::setPhaseLock(bool enabled)
+{
+	phaseLockEnabled = enabled;
+
+	{
+		const ScopedLock sl(lock);
+		phaseLock.setTargetPhase(phaseTarget / 1000.);
+		phaseLock.setTolerance(phaseTolerance / 1000.);
+		phaseLock.reset();
+		framerateDeltaPending = false;
+	}
+
+	if (!enabled)
+	{
+		sendMessage(RPiCamProtocol::framerateDelta(0), PHASE_LOCK_TIMEOUT);
+	}
+}
+
+
+String RPiCam::getPhaseLockStatus()
+{
+	if (!phaseLockEnabled)
+	{
+		return "Phase lock off";
+	}
+
+	const ScopedLock sl(lock);
+
+	if (phaseLock.getNumUpdates() == 0)
+	{
+		return "Waiting for strobe pulses";
+	}
+
+	String s = phaseLock.isLocked() ? "Locked" : "Locking";
+	s += ": phase error " + String(1000. * phaseLock.getPhaseError(), 2) + " ms";
+	s += ", frame rate " + String(phaseLock.getCorrection() >= 0 ? "+" : "") + String(phaseLock.getCorrection(), 4) + " Hz";
+	return s;
+}
+
+
+void RPiCam::timerCallback()
+{
+	if (client->isConnected() && !replay.isOpen() && Time::getMillisecondCounter() >= nextLease)
+	{
+		renewLease();
+	}
+
+	double delta = 0;
+	{
+		const ScopedLock sl(lock);
+		if (!framerateDeltaPending)
+		{
+			return;
+		}
+		delta = phaseLock.getCorrection();
+		framerateDeltaPending = false;
+	}
+
+	// short timeout: the next correction follows soon
+	sendMessage(RPiCamProtocol::framerateDelta(delta), PHASE_LOCK_TIMEOUT);
+}
+
+
+void RPiCam::renewLease()
+{
+	nextLease = Time::getMillisecondCounter() + LEASE_INTERVAL;
+
+	// (heartbeat, not logged)
+	std::string reply;
+	if (client->request(RPiCamProtocol::lease(LEASE_SECONDS, clientName.toStdString()), reply, LEASE_TIMEOUT))
+	{
+		checkLease(String(reply));
+	}
+}
+
+
+bool RPiCam::checkLease(const String& reply)
+{
+	std::string holder;
+	double remaining = 0;
+	if (RPiCamProtocol::parseLeased(reply.toStdString(), holder, remaining))
+	{
+		if (leaseHolder != String(holder))
+		{
+			leaseHolder = String(holder);
+			CoreServices::sendStatusMessage("RPiCam: " + address + " is controlled by " + leaseHolder);
+		}
+		return false;
+	}
+
+	if (reply.isNotEmpty())
+	{
+		leaseHolder = String();
+	}
+	return true;
+}
+
+
+String RPiCam::getWriteBufferStatus()
+{
+	WriteBufferStatus status;
+	if (!frameStream->getWriteBuffer(status) || status.size <= 0)
+	{
+		return String();
+	}
+
+	String s = "write buffer " + String((int) (100 * status.fill / status.size)) + "%";
+	s += " (max " + String((int) (100 * status.highWater / status.size)) + "% of " + String((int) (status.size >> 20)) + " MB)";
+	if (status.stalls > 0)
+	{
+		s += ", " + String((juce::int64) status.stalls) + " stalls";
+	}
+	return s;
+}
+
+
+void RPiCam::setRois(const std::vector<RoiSettings>& r)
+{
+	CameraConfigStore::Snapshot c = config.update([&](CameraConfig& c) { c.rois = r; });
+	updateFramePrefix();
+
+	// cropped from unencoded frames of a spare splitter port on the RPi
+	sendMessage(RPiCamProtocol::rois(c->rois), 1000);
+
+	// the metered region might have changed
+	setExposureMonitor(exposureInterval, exposureRegion);
+}
+
+
+void RPiCam::setExposureMonitor(int interval, const String& roiName)
+{
+	exposureInterval = jmax(0, interval);
+	exposureRegion = roiName;
+
+	CameraConfigStore::Snapshot c = config.get();
+	const RoiSettings* region = nullptr;
+	for (size_t i = 0; i < c->rois.size(); i++)
+	{
+		if (roiName == String(c->rois[i].name))
+		{
+			region = &c->rois[i];
+		}
+	}
+
+	// computed from downscaled unencoded frames on the RPi (also while recording)
+	sendMessage(RPiCamProtocol::exposure(exposureInterval, region), 1000);
+}
+
+
+void RPiCam::setExposureControl(double target, double maxSaturation, int minShutter, int maxShutter)
+{
+	exposureTarget = jlimit(0.0, 254.0, target);
+	exposureMaxSaturation = maxSaturation;
+	exposureMinShutter = minShutter;
+	exposureMaxShutter = maxShutter;
+
+	sendMessage(RPiCamProtocol::exposureControl(exposureTarget, exposureMaxSaturation, exposureMinShutter, exposureMaxShutter), 1000);
+}
+
+
+void RPiCam::setStream(int w, int h, int kbps)
+{
+	streamWidth = w;
+	streamHeight = h;
+	streamBitrate = kbps;
+
+	// the live stream is encoded on its own splitter port and can be
+	// changed while recording
+	sendMessage(RPiCamProtocol::stream(streamWidth, streamHeight, streamBitrate * 1000), 1000);
+}
+
+
+void RPiCam::setIntraPeriod(int frames)
+{
+	intraPeriod = frames > 0 ? frames : 0;
+
+	// restarts the live stream; recordings use it from the next start
+	sendMessage(RPiCamProtocol::intraPeriod(intraPeriod), 1000);
+}
+
+
+void RPiCam::requestKeyframe()
+{
+	sendMessage(RPiCamProtocol::requestKeyframe(), 1000);
+}
+
+
+bool RPiCam::setReplay(const String& videoPath, double speed)
+{
+	// the files are read without holding the lock that process() takes
+	ReplaySource loaded;
+	{
+		const ScopedLock sl(lock);
+		replay.close();
+		loaded = replay;	// (strobe and sample rate settings)
+	}
+	loaded.setSpeed(speed);
+
+	if (videoPath.isEmpty())
+	{
+		const ScopedLock sl(lock);
+		replay.setSpeed(speed);
+		return true;
+	}
+
+	if (!loaded.open(videoPath.toStdString()))
+	{
+		std::cout << "RPiCam could not find timestamps for " << videoPath.toStdString() << "\n";
+		return false;
+	}
+
+	config.update([&](CameraConfig& c)
+	{
+		if (loaded.getFramerate() > 0)
+		{
+			c.framerate = roundToInt(loaded.getFramerate());
+		}
+		if (loaded.getWidth() > 0 && loaded.getHeight() > 0)
+		{
+			c.width = loaded.getWidth();
+			c.height = loaded.getHeight();
+		}
+	});
+	updateFramePrefix();
+
+	{
+		const ScopedLock sl(lock);
+		std::swap(replay, loaded);
+
+		// frame pulse plus barcode edges of all frames released in one block
+		replayFrames.reserve(MAX_FRAMES_PER_BLOCK);
+		replayEdges.reserve(MAX_FRAMES_PER_BLOCK * 2 * (decoder.getNumBits() + 1));
+	}
+
+	std::cout << "RPiCam replaying " << replay.getNumFrames() << " frames of " << videoPath.toStdString() << "\n";
+
+	return true;
+}
+
+
+void RPiCam::setStrobeSource(int nodeId, int subProcessor)
+{
+	strobeSourceNode = nodeId;
+	strobeSubProcessor = subProcessor;
+}
+
+
+void RPiCam::setStrobeChannel(int channel)
+{
+	strobeChannel = channel;
+}
+
+
+void RPiCam::setBarcodeBits(int n)
+{
+	if (!config.get()->recording)
 	{
-		String msg("ResetGains");
-		sendMessage(msg, 1000);
+		decoder.setNumBits(n);
 	}
 }
 
@@ -288,23 +648,22 @@ void RPiCam::destroyContext()
 
 void RPiCam::openSocket()
 {
-	if (socket == NULL)
+	TraceSpan span(trace, "connection", "connect");
+
+	if (!client->isConnected())
 	{
-		socket = zmq_socket(context, ZMQ_REQ);
-		String url = String("tcp://") + String(address) + ":" + String(port);
-		std::cout << "RPiCam connecting to " << url.toStdString() << " ... ";
+		// plain addresses use tcp; ipc:// and inproc:// endpoints avoid the network stack
+		std::string url = RPiCamProtocol::commandUrl(address.toStdString(), port);
+		std::cout << "RPiCam connecting to " << url << "\n";
 
-		int rc = zmq_connect(socket, url.toRawUTF8());
+		// (the connection is established with the first request)
+		client->setUrl(url);
 
-		if (rc != 0)
-		{
-			std::cout << "failed to open socket: " << zmq_strerror(zmq_errno()) << "\n";
-			socket = NULL;
-		}
-		else
-		{
-			std::cout << "done\n";
-		}
+		// frame info is published on the port (or endpoint) following the command port
+		frameStream->connect(RPiCamProtocol::frameUrl(address.toStdString(), port));
+
+		// recorded files are copied over a separate connection
+		transfer->setUrl(url);
 	}
 	else
 	{
@@ -315,11 +674,19 @@ void RPiCam::openSocket()
 
 bool RPiCam::closeSocket()
 {
-	if (socket != NULL)
+	TraceSpan span(trace, "connection", "disconnect");
+
+	if (client->isConnected())
 	{
 		std::cout << "RPiCam closing socket ...";
-    	zmq_close(socket);
-		socket = NULL;
+		if (leaseHolder.isEmpty())
+		{
+			// let other clients take over right away
+			std::string reply;
+			client->request(RPiCamProtocol::release(), reply, LEASE_TIMEOUT);
+		}
+		frameStream->disconnect();
+		client->setUrl(std::string());
 		std::cout << "done\n";
 	}
 
@@ -343,27 +710,26 @@ String RPiCam::sendMessage(String msg, int timeout)
 {
 	String response;
 
-	std::cout << "RPiCam sending message: "  << msg.toStdString() << " ... ";
+	// one span per command, named after the command
+	std::string command = msg.upToFirstOccurrenceOf(" ", false, false).toStdString();
+	TraceSpan span(trace, "command", command.c_str());
 
-	if (socket != NULL)
-	{
-		zmq_setsockopt(socket, ZMQ_RCVTIMEO, (const void*) &timeout, sizeof(int));
-		zmq_send(socket, msg.getCharPointer(), msg.length(), 0);
+	// tagged with the settings in force when it was sent
+	msg = String(RPiCamProtocol::tagConfig(msg.toStdString(), config.getVersion()));
 
-		unsigned char* buffer = new unsigned char[MAX_MESSAGE_LENGTH];
-		int result = zmq_recv(socket, buffer, MAX_MESSAGE_LENGTH-1, 0);
+	std::cout << "RPiCam sending message: "  << msg.toStdString() << " ... ";
 
-		if (result < 0)
+	if (client->isConnected())
+	{
+		std::string reply;
+		if (client->request(msg.toStdString(), reply, timeout))
 		{
-            response = String("");  // responder died.
+			response = String(reply);
 		}
 		else
 		{
-			response = String(reinterpret_cast<char*>(buffer), result);
+            response = String("");  // responder died.
 		}
-
-		delete buffer;
-
 	}
 	else
 	{
@@ -372,12 +738,173 @@ String RPiCam::sendMessage(String msg, int timeout)
 
 	std::cout << "the RPi answered: " << response.toStdString() << "\n";
 
+	checkLease(response);
+
 	return response;
 }
 
 
+bool RPiCam::discoverCameras()
+{
+	if (!discoveryPending.compareAndSetBool(1, 0))
+	{
+		return false;
+	}
+
+	Component::SafePointer<RPiCamEditor> editor((RPiCamEditor*) getEditor());
+
+	backgroundJobs.addJob(new FunctionJob("RPiCam discovery", [this, editor]
+	{
+		TraceSpan span(trace, "connection", "discover");
+
+		std::cout << "RPiCam searching for cameras ...\n";
+		Array<DiscoveredCamera> cameras = CameraDiscovery::find(context, DISCOVERY_TIMEOUT);
+		std::cout << "RPiCam found " << cameras.size() << " cameras\n";
+		discoveryPending = 0;
+
+		MessageManager::callAsync([editor, cameras]
+		{
+			if (RPiCamEditor* e = editor.getComponent())
+			{
+				e->camerasFound(cameras);
+			}
+		});
+	}), true);
+
+	return true;
+}
+
+
+bool RPiCam::takeSnapshot()
+{
+	if (!client->isConnected() || !snapshotPending.compareAndSetBool(1, 0))
+	{
+		return false;
+	}
+
+	// (chosen now: the recording may stop while waiting for the reply)
+	File dir(recordingDirectory);
+	if (!config.get()->recording || recordingDirectory.isEmpty())
+	{
+		dir = CoreServices::RecordNode::getRecordingPath();
+	}
+	if (dir.getFullPathName().isEmpty())
+	{
+		dir = File::getSpecialLocation(File::userHomeDirectory);
+	}
+
+	std::string url = client->getUrl();
+	String cameraAddress = address;
+	Component::SafePointer<RPiCamEditor> editor((RPiCamEditor*) getEditor());
+
+	backgroundJobs.addJob(new FunctionJob("RPiCam snapshot", [this, url, cameraAddress, dir, editor]
+	{
+		Image image;
+		File file;
+		bool success = captureSnapshot(url, cameraAddress, dir, image, file);
+		snapshotPending = 0;
+
+		MessageManager::callAsync([editor, success, image, file]
+		{
+			if (RPiCamEditor* e = editor.getComponent())
+			{
+				e->snapshotTaken(success, image, file);
+			}
+		});
+	}), true);
+
+	return true;
+}
+
+
+bool RPiCam::captureSnapshot(const std::string& url, const String& cameraAddress, const File& dir, Image& image, File& file)
+{
+	TraceSpan span(trace, "command", "Snapshot");
+
+	// (only used on the background thread)
+	snapshotClient->setUrl(url);
+
+	std::string msg = RPiCamProtocol::tagConfig(RPiCamProtocol::snapshot(), config.getVersion());
+	std::cout << "RPiCam sending message: "  << msg << " ... ";
+
+	// reply: "Snapshot <camera timestamp> <unix time>" followed by the jpeg
+	// data which is written and decoded straight from the message buffer
+	std::vector<ZmqFrame> reply;
+	int64_t camTime = 0;
+	double unixTime = 0;
+
+	bool success = snapshotClient->request(msg, reply, SNAPSHOT_TIMEOUT)
+		&& reply.size() == 2 && reply[1].size() > 0
+		&& RPiCamProtocol::parseSnapshot(reply[0].str(), camTime, unixTime);
+
+	std::cout << "the RPi answered: " << (reply.empty() ? std::string() : reply[0].str()) << "\n";
+
+	if (success)
+	{
+		dir.createDirectory();
+
+		String name = "RPiCam" + String(getNodeId()) + "_snapshot_" + generateDateString() + "_" + String((juce::int64) camTime) + ".jpg";
+		file = dir.getChildFile(name);
+
+		FileOutputStream out(file);
+		if (out.openedOk())
+		{
+			out.write(reply[1].data(), reply[1].size());
+		}
+		else
+		{
+			std::cout << "RPiCam could not write snapshot " << file.getFullPathName().toStdString() << "\n";
+		}
+
+		image = ImageFileFormat::loadFrom(reply[1].data(), reply[1].size());
+
+		CameraConfigStore::Snapshot c = config.get();
+		if (c->recording)
+		{
+			const ScopedLock sl(lock);
+			snapshotMessage = "RPiCam Address=" + cameraAddress + " Cfg=" + String((juce::int64) c->version) + " Snapshot=" + name + " Timestamp=" + String((juce::int64) camTime);
+		}
+	}
+
+	return success;
+}
+
+
 void RPiCam::updateSettings()
 {
+	// TTL inputs that can carry the strobe signal
+	strobeSources.clearQuick();
+	bool found = false;
+
+	for (int i = 0; i < getTotalEventChannels(); i++)
+	{
+		const EventChannel* chan = getEventChannel(i);
+		if (chan->getChannelType() != EventChannel::TTL)
+		{
+			continue;
+		}
+
+		StrobeSource s = { (int) chan->getSourceNodeID(), (int) chan->getSubProcessorIdx(),
+						   chan->getSourceName(), (int) chan->getNumChannels() };
+		strobeSources.add(s);
+
+		found = found || (s.nodeId == strobeSourceNode && s.subProcessor == strobeSubProcessor);
+	}
+
+	// keep the selected (or saved) source as long as it exists
+	if (!found && strobeSources.size() > 0)
+	{
+		setStrobeSource(strobeSources[0].nodeId, strobeSources[0].subProcessor);
+	}
+
+	// copies left from a previous session are resumed (the node id is only
+	// known once the processor is part of the signal chain)
+	if (getNodeId() > 0)
+	{
+		transfer->setQueueFile(File::getSpecialLocation(File::userApplicationDataDirectory)
+			.getChildFile("RPiCam").getChildFile("transfers_" + String(getNodeId()) + ".json"));
+	}
+
 	if (editor != NULL)
 	{
 		editor->update();
@@ -399,31 +926,83 @@ void RPiCam::setParameter(int parameterIndex, float newValue)
 }
 
 
-void RPiCam::handleEvent(int eventType, juce::MidiMessage& event, int samplePosition)
+void RPiCam::handleEvent(const EventChannel* eventInfo, const MidiMessage& event, int samplePosition)
 {
+	if (Event::getEventType(event) == EventChannel::TTL)
+	{
+		TTLEventPtr ttl = TTLEvent::deserializeFromMessage(event, eventInfo);
+
+		// the same line number of another source (second board, pulse
+		// generator) must not reach the decoder
+		if (ttl->getChannel() == strobeChannel
+			&& (int) eventInfo->getSourceNodeID() == strobeSourceNode
+			&& (int) eventInfo->getSubProcessorIdx() == strobeSubProcessor
+			&& !replay.isOpen())
+		{
+			decoder.addEdge(Event::getTimestamp(event), ttl->getState());
+		}
+	}
 }
 
 
 void RPiCam::startRecording()
 {
-	isRecording = true;
+	TraceSpan span(trace, "recording", "start recording");
+
+	CameraConfigStore::Snapshot c = config.update([](CameraConfig& c) { c.recording = true; });
+	updateFramePrefix();
+	firstFramePending = true;
 
 	int expNumber = CoreServices::RecordNode::getExperimentNumber();
 	int recNumber = CoreServices::RecordNode::getRecordingNumber() + 1;
 	String recPath = CoreServices::RecordNode::getRecordingPath().getFullPathName();
 
-	String msg("Start");
-	msg += String(" Experiment=") + String(expNumber);
-	msg += String(" Recording=") + String(recNumber);
+	experimentNumber = expNumber;
+	recordingNumber = recNumber;
+	recordingDirectory = recPath;
 
     // make sure to include a unique recording directory name to avoid overwriting data on the RPi
     if (recPath.length() == 0)
     {
         recPath = generateDateString();
     }
-    msg += String(" Path=") + recPath;
+	String msg = RPiCamProtocol::start(expNumber, recNumber, recPath.toStdString());
+
+	// the RPi restarts its frame counter for every recording
+	resetDecoder = true;
+
+	if (replay.isOpen())
+	{
+		// the replayed session takes the place of the RPi
+		replayStartPending = true;
+		rpiRecPath = String();
+
+		RPiCamEditor* e = (RPiCamEditor*)getEditor();
+		e->enableControls(false);
+		return;
+	}
+
+	// don't compete with the RPi writing video data to the SD card
+	transfer->setPaused(true);
 
 	rpiRecPath = sendMessage(msg);
+	if (leaseHolder.isNotEmpty())
+	{
+		// another client controls the camera (nothing is recorded)
+		CoreServices::sendStatusMessage("RPiCam: not recording, " + address + " is controlled by " + leaseHolder);
+		rpiRecPath = String();
+	}
+
+	// the files of each region are written next to the video file
+	roiMessages.clear();
+	for (size_t i = 0; i < c->rois.size(); i++)
+	{
+		const RoiSettings& r = c->rois[i];
+		roiMessages.add("RPiCam Address=" + address + " Cfg=" + String((juce::int64) c->version) + " ROI=" + String(r.name) + " RoiPath=" + rpiRecPath
+			+ " Rect=" + String(r.x, 4) + "," + String(r.y, 4) + "," + String(r.width, 4) + "," + String(r.height, 4)
+			+ " Size=" + String(r.outputWidth) + "x" + String(r.outputHeight));
+	}
+
     sendRecPathEvent = true;
 
 	RPiCamEditor* e = (RPiCamEditor*)getEditor();
@@ -433,43 +1012,273 @@ void RPiCam::startRecording()
 
 void RPiCam::stopRecording()
 {
-	isRecording  = false;
+	{
+		TraceSpan span(trace, "recording", "stop recording");
 
-	sendMessage(String("Stop"), 1000);
+		config.update([](CameraConfig& c) { c.recording = false; });
+		updateFramePrefix();
+
+		if (!replay.isOpen())
+		{
+			sendMessage(RPiCamProtocol::stop(), 1000);
+		}
+
+		// give the last frame messages a moment to arrive
+		Thread::sleep(100);
+		writeFrameTable();
+	}
+
+	if (traceAfterRecording && recordingDirectory.isNotEmpty())
+	{
+		String name = "RPiCam" + String(getNodeId());
+		name += "_experiment" + String(experimentNumber);
+		name += "_recording" + String(recordingNumber);
+		name += "_trace.json";
+		exportTrace(File(recordingDirectory).getChildFile(name));
+	}
+
+	WriteBufferStatus status;
+	if (frameStream->getWriteBuffer(status) && status.stalls > 0)
+	{
+		// frames might have been dropped by the encoder
+		CoreServices::sendStatusMessage("RPiCam: SD card too slow (" + getWriteBufferStatus() + ")");
+	}
+
+	if (copyData && rpiRecPath.isNotEmpty() && recordingDirectory.isNotEmpty())
+	{
+		String name = "RPiCam" + String(getNodeId()) + "_" + rpiRecPath.fromLastOccurrenceOf("/", false, false);
+		transfer->add(rpiRecPath, File(recordingDirectory).getChildFile(name));
+	}
+	transfer->setPaused(false);
 
 	RPiCamEditor* e = (RPiCamEditor*)getEditor();
 	e->enableControls(true);
 }
 
 
+void RPiCam::emitEvents()
+{
+	if (events.empty())
+	{
+		return;
+	}
+
+	TraceSpan span(trace, "process", "emit events", (int64_t) events.size());
+
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		const BatchedEvent& e = events[i];
+
+		// (the event is serialized by addEvent, so the value can be reused;
+		// the TextEvent and its text are allocated for each event)
+		softwareTimestamp->setValue((juce::int64) e.softwareTime);
+		TextEventPtr event = TextEvent::createTextEvent(messageChannel, e.sampleNumber,
+			String::fromUTF8(e.text, (int) e.length), eventMetaData);
+		addEvent(messageChannel, event, 0);
+	}
+
+	events.clear();
+}
+
+
 void RPiCam::process(AudioSampleBuffer& buffer)
 {
+	// decoder and matcher are also accessed by writeFrameTable
+	const ScopedLock sl(lock);
+
+	// (one consistent view of the settings for the whole block)
+	const CameraConfigStore::Snapshot cfg = config.get();
+
+	if (resetDecoder)
+	{
+		decoder.reset();
+		decoder.setSampleRate(CoreServices::getGlobalSampleRate());
+		decoder.setNominalFramerate(cfg->framerate);
+
+		matcher.reset();
+		matcher.setSampleRate(CoreServices::getGlobalSampleRate());
+		matcher.setNominalFramerate(cfg->framerate);
+
+		// the correction of the last recording is a good starting point
+		phaseLock.setSampleRate(CoreServices::getGlobalSampleRate());
+		phaseLock.setNominalFramerate(cfg->framerate);
+		phaseLock.restart();
+
+		resetDecoder = false;
+	}
+
+	checkForEvents();
+
+	// all events of this block share the software timestamp
+	juce::int64 softwareTime = timer.getHighResolutionTicks();
+	events.clear();
+
+	if (replay.isOpen() && cfg->recording)
+	{
+		processReplay(CoreServices::getGlobalTimestamp(), getNumInputs() > 0 ? getNumSamples(0) : 0);
+	}
 
     if (rpiRecPath.isNotEmpty() && sendRecPathEvent)
     {
-        juce::int64 timestamp_software = timer.getHighResolutionTicks();
-        String msg1("RPiCam Address=" + address + " RecPath=" + rpiRecPath);
-
-        uint8* msg1_raw = new uint8[msg1.length()+1];
-        memcpy(msg1_raw, msg1.toRawUTF8(), msg1.length());
-		*(msg1_raw+msg1.length()) = '\0';
-
-	    MetaDataValueArray md;
-	    md.add(new MetaDataValue(MetaDataDescriptor::INT64, 1, &timestamp_software));
-	    TextEventPtr event = TextEvent::createTextEvent(messageChannel, CoreServices::getGlobalTimestamp(), String::fromUTF8(reinterpret_cast<const char*>((uint8*)msg1_raw), msg1.length()+1), md);
-	    addEvent(messageChannel, event, 0);
-
-//        addEvent(events,
-//                 MESSAGE,
-//                 0,
-//                 0,
-//                 0,
-//                 msg1.length()+1,
-//                 (uint8*)msg1_raw);
-        delete[] msg1_raw;
+        String msg("RPiCam Address=" + address + " Cfg=" + String((juce::int64) cfg->version) + " RecPath=" + rpiRecPath);
+        events.add(CoreServices::getGlobalTimestamp(), softwareTime, msg.toStdString());
+
+		for (int i = 0; i < roiMessages.size(); i++)
+		{
+			events.add(CoreServices::getGlobalTimestamp(), softwareTime, roiMessages[i].toStdString());
+		}
 
         sendRecPathEvent = false;
     }
+
+	if (snapshotMessage.isNotEmpty())
+	{
+		events.add(CoreServices::getGlobalTimestamp(), softwareTime, snapshotMessage.toStdString());
+		snapshotMessage = String();
+	}
+
+	// barcodes anchor the frame index to the TTL sample number
+	FramePulse pulse;
+	while (decoder.popPulse(pulse))
+	{
+		if (pulse.fromBarcode)
+		{
+			events.addFrame(pulse.sampleNumber, softwareTime, framePrefix, pulse.frameIndex);
+		}
+		matcher.addPulse(pulse);
+
+		if (phaseLockEnabled && !replay.isOpen() && phaseLock.addPulse(pulse.sampleNumber))
+		{
+			framerateDeltaPending = true;
+		}
+	}
+
+	int numFrames = frameStream->read(streamedFrames, MAX_FRAMES_PER_BLOCK);
+	for (int i = 0; !replay.isOpen() && i < numFrames; i++)
+	{
+		matcher.addFrame(streamedFrames[i].frameIndex, streamedFrames[i].pts);
+	}
+
+	if (firstFramePending && cfg->recording && numFrames > 0)
+	{
+		// (time at which the frame info arrived)
+		trace.add("frames", "first frame", streamedFrames[0].received, 0, streamedFrames[0].frameIndex);
+		firstFramePending = false;
+	}
+
+	emitEvents();
+}
+
+
+void RPiCam::processReplay(juce::int64 blockStart, int numSamples)
+{
+	if (replayStartPending)
+	{
+		replay.setSampleRate(CoreServices::getGlobalSampleRate());
+		replay.setStrobe(0.001, replayBarcodeInterval, decoder.getNumBits(), 0.0002, 0.0005, 0.0002);
+		replay.start(blockStart);
+		replayStartPending = false;
+	}
+
+	replayFrames.clear();
+	replayEdges.clear();
+	replay.advance(blockStart + numSamples, MAX_FRAMES_PER_BLOCK, replayFrames, replayEdges);
+
+	for (size_t i = 0; i < replayEdges.size(); i++)
+	{
+		decoder.addEdge(replayEdges[i].sampleNumber, replayEdges[i].state);
+	}
+
+	for (size_t i = 0; i < replayFrames.size(); i++)
+	{
+		matcher.addFrame(replayFrames[i].frameIndex, replayFrames[i].pts);
+	}
+}
+
+
+void RPiCam::writeFrameTable()
+{
+	std::vector<FrameTableEntry> table;
+	{
+		const ScopedLock sl(lock);
+
+		int numFrames = frameStream->read(streamedFrames, MAX_FRAMES_PER_BLOCK);
+		for (int i = 0; i < numFrames; i++)
+		{
+			matcher.addFrame(streamedFrames[i].frameIndex, streamedFrames[i].pts);
+		}
+
+		decoder.flush();
+		FramePulse pulse;
+		while (decoder.popPulse(pulse))
+		{
+			matcher.addPulse(pulse);
+		}
+
+		std::cout << "RPiCam matched " << matcher.getNumMatched() << " strobe pulses to "
+				  << matcher.getNumFrames() << " frames\n";
+		matcher.finish(table);
+	}
+
+	if (table.empty() || recordingDirectory.isEmpty())
+	{
+		return;
+	}
+
+	String name = "RPiCam" + String(getNodeId());
+	name += "_experiment" + String(experimentNumber);
+	name += "_recording" + String(recordingNumber);
+	name += "_frames.bin";
+	File f = File(recordingDirectory).getChildFile(name);
+
+	if (!FrameMatcher::writeTable(f.getFullPathName().toStdString(), table, CoreServices::getGlobalSampleRate()))
+	{
+		std::cout << "RPiCam could not write frame table " << f.getFullPathName().toStdString() << "\n";
+	}
+}
+
+
+bool RPiCam::exportTrace(const File& file)
+{
+	std::vector<TraceProcess> processes(1);
+	processes[0].name = "RPiCam " + String(getNodeId()).toStdString() + " (plugin)";
+	processes[0].offset = 0;
+	trace.copy(processes[0].events);
+
+	if (client->isConnected() && !replay.isOpen())
+	{
+		// the host's clock is assumed to have been read half way through
+		// the round trip (the offset is accurate to half the round trip)
+		std::string reply;
+		int64_t sent = Trace::now();
+		bool success = client->request(RPiCamProtocol::trace(), reply, TRACE_TIMEOUT);
+		int64_t received = Trace::now();
+
+		TraceProcess host;
+		int64_t hostTime = 0;
+		if (success && RPiCamProtocol::parseTrace(reply, hostTime, host.events))
+		{
+			host.offset = (sent + received) / 2 - hostTime;
+			host.name = "rpicamera " + address.toStdString()
+				+ " (offset " + String(host.offset / 1000.0, 1).toStdString()
+				+ " +/- " + String((received - sent) / 2000.0, 1).toStdString() + " ms)";
+			processes.push_back(host);
+		}
+		else
+		{
+			std::cout << "RPiCam could not get the trace of " << address.toStdString() << "\n";
+		}
+	}
+
+	std::ofstream out(file.getFullPathName().toStdString().c_str());
+	if (!out)
+	{
+		std::cout << "RPiCam could not write trace " << file.getFullPathName().toStdString() << "\n";
+		return false;
+	}
+	writeChromeTrace(out, processes);
+
+	return true;
 }
 
 
@@ -484,15 +1293,52 @@ void RPiCam::saveCustomParametersToXml(XmlElement* parentElement)
     XmlElement* mainNode = parentElement->createNewChildElement("RPiCam");
 	mainNode->setAttribute("address", address);
     mainNode->setAttribute("port", port);
-    mainNode->setAttribute("width", width);
-    mainNode->setAttribute("height", height);
-    mainNode->setAttribute("framerate", framerate);
-	mainNode->setAttribute("hflip", hflip);
-	mainNode->setAttribute("vflip", vflip);
-	mainNode->setAttribute("x1", zoom[0]);
-	mainNode->setAttribute("y1", zoom[1]);
-	mainNode->setAttribute("x2", zoom[2]);
-	mainNode->setAttribute("y2", zoom[3]);
+	CameraConfigStore::Snapshot c = config.get();
+    mainNode->setAttribute("width", c->width);
+    mainNode->setAttribute("height", c->height);
+    mainNode->setAttribute("framerate", c->framerate);
+	mainNode->setAttribute("hflip", c->hflip);
+	mainNode->setAttribute("vflip", c->vflip);
+	mainNode->setAttribute("x1", c->zoom[0]);
+	mainNode->setAttribute("y1", c->zoom[1]);
+	mainNode->setAttribute("x2", c->zoom[2]);
+	mainNode->setAttribute("y2", c->zoom[3]);
+	mainNode->setAttribute("strobe_channel", strobeChannel);
+	mainNode->setAttribute("strobe_source_node", strobeSourceNode);
+	mainNode->setAttribute("strobe_subprocessor", strobeSubProcessor);
+	mainNode->setAttribute("barcode_bits", decoder.getNumBits());
+	mainNode->setAttribute("copy_data", copyData);
+	mainNode->setAttribute("stream_width", streamWidth);
+	mainNode->setAttribute("stream_height", streamHeight);
+	mainNode->setAttribute("stream_bitrate", streamBitrate);
+	mainNode->setAttribute("intra_period", intraPeriod);
+	mainNode->setAttribute("copy_max_rate", transfer->getMaxRate());
+	mainNode->setAttribute("replay_file", getReplayFile());
+	mainNode->setAttribute("replay_speed", replay.getSpeed());
+	mainNode->setAttribute("replay_barcode_interval", replayBarcodeInterval);
+	mainNode->setAttribute("phase_lock", phaseLockEnabled);
+	mainNode->setAttribute("phase_target", phaseTarget);
+	mainNode->setAttribute("phase_tolerance", phaseTolerance);
+	mainNode->setAttribute("exposure_interval", exposureInterval);
+	mainNode->setAttribute("exposure_region", exposureRegion);
+	mainNode->setAttribute("exposure_target", exposureTarget);
+	mainNode->setAttribute("exposure_max_saturation", exposureMaxSaturation);
+	mainNode->setAttribute("exposure_min_shutter", exposureMinShutter);
+	mainNode->setAttribute("exposure_max_shutter", exposureMaxShutter);
+	mainNode->setAttribute("trace_after_recording", traceAfterRecording);
+
+	for (size_t i = 0; i < c->rois.size(); i++)
+	{
+		const RoiSettings& r = c->rois[i];
+		XmlElement* roiNode = mainNode->createNewChildElement("ROI");
+		roiNode->setAttribute("name", String(r.name));
+		roiNode->setAttribute("x", r.x);
+		roiNode->setAttribute("y", r.y);
+		roiNode->setAttribute("width", r.width);
+		roiNode->setAttribute("height", r.height);
+		roiNode->setAttribute("output_width", r.outputWidth);
+		roiNode->setAttribute("output_height", r.outputHeight);
+	}
 }
 
 
@@ -508,37 +1354,109 @@ void RPiCam::loadCustomParametersFromXml()
                 setAddress(mainNode->getStringAttribute("address"), false, false);
 				setPort(mainNode->getIntAttribute("port"), false, false);
 
-                if (mainNode->hasAttribute("width"))
+                std::vector<RoiSettings> rois;
+                forEachXmlChildElementWithTagName(*mainNode, roiNode, "ROI")
                 {
-                    width = mainNode->getIntAttribute("width");
+                    RoiSettings r;
+                    r.name = roiNode->getStringAttribute("name").toStdString();
+                    r.x = roiNode->getDoubleAttribute("x");
+                    r.y = roiNode->getDoubleAttribute("y");
+                    r.width = roiNode->getDoubleAttribute("width", 1.0);
+                    r.height = roiNode->getDoubleAttribute("height", 1.0);
+                    r.outputWidth = roiNode->getIntAttribute("output_width");
+                    r.outputHeight = roiNode->getIntAttribute("output_height");
+                    rois.push_back(r);
                 }
 
-                if (mainNode->hasAttribute("height"))
+                // camera settings are published as one new version
+                config.update([&](CameraConfig& c)
+                {
+                    c.width = mainNode->getIntAttribute("width", c.width);
+                    c.height = mainNode->getIntAttribute("height", c.height);
+                    c.framerate = mainNode->getIntAttribute("framerate", c.framerate);
+                    c.hflip = mainNode->getBoolAttribute("hflip", c.hflip);
+                    c.vflip = mainNode->getBoolAttribute("vflip", c.vflip);
+
+                    if (mainNode->hasAttribute("x1"))
+                    {
+                        c.zoom[0] = mainNode->getIntAttribute("x1");
+                        c.zoom[1] = mainNode->getIntAttribute("y1");
+                        c.zoom[2] = mainNode->getIntAttribute("x2");
+                        c.zoom[3] = mainNode->getIntAttribute("y2");
+                    }
+
+                    c.rois = rois;
+                });
+                updateFramePrefix();
+
+      			if (mainNode->hasAttribute("strobe_channel"))
       			{
-      			    height = mainNode->getIntAttribute("height");
+      			    strobeChannel = mainNode->getIntAttribute("strobe_channel");
       			}
 
-                if (mainNode->hasAttribute("framerate"))
-                {
-                    framerate = mainNode->getIntAttribute("framerate");
-                }
+      			if (mainNode->hasAttribute("strobe_source_node"))
+      			{
+      			    setStrobeSource(mainNode->getIntAttribute("strobe_source_node"),
+      			                    mainNode->getIntAttribute("strobe_subprocessor", 0));
+      			}
 
-                if (mainNode->hasAttribute("hflip"))
-                {
-                    hflip = mainNode->getBoolAttribute("hflip");
-                }
+      			if (mainNode->hasAttribute("barcode_bits"))
+      			{
+      			    decoder.setNumBits(mainNode->getIntAttribute("barcode_bits"));
+      			}
+
+      			if (mainNode->hasAttribute("stream_width"))
+      			{
+      			    streamWidth = mainNode->getIntAttribute("stream_width");
+      			    streamHeight = mainNode->getIntAttribute("stream_height");
+      			    streamBitrate = mainNode->getIntAttribute("stream_bitrate", 500);
+      			}
+
+      			if (mainNode->hasAttribute("intra_period"))
+      			{
+      			    // sent together with the other camera parameters
+      			    intraPeriod = mainNode->getIntAttribute("intra_period");
+      			}
+
+      			if (mainNode->hasAttribute("copy_data"))
+      			{
+      			    copyData = mainNode->getBoolAttribute("copy_data");
+      			}
+
+      			if (mainNode->hasAttribute("copy_max_rate"))
+      			{
+      			    // kB/s (0: unlimited)
+      			    transfer->setMaxRate(mainNode->getIntAttribute("copy_max_rate"));
+      			}
+
+      			if (mainNode->hasAttribute("replay_file"))
+      			{
+      			    replayBarcodeInterval = mainNode->getIntAttribute("replay_barcode_interval");
+      			    setReplay(mainNode->getStringAttribute("replay_file"), mainNode->getDoubleAttribute("replay_speed", 1.0));
+      			}
+
+      			if (mainNode->hasAttribute("phase_lock"))
+      			{
+      			    // ms relative to the acquisition clock
+      			    phaseTarget = mainNode->getDoubleAttribute("phase_target", 0.0);
+      			    phaseTolerance = mainNode->getDoubleAttribute("phase_tolerance", 1.0);
+      			    setPhaseLock(mainNode->getBoolAttribute("phase_lock"));
+      			}
 
-      			if (mainNode->hasAttribute("vflip"))
+      			if (mainNode->hasAttribute("exposure_interval"))
       			{
-      			    vflip = mainNode->getBoolAttribute("vflip");
+      			    // sent together with the other camera parameters
+      			    exposureInterval = mainNode->getIntAttribute("exposure_interval");
+      			    exposureRegion = mainNode->getStringAttribute("exposure_region");
+      			    exposureTarget = mainNode->getDoubleAttribute("exposure_target");
+      			    exposureMaxSaturation = mainNode->getDoubleAttribute("exposure_max_saturation", 0.01);
+      			    exposureMinShutter = mainNode->getIntAttribute("exposure_min_shutter", 100);
+      			    exposureMaxShutter = mainNode->getIntAttribute("exposure_max_shutter");
       			}
 
-      			if (mainNode->hasAttribute("x1"))
+      			if (mainNode->hasAttribute("trace_after_recording"))
       			{
-      			    zoom[0] = mainNode->getIntAttribute("x1");
-      			    zoom[1] = mainNode->getIntAttribute("y1");
-      			    zoom[2] = mainNode->getIntAttribute("x2");
-      			    zoom[3] = mainNode->getIntAttribute("y2");
+      			    traceAfterRecording = mainNode->getBoolAttribute("trace_after_recording");
       			}
 
                 RPiCamEditor* e = (RPiCamEditor*)getEditor();
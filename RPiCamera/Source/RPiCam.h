@@ -36,12 +36,44 @@
 #endif
 
 #include <ProcessorHeaders.h>
+#include <atomic>
+
+#include "BarcodeDecoder.h"
+#include "CameraClient.h"
+#include "CameraConfig.h"
+#include "CameraDiscovery.h"
+#include "DataTransfer.h"
+#include "EventBatch.h"
+#include "FrameMatcher.h"
+#include "FrameStream.h"
+#include "PhaseLock.h"
+#include "ReplaySource.h"
+#include "RPiCamProtocol.h"
+#include "Trace.h"
 
 /**
 
  Control Rapsberry PI camera via zmq messages
 
-  @see GenericProcessor
+ This class only connects the Open Ephys GUI to the engine classes which do
+ not depend on JUCE (CameraClient, RPiCamProtocol, FrameStream,
+ BarcodeDecoder, FrameMatcher, TimestampFile, ReplaySource; see the
+ rpicam_core library in RPiCamera/Tools).
+
+ The strobe pulses (and frame index barcodes) sent by the RPi are decoded
+ from the TTL events on the selected strobe channel and matched to the
+ frames streamed by the RPi. At the end of each recording, a table mapping
+ frame indices to sample numbers is written to the recording directory.
+ If enabled, the files recorded by the RPi are copied to the recording
+ directory in the background after each recording. Still images can be
+ taken at any time (also while recording) and are saved to the recording
+ directory.
+
+ Instead of a connected RPi, a recorded session can be replayed (see
+ ReplaySource): its frames and strobe signal are fed to the decoder and
+ matcher during each recording, in real time or as fast as possible.
+
+  @see GenericProcessor, BarcodeDecoder, FrameMatcher, DataTransfer, ReplaySource
 
 */
 
@@ -49,7 +81,7 @@
 String generateDateString();
 
 
-class RPiCam : public GenericProcessor
+class RPiCam : public GenericProcessor, private Timer
 {
 public:
     RPiCam();
@@ -59,13 +91,9 @@ public:
     void setParameter(int parameterIndex, float newValue);
 	void createEventChannels();
 
-    bool isSource() { return true; };
-
     void updateSettings();
 
     bool isReady() { return true; }
-    float getDefaultSampleRate() { return 30000.; };
-    int getDefaultNumOutputs() { return 1; };
     void enabledState(bool t);
     int getNumEventChannels() { return 1; };
 
@@ -77,17 +105,94 @@ public:
 	void setAddress(String s, bool connect = false, bool update = true);
 	String getAddress();
 	void setResolution(int w, int h);
-    int getWidth() { return width; }
-    int getHeight() { return height; }
+    int getWidth() { return config.get()->width; }
+    int getHeight() { return config.get()->height; }
 	void setFramerate(int fps);
-	int getFramerate() { return framerate; }
+	int getFramerate() { return config.get()->framerate; }
 	void setVflip(bool status);
-	bool getVflip() { return vflip; }
+	bool getVflip() { return config.get()->vflip; }
 	void setHflip(bool status);
-	bool getHflip() { return hflip; }
+	bool getHflip() { return config.get()->hflip; }
 	void setZoom(int z[4]);
 	void getZoom(int *z);
+
+	/** Consistent snapshot of the camera settings (any thread, lock-free). */
+	CameraConfigStore::Snapshot getConfig() const { return config.get(); }
 	void resetGains();
+	void setStream(int w, int h, int kbps);
+	int getStreamWidth() { return streamWidth; }
+	int getStreamHeight() { return streamHeight; }
+	int getStreamBitrate() { return streamBitrate; }
+
+	/** Frames between key frames of the recording and the live stream (0: default). */
+	void setIntraPeriod(int frames);
+	int getIntraPeriod() { return intraPeriod; }
+
+	/** Key frame of the live stream and the recording with the next frame. */
+	void requestKeyframe();
+
+	/** Lock the frame timing to the acquisition clock (via the strobe pulses). */
+	void setPhaseLock(bool enabled);
+	bool getPhaseLock() { return phaseLockEnabled; }
+	String getPhaseLockStatus();
+
+	/** Regions recorded as separate files (applied to the next recording). */
+	void setRois(const std::vector<RoiSettings>& r);
+	std::vector<RoiSettings> getRois() { return config.get()->rois; }
+
+	/** Exposure summary of every n-th frame (0: off), metered in a region (empty: whole image). */
+	void setExposureMonitor(int interval, const String& roiName);
+	int getExposureInterval() { return exposureInterval; }
+	String getExposureRegion() { return exposureRegion; }
+
+	/** Bounded shutter control on the RPi (target mean luma 0: off). */
+	void setExposureControl(double target, double maxSaturation, int minShutter, int maxShutter);
+	double getExposureTarget() { return exposureTarget; }
+	double getExposureMaxSaturation() { return exposureMaxSaturation; }
+	int getExposureMinShutter() { return exposureMinShutter; }
+	int getExposureMaxShutter() { return exposureMaxShutter; }
+
+	/** Latest summary published by the RPi; returns the number received (0: none). */
+	juce::int64 getExposure(ExposureSummary& summary) { return frameStream->getExposure(summary); }
+
+	/** Write-behind buffer of the video file on the RPi ("" if not reported). */
+	String getWriteBufferStatus();
+
+	/** Timeline of the plugin and the RPi as one Chrome trace (JSON) file. */
+	bool exportTrace(const File& file);
+
+	/** Export the trace into the recording directory after each recording. */
+	void setTraceAfterRecording(bool status) { traceAfterRecording = status; }
+	bool getTraceAfterRecording() { return traceAfterRecording; }
+	/** TTL event channel of an upstream processor that may carry the strobe. */
+	struct StrobeSource
+	{
+		int nodeId;
+		int subProcessor;
+		String name;
+		int numLines;
+	};
+
+	// lines per source offered by the editor
+	static const int MAX_STROBE_LINES = 8;
+
+	const Array<StrobeSource>& getStrobeSources() { return strobeSources; }
+	void setStrobeSource(int nodeId, int subProcessor);
+	int getStrobeSourceNode() { return strobeSourceNode; }
+	int getStrobeSubProcessor() { return strobeSubProcessor; }
+	void setStrobeChannel(int channel);
+	int getStrobeChannel() { return strobeChannel; }
+	void setBarcodeBits(int n);
+	int getBarcodeBits() { return decoder.getNumBits(); }
+	void setCopyData(bool status) { copyData = status; }
+	bool getCopyData() { return copyData; }
+	String getTransferStatus() { return transfer->getStatus(); }
+
+	/** Replay a recorded video file (empty: off); speed 0: as fast as possible. */
+	bool setReplay(const String& videoPath, double speed = 1.0);
+	bool isReplaying() { return replay.isOpen(); }
+	String getReplayFile() { return String(replay.getVideoPath()); }
+	double getReplaySpeed() { return replay.getSpeed(); }
 
 	void sendCameraParameters();
 
@@ -96,34 +201,125 @@ public:
 
 	String sendMessage(String msg, int timeout=-1);
 
+	/** Client controlling the camera if it is not this one ("" otherwise). */
+	String getLeaseHolder() { return leaseHolder; }
+
+	/** Request a still image on a background thread; the editor saves and
+		shows it when the reply arrives (see RPiCamEditor::snapshotTaken).
+		Returns false if not connected or a snapshot is still pending. */
+	bool takeSnapshot();
+
+	/** Search the local network for hosts (found and probed in parallel) on a
+		background thread; the editor lists them when the search is done (see
+		RPiCamEditor::camerasFound). Returns false if a search is still running. */
+	bool discoverCameras();
+
     void saveCustomParametersToXml(XmlElement* parentElement);
     void loadCustomParametersFromXml();
 
 private:
-    void handleEvent(int eventType, MidiMessage& event, int samplePos);
+    void handleEvent(const EventChannel* eventInfo, const MidiMessage& event, int samplePosition) override;
+	void emitEvents();
+	void timerCallback() override;
+	void renewLease();
+	bool checkLease(const String& reply);
+	void updateFramePrefix();
+	void writeFrameTable();
+	void processReplay(juce::int64 blockStart, int numSamples);
+	bool captureSnapshot(const std::string& url, const String& cameraAddress, const File& dir, Image& image, File& file);
 
     void createContext();
 	void destroyContext();
 
     void* context;
-	void* socket;
+	ScopedPointer<CameraClient> client;
+
+	// exclusive control of the camera, renewed by the timer
+	String clientName;
+	String leaseHolder;
+	uint32 nextLease;
     int port;
 	String address;
 
     bool sendRecPathEvent;
     String rpiRecPath;
-
-	int width;
-	int height;
-	int framerate;
-	bool vflip;
-	bool hflip;
-	int zoom[4];
-	bool isRecording;
+	String snapshotMessage;
+	StringArray roiMessages;
+
+	// camera settings, changed on the message thread and read everywhere
+	CameraConfigStore config;
+
+	// live stream (width 0: off; bitrate in kbit/s)
+	int streamWidth;
+	int streamHeight;
+	int streamBitrate;
+
+	// key frame interval (frames; 0: encoder default)
+	int intraPeriod;
+
+	// exposure monitor (interval 0: off) and control (target 0: off)
+	int exposureInterval;
+	String exposureRegion;
+	double exposureTarget;
+	double exposureMaxSaturation;
+	int exposureMinShutter;
+	int exposureMaxShutter;	// usec (0: frame period)
+
+	// frame rate corrections are computed in process() and sent by the timer
+	PhaseLock phaseLock;
+	std::atomic<bool> phaseLockEnabled;
+	double phaseTarget;		// ms
+	double phaseTolerance;	// ms
+	bool framerateDeltaPending;
+
+	// only edges of this line of this source reach the decoder (set on the
+	// message thread, read in handleEvent)
+	Array<StrobeSource> strobeSources;
+	std::atomic<int> strobeSourceNode;
+	std::atomic<int> strobeSubProcessor;
+	std::atomic<int> strobeChannel;
+	BarcodeDecoder decoder;
+	bool resetDecoder;
+
+	ScopedPointer<FrameStream> frameStream;
+	HeapBlock<StreamedFrame> streamedFrames;
+	FrameMatcher matcher;
+	int experimentNumber;
+	int recordingNumber;
+	String recordingDirectory;
+
+	ScopedPointer<DataTransfer> transfer;
+	bool copyData;
+
+	// requests that wait for the network (snapshots, discovery) run here
+	// instead of on the message thread; snapshots use their own connection,
+	// which shares the lease of the main one ("<client name>/snapshot")
+	ThreadPool backgroundJobs;
+	ScopedPointer<CameraClient> snapshotClient;
+	Atomic<int> snapshotPending;
+	Atomic<int> discoveryPending;
+
+	ReplaySource replay;
+	int replayBarcodeInterval;
+	bool replayStartPending;
+	std::vector<ReplayFrame> replayFrames;
+	std::vector<ReplayEdge> replayEdges;
 
 	const EventChannel* messageChannel{ nullptr };
 	Time timer;
 
+	// commands, connection and recording steps (see exportTrace)
+	Trace trace;
+	bool traceAfterRecording;
+	bool firstFramePending;
+
+	// text events of the current block, collected without allocating and
+	// emitted together with reused metadata
+	EventBatch events;
+	std::string framePrefix;
+	MetaDataValueArray eventMetaData;
+	MetaDataValue* softwareTimestamp;
+
     CriticalSection lock;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RPiCam);
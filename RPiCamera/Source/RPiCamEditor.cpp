@@ -33,7 +33,7 @@ RPiCamEditor::RPiCamEditor(GenericProcessor* parentNode, bool useDefaultParamete
     : GenericEditor(parentNode, useDefaultParameterEditors)
 
 {
-	desiredWidth = 280;
+	desiredWidth = 540;
 
 	RPiCam *p= (RPiCam *)getProcessor();
 
@@ -60,14 +60,30 @@ RPiCamEditor::RPiCamEditor(GenericProcessor* parentNode, bool useDefaultParamete
     addAndMakeVisible(addressLabel);
 
 	addressEdit = new Label("Address", p->getAddress());
-    addressEdit->setBounds(75,50,120+80,20);
+    addressEdit->setBounds(75,50,100,20);
     addressEdit->setFont(Font("Default", 15, Font::plain));
     addressEdit->setColour(Label::textColourId, Colours::white);
 	addressEdit->setColour(Label::backgroundColourId, Colours::grey);
     addressEdit->setEditable(true);
     addressEdit->addListener(this);
+	addressEdit->setTooltip("IP address of the RPi or zmq endpoint (tcp://, ipc://, inproc://)");
 	addAndMakeVisible(addressEdit);
 
+	// hosts announcing themselves on the local network
+	findButton = new UtilityButton("Find", Font("Default", 15, Font::plain));
+	findButton->setBounds(178,50,40,20);
+	findButton->addListener(this);
+	findButton->setTooltip("Find cameras on the local network");
+	addAndMakeVisible(findButton);
+
+	// replay of a recorded session instead of a connected RPi
+	replayButton = new UtilityButton("Replay", Font("Default", 15, Font::plain));
+	replayButton->setBounds(221,50,54,20);
+	replayButton->setToggleState(p->isReplaying(), dontSendNotification);
+	replayButton->addListener(this);
+	replayButton->setTooltip("Replay the frames and strobe signal of a recorded video file");
+	addAndMakeVisible(replayButton);
+
 	// frame rate (values depend on camera format)
     fpsLabel = new Label("FPS", "FPS:");
     fpsLabel->setBounds(185,75,65,20);
@@ -129,6 +145,123 @@ RPiCamEditor::RPiCamEditor(GenericProcessor* parentNode, bool useDefaultParamete
 	vflipButton->setTooltip("Enable/disable vertical flip");
     addAndMakeVisible(vflipButton);
 
+	// TTL channel receiving the camera's strobe pulses
+	strobeLabel = new Label("Strobe", "TTL:");
+	strobeLabel->setBounds(285,25,50,20);
+	strobeLabel->setTooltip("Digital input channel connected to the RPi strobe pin");
+	addAndMakeVisible(strobeLabel);
+
+	strobeCombo = new ComboBox();
+	strobeCombo->setBounds(285,50,50,20);
+	strobeCombo->addListener(this);
+	updateStrobeCombo();
+	addAndMakeVisible(strobeCombo);
+
+	// copy recorded files from the RPi after each recording
+	copyButton = new UtilityButton("Copy", Font("Default", 15, Font::plain));
+	copyButton->setBounds(285,75,50,20);
+	copyButton->setClickingTogglesState(true);
+	copyButton->setToggleState(p->getCopyData(), dontSendNotification);
+	copyButton->addListener(this);
+	copyButton->setTooltip("Copy the recorded files from the RPi to the recording directory");
+	addAndMakeVisible(copyButton);
+
+	transferLabel = new Label("Transfer", "");
+	transferLabel->setBounds(230,100,105,25);
+	transferLabel->setFont(Font("Default", 12, Font::plain));
+	transferLabel->setJustificationType(Justification::right);
+	addAndMakeVisible(transferLabel);
+
+	// low-resolution live stream (encoded in parallel to the recording)
+	streamLabel = new Label("Live", "Live:");
+	streamLabel->setBounds(340,25,65,25);
+	streamLabel->setTooltip(String("Live stream: ffplay -f h264 tcp://<address>:<port+2>"));
+	addAndMakeVisible(streamLabel);
+
+	streamCombo = new ComboBox();
+	streamCombo->setBounds(340,50,75,20);
+	streamCombo->addListener(this);
+	streamCombo->addItem("Off", 1);
+	streamCombo->addItem("320x240", 2);
+	streamCombo->addItem("480x360", 3);
+	streamCombo->addItem("640x480", 4);
+	addAndMakeVisible(streamCombo);
+
+	bitrateCombo = new ComboBox();
+	bitrateCombo->setBounds(340,75,75,20);
+	bitrateCombo->addListener(this);
+	bitrateCombo->addItem("250k", 1);
+	bitrateCombo->addItem("500k", 2);
+	bitrateCombo->addItem("1M", 3);
+	bitrateCombo->addItem("2M", 4);
+	addAndMakeVisible(bitrateCombo);
+
+	snapshotButton = new UtilityButton("Snap", Font("Default", 15, Font::plain));
+	snapshotButton->setBounds(340,102,50,20);
+	snapshotButton->addListener(this);
+	snapshotButton->setTooltip("Take a still image (also while recording) and save it to the recording directory");
+	addAndMakeVisible(snapshotButton);
+
+	// timeline of commands and recording steps on both sides
+	traceButton = new UtilityButton("T", Font("Default", 15, Font::plain));
+	traceButton->setBounds(395,102,20,20);
+	traceButton->addListener(this);
+	traceButton->setToggleState(p->getTraceAfterRecording(), dontSendNotification);
+	traceButton->setTooltip("Save the timeline of the plugin and the RPi as a Chrome trace (chrome://tracing, ui.perfetto.dev)");
+	addAndMakeVisible(traceButton);
+
+	// regions of interest recorded as separate files
+	roiLabel = new Label("ROIs", "ROIs:");
+	roiLabel->setBounds(420,25,55,25);
+	addAndMakeVisible(roiLabel);
+
+	roiButton = new UtilityButton("Edit", Font("Default", 15, Font::plain));
+	roiButton->setBounds(420,50,55,20);
+	roiButton->addListener(this);
+	roiButton->setTooltip("Add, change or remove regions of interest (applied to the next recording)");
+	addAndMakeVisible(roiButton);
+
+	// exposure statistics computed on the RPi
+	exposureButton = new UtilityButton("Exp", Font("Default", 15, Font::plain));
+	exposureButton->setBounds(420,75,55,20);
+	exposureButton->addListener(this);
+	exposureButton->setToggleState(p->getExposureInterval() > 0, dontSendNotification);
+	exposureButton->setTooltip("Exposure histogram and control");
+	addAndMakeVisible(exposureButton);
+
+	// frame timing locked to the acquisition clock (requires strobe decoding)
+	lockButton = new UtilityButton("Lock", Font("Default", 15, Font::plain));
+	lockButton->setBounds(420,102,55,20);
+	lockButton->setClickingTogglesState(true);
+	lockButton->setToggleState(p->getPhaseLock(), dontSendNotification);
+	lockButton->addListener(this);
+	lockButton->setTooltip(p->getPhaseLockStatus());
+	addAndMakeVisible(lockButton);
+
+	// key frames of the recording (seeking) and the live stream (joining)
+	keyframeLabel = new Label("Keys", "Keys:");
+	keyframeLabel->setBounds(480,25,55,25);
+	keyframeLabel->setTooltip("Frames between key frames of the recording and the live stream");
+	addAndMakeVisible(keyframeLabel);
+
+	intraCombo = new ComboBox();
+	intraCombo->setBounds(480,50,55,20);
+	intraCombo->addListener(this);
+	intraCombo->addItem("Auto", 1);
+	const int intraPeriods[] = {5, 10, 30, 60, 150};
+	for (int i = 0; i < 5; i++)
+	{
+		intraCombo->addItem(String(intraPeriods[i]), intraPeriods[i] + 1);
+	}
+	intraCombo->setTooltip("Frames between key frames (Auto: encoder default, one second for the live stream)");
+	addAndMakeVisible(intraCombo);
+
+	keyframeButton = new UtilityButton("Key", Font("Default", 15, Font::plain));
+	keyframeButton->setBounds(480,75,55,20);
+	keyframeButton->addListener(this);
+	keyframeButton->setTooltip("Insert a key frame into the live stream and the recording now");
+	addAndMakeVisible(keyframeButton);
+
 	// zoom buttons
     zoomLabel = new Label("Zoom", "Zoom:");
     zoomLabel->setBounds(5,100,65,25);
@@ -167,12 +300,35 @@ RPiCamEditor::RPiCamEditor(GenericProcessor* parentNode, bool useDefaultParamete
 		addAndMakeVisible(l);
 		zoomValues.add(l);
 	}
+
+	// transfer progress
+	startTimer(500);
 }
 
 
 RPiCamEditor::~RPiCamEditor()
 {
+	stopTimer();
+
+	// the histogram window reads from the processor
+	exposureWindow.deleteAndZero();
+}
+
+
+void RPiCamEditor::timerCallback()
+{
+	RPiCam *p= (RPiCam *)getProcessor();
+	transferLabel->setText(p->getTransferStatus(), dontSendNotification);
+	transferLabel->setTooltip(p->getWriteBufferStatus());
+	lockButton->setTooltip(p->getPhaseLockStatus());
+	connectButton->setTooltip(p->getLeaseHolder().isEmpty() ? String() : "Controlled by " + p->getLeaseHolder() + " (read only)");
 
+	ExposureSummary summary;
+	if (p->getExposureInterval() > 0 && p->getExposure(summary) > 0)
+	{
+		exposureButton->setTooltip("Mean " + String(summary.mean, 1) + ", " + String(100. * summary.saturated, 2)
+			+ "% saturated, shutter " + String(summary.shutter) + " us");
+	}
 }
 
 
@@ -192,6 +348,52 @@ void RPiCamEditor::updateValues()
 		addressEdit->setText(p->getAddress(), dontSendNotification);
 	}
 
+	updateStrobeCombo();
+	copyButton->setToggleState(p->getCopyData(), dontSendNotification);
+	lockButton->setToggleState(p->getPhaseLock(), dontSendNotification);
+	replayButton->setToggleState(p->isReplaying(), dontSendNotification);
+	if (p->isReplaying())
+	{
+		replayButton->setTooltip("Replaying " + p->getReplayFile());
+	}
+
+	int streamId = 1;
+	for (int i=2; i<=streamCombo->getNumItems(); i++)
+	{
+		if (streamCombo->getItemText(i-1) == String(p->getStreamWidth()) + "x" + String(p->getStreamHeight()))
+		{
+			streamId = i;
+		}
+	}
+	streamCombo->setSelectedId(streamId, dontSendNotification);
+
+	std::vector<RoiSettings> rois = p->getRois();
+	StringArray roiNames;
+	for (size_t i = 0; i < rois.size(); i++)
+	{
+		roiNames.add(String(rois[i].name) + " " + String(rois[i].outputWidth) + "x" + String(rois[i].outputHeight));
+	}
+	roiLabel->setText("ROIs: " + String((int) rois.size()), dontSendNotification);
+	roiLabel->setTooltip(roiNames.joinIntoString(", "));
+	exposureButton->setToggleState(p->getExposureInterval() > 0, dontSendNotification);
+	traceButton->setToggleState(p->getTraceAfterRecording(), dontSendNotification);
+
+	// ids are the number of frames + 1 (1: default)
+	if (intraCombo->indexOfItemId(p->getIntraPeriod() + 1) < 0)
+	{
+		intraCombo->addItem(String(p->getIntraPeriod()), p->getIntraPeriod() + 1);
+	}
+	intraCombo->setSelectedId(p->getIntraPeriod() + 1, dontSendNotification);
+
+	const int bitrates[] = {250, 500, 1000, 2000};
+	for (int i=0; i<4; i++)
+	{
+		if (bitrates[i] == p->getStreamBitrate())
+		{
+			bitrateCombo->setSelectedId(i+1, dontSendNotification);
+		}
+	}
+
   // set camera format based on resolution
   int index = 0;
   for (RPiCamFormat *fmt=camFormats.begin(); fmt++; fmt!=camFormats.end())
@@ -215,12 +417,311 @@ void RPiCamEditor::updateValues()
 }
 
 
+void RPiCamEditor::updateSettings()
+{
+	// upstream TTL sources may have changed
+	updateStrobeCombo();
+}
+
+
+void RPiCamEditor::updateStrobeCombo()
+{
+	RPiCam *p= (RPiCam *)getProcessor();
+	const Array<RPiCam::StrobeSource>& sources = p->getStrobeSources();
+
+	// one section per source; ids 2 + source * MAX_STROBE_LINES + line
+	strobeCombo->clear(dontSendNotification);
+	strobeCombo->addItem("-", 1);
+
+	int selected = 1;
+	String tooltip = "Digital input channel connected to the RPi strobe pin";
+
+	for (int k = 0; k < sources.size(); k++)
+	{
+		RPiCam::StrobeSource s = sources[k];
+		strobeCombo->addSectionHeading(s.name);
+
+		for (int i = 0; i < jmin(s.numLines, (int) RPiCam::MAX_STROBE_LINES); i++)
+		{
+			strobeCombo->addItem(String(i+1), 2 + k * RPiCam::MAX_STROBE_LINES + i);
+		}
+
+		if (s.nodeId == p->getStrobeSourceNode() && s.subProcessor == p->getStrobeSubProcessor())
+		{
+			if (p->getStrobeChannel() >= 0)
+			{
+				selected = 2 + k * RPiCam::MAX_STROBE_LINES + p->getStrobeChannel();
+			}
+			tooltip += " (" + s.name + ")";
+		}
+	}
+
+	strobeCombo->setSelectedId(selected, dontSendNotification);
+	strobeCombo->setTooltip(tooltip);
+}
+
+
 void RPiCamEditor::enableControls(bool state)
 {
 	resolutionCombo->setEnabled(state);
 	fpsCombo->setEnabled(state);
+	strobeCombo->setEnabled(state);
+	replayButton->setEnabled(state);
+	findButton->setEnabled(state);
+	roiButton->setEnabled(state);
+}
+
+
+bool RPiCamEditor::editRoi(RoiSettings& r)
+{
+	AlertWindow w("Region of interest",
+		"Rectangle: left, top, width and height relative to the recorded image (0 to 1).\n"
+		"The region is resampled to the output size and written to its own file.",
+		AlertWindow::NoIcon);
+	w.addTextEditor("name", String(r.name), "Name:");
+	w.addTextEditor("rect", String(r.x, 3) + " " + String(r.y, 3) + " " + String(r.width, 3) + " " + String(r.height, 3), "Rectangle:");
+	w.addTextEditor("size", String(r.outputWidth) + "x" + String(r.outputHeight), "Output size:");
+	w.addButton("OK", 1, KeyPress(KeyPress::returnKey));
+	w.addButton("Cancel", 0, KeyPress(KeyPress::escapeKey));
+
+	if (w.runModalLoop() != 1)
+	{
+		return false;
+	}
+
+	// names are used in file names on the RPi
+	String name = w.getTextEditorContents("name").retainCharacters("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_");
+	StringArray rect = StringArray::fromTokens(w.getTextEditorContents("rect"), " ,", "");
+	StringArray size = StringArray::fromTokens(w.getTextEditorContents("size"), "x ", "");
+	rect.removeEmptyStrings();
+	size.removeEmptyStrings();
+
+	if (name.isEmpty() || rect.size() != 4 || size.size() != 2)
+	{
+		CoreServices::sendStatusMessage("RPiCam: invalid region of interest");
+		return false;
+	}
+
+	r.name = name.toStdString();
+	r.x = jlimit(0.0, 1.0, rect[0].getDoubleValue());
+	r.y = jlimit(0.0, 1.0, rect[1].getDoubleValue());
+	r.width = jlimit(0.0, 1.0 - r.x, rect[2].getDoubleValue());
+	r.height = jlimit(0.0, 1.0 - r.y, rect[3].getDoubleValue());
+	r.outputWidth = jlimit(1, 1920, size[0].getIntValue());
+	r.outputHeight = jlimit(1, 1080, size[1].getIntValue());
+
+	return r.width > 0 && r.height > 0;
+}
+
+bool RPiCamEditor::editExposureControl()
+{
+	RPiCam *p= (RPiCam *)getProcessor();
+
+	AlertWindow w("Exposure control",
+		"The shutter time is adjusted in small steps to keep the mean brightness of the
+"
+		"metered region close to the target (gains stay fixed). The exposure is reduced
+"
+		"if too many pixels are saturated.",
+		AlertWindow::NoIcon);
+	double target = p->getExposureTarget() > 0 ? p->getExposureTarget() : 100.0;
+	w.addTextEditor("target", String(target, 1), "Target mean (0-255):");
+	w.addTextEditor("saturation", String(100. * p->getExposureMaxSaturation(), 2), "Max. saturated (%):");
+	w.addTextEditor("shutter", String(p->getExposureMinShutter()) + " " + String(p->getExposureMaxShutter()), "Shutter range (us, 0: frame period):");
+	w.addButton("OK", 1, KeyPress(KeyPress::returnKey));
+	w.addButton("Cancel", 0, KeyPress(KeyPress::escapeKey));
+
+	if (w.runModalLoop() != 1)
+	{
+		return false;
+	}
+
+	StringArray shutter = StringArray::fromTokens(w.getTextEditorContents("shutter"), " ,", "");
+	shutter.removeEmptyStrings();
+
+	target = w.getTextEditorContents("target").getDoubleValue();
+	if (target <= 0 || shutter.size() != 2)
+	{
+		CoreServices::sendStatusMessage("RPiCam: invalid exposure control settings");
+		return false;
+	}
+
+	p->setExposureControl(target,
+		jlimit(0.0, 1.0, w.getTextEditorContents("saturation").getDoubleValue() / 100.),
+		jmax(1, shutter[0].getIntValue()),
+		jmax(0, shutter[1].getIntValue()));
+
+	return true;
+}
+
+
+/**
+
+  Histogram of the latest exposure summary (refreshed while open)
+
+*/
+
+class ExposureView : public Component, private Timer
+{
+public:
+	ExposureView(RPiCam* p) : processor(p), count(0)
+	{
+		setSize(400, 220);
+		startTimer(200);
+	}
+
+	void paint(Graphics& g) override
+	{
+		g.fillAll(Colours::black);
+		g.setColour(Colours::white);
+		g.setFont(13);
+
+		if (count == 0)
+		{
+			g.drawText(processor->getExposureInterval() > 0 ? "Waiting for the RPi" : "Exposure monitor off",
+				getLocalBounds(), Justification::centred);
+			return;
+		}
+
+		String info = "Frame " + String((juce::int64) summary.frameIndex) + "   mean " + String(summary.mean, 1)
+			+ "   saturated " + String(100. * summary.saturated, 2) + "%   dark " + String(100. * summary.dark, 2) + "%";
+		String gains = "Shutter " + String(summary.shutter) + " us   gain " + String(summary.analogGain, 2)
+			+ " x " + String(summary.digitalGain, 2) + (summary.target > 0 ? "   target " + String(summary.target, 0) : String());
+		g.drawText(info, 10, 5, getWidth() - 20, 18, Justification::left);
+		g.drawText(gains, 10, 23, getWidth() - 20, 18, Justification::left);
+
+		Rectangle<float> area(10.0f, 45.0f, getWidth() - 20.0f, getHeight() - 55.0f);
+		int maxCount = 1;
+		for (size_t i = 0; i < summary.histogram.size(); i++)
+		{
+			maxCount = jmax(maxCount, summary.histogram[i]);
+		}
+
+		// bins are 8 luma levels wide; the last one holds the saturated pixels
+		float w = area.getWidth() / summary.histogram.size();
+		for (size_t i = 0; i < summary.histogram.size(); i++)
+		{
+			float h = area.getHeight() * summary.histogram[i] / maxCount;
+			g.setColour(i + 1 == summary.histogram.size() ? Colours::red : Colours::lightgrey);
+			g.fillRect(area.getX() + i * w, area.getBottom() - h, jmax(1.0f, w - 1), h);
+		}
+
+		if (summary.target > 0)
+		{
+			g.setColour(Colours::orange);
+			float x = area.getX() + area.getWidth() * (float) summary.target / 256.0f;
+			g.drawLine(x, area.getY(), x, area.getBottom());
+		}
+	}
+
+private:
+	void timerCallback() override
+	{
+		juce::int64 n = processor->getExposure(summary);
+		if (n != count)
+		{
+			count = n;
+			repaint();
+		}
+	}
+
+	RPiCam* processor;
+	ExposureSummary summary;
+	juce::int64 count;
+};
+
+
+void RPiCamEditor::showExposure()
+{
+	if (exposureWindow == nullptr)
+	{
+		// not modal: the histogram is watched while changing settings;
+		// closing only hides the window
+		DialogWindow::LaunchOptions options;
+		options.content.setOwned(new ExposureView((RPiCam *)getProcessor()));
+		options.dialogTitle = "RPiCam exposure";
+		options.dialogBackgroundColour = Colours::black;
+		options.escapeKeyTriggersCloseButton = true;
+		options.useNativeTitleBar = true;
+		options.resizable = true;
+		exposureWindow = options.create();
+	}
+
+	exposureWindow->setVisible(true);
+	exposureWindow->toFront(true);
+}
+
+
+void RPiCamEditor::camerasFound(const Array<DiscoveredCamera>& cameras)
+{
+	RPiCam *p= (RPiCam *)getProcessor();
+
+	findButton->setEnabled(true);
+
+	PopupMenu menu;
+	for (int i = 0; i < cameras.size(); i++)
+	{
+		const DiscoveredCamera& c = cameras.getReference(i);
+		String text = c.cameraId + " (" + c.sensor + ")  " + c.address + ":" + String(c.port) + "  ";
+		text += c.roundTrip >= 0 ? String(c.roundTrip, 1) + " ms" : String("not reachable");
+		menu.addItem(i + 1, text, true, c.address == p->getAddress() && c.port == p->getPort());
+	}
+	if (cameras.size() == 0)
+	{
+		menu.addItem(-1, "No cameras found", false);
+	}
+
+	int result = menu.showAt(findButton);
+	if (result > 0)
+	{
+		const DiscoveredCamera& c = cameras.getReference(result - 1);
+		p->setAddress(c.address, false, false);
+		p->setPort(c.port, false, false);
+
+		p->closeSocket();
+		p->openSocket();
+		p->sendCameraParameters();
+
+		updateValues();
+	}
+}
+
+
+void RPiCamEditor::snapshotTaken(bool success, const Image& image, const File& file)
+{
+	snapshotButton->setEnabled(true);
+
+	if (!success)
+	{
+		CoreServices::sendStatusMessage("RPiCam: snapshot failed");
+		return;
+	}
+
+	CoreServices::sendStatusMessage("RPiCam: saved snapshot " + file.getFileName());
+
+	if (!image.isValid())
+	{
+		return;
+	}
+
+	// scale down large images to fit on the screen
+	float scale = jmin(1.0f, 640.0f / image.getWidth());
+
+	ImageComponent* view = new ImageComponent();
+	view->setImage(image);
+	view->setSize(roundToInt(scale * image.getWidth()), roundToInt(scale * image.getHeight()));
+
+	DialogWindow::LaunchOptions options;
+	options.content.setOwned(view);
+	options.dialogTitle = file.getFileName();
+	options.dialogBackgroundColour = Colours::black;
+	options.escapeKeyTriggersCloseButton = true;
+	options.useNativeTitleBar = true;
+	options.resizable = true;
+	options.launchAsync();
 }
 
+
 void RPiCamEditor::buttonEvent(Button* button)
 {
 	RPiCam *p= (RPiCam *)getProcessor();
@@ -231,6 +732,69 @@ void RPiCamEditor::buttonEvent(Button* button)
 		p->openSocket();
 		p->sendCameraParameters();
 	}
+	else if (button == findButton)
+	{
+		// (see camerasFound)
+		if (p->discoverCameras())
+		{
+			findButton->setEnabled(false);
+			CoreServices::sendStatusMessage("RPiCam: searching for cameras ...");
+		}
+	}
+	else if (button == roiButton)
+	{
+		std::vector<RoiSettings> rois = p->getRois();
+
+		PopupMenu removeMenu;
+		PopupMenu menu;
+		for (size_t i = 0; i < rois.size(); i++)
+		{
+			const RoiSettings& r = rois[i];
+			String text = String(r.name) + "  (" + String(r.x, 2) + ", " + String(r.y, 2) + ", " + String(r.width, 2) + ", "
+				+ String(r.height, 2) + ") -> " + String(r.outputWidth) + "x" + String(r.outputHeight);
+			menu.addItem((int) i + 1, text);
+			removeMenu.addItem(1000 + (int) i, String(r.name));
+		}
+		if (!rois.empty())
+		{
+			menu.addSeparator();
+		}
+		menu.addItem(999, "Add region ...");
+		menu.addSubMenu("Remove", removeMenu, !rois.empty());
+
+		int result = menu.showAt(button);
+		bool changed = false;
+
+		if (result >= 1000)
+		{
+			rois.erase(rois.begin() + (result - 1000));
+			changed = true;
+		}
+		else if (result == 999)
+		{
+			RoiSettings r;
+			r.name = "roi" + std::to_string(rois.size() + 1);
+			r.x = r.y = 0.25;
+			r.width = r.height = 0.5;
+			r.outputWidth = 160;
+			r.outputHeight = 120;
+			if (editRoi(r))
+			{
+				rois.push_back(r);
+				changed = true;
+			}
+		}
+		else if (result > 0)
+		{
+			changed = editRoi(rois[result - 1]);
+		}
+
+		if (changed)
+		{
+			p->setRois(rois);
+			updateValues();
+		}
+	}
 	else if (button == resetButton)
 	{
 		p->resetGains();
@@ -243,6 +807,135 @@ void RPiCamEditor::buttonEvent(Button* button)
 	{
 		p->setVflip(button->getToggleState());
 	}
+	else if (button == exposureButton)
+	{
+		const int intervals[] = {1, 2, 5, 10, 30};
+		PopupMenu intervalMenu;
+		intervalMenu.addItem(100, "Off", true, p->getExposureInterval() == 0);
+		for (int i = 0; i < 5; i++)
+		{
+			intervalMenu.addItem(101 + i, i == 0 ? String("Every frame") : "Every " + String(intervals[i]) + " frames",
+				true, p->getExposureInterval() == intervals[i]);
+		}
+
+		// regions are cropped from the recorded (zoomed) image
+		std::vector<RoiSettings> rois = p->getRois();
+		PopupMenu regionMenu;
+		regionMenu.addItem(200, "Whole image", true, p->getExposureRegion().isEmpty());
+		for (size_t i = 0; i < rois.size(); i++)
+		{
+			regionMenu.addItem(201 + (int) i, String(rois[i].name), true, p->getExposureRegion() == String(rois[i].name));
+		}
+
+		PopupMenu menu;
+		menu.addItem(1, "Show histogram");
+		menu.addSubMenu("Monitor", intervalMenu);
+		menu.addSubMenu("Meter", regionMenu);
+		menu.addSeparator();
+		menu.addItem(2, "Hold exposure ...", p->getExposureInterval() > 0, p->getExposureTarget() > 0);
+		menu.addItem(3, "Release exposure", p->getExposureTarget() > 0);
+
+		int result = menu.showAt(button);
+		if (result == 1)
+		{
+			if (p->getExposureInterval() == 0)
+			{
+				p->setExposureMonitor(intervals[2], p->getExposureRegion());
+			}
+			showExposure();
+		}
+		else if (result == 2)
+		{
+			editExposureControl();
+		}
+		else if (result == 3)
+		{
+			p->setExposureControl(0, p->getExposureMaxSaturation(), p->getExposureMinShutter(), p->getExposureMaxShutter());
+		}
+		else if (result >= 100 && result <= 105)
+		{
+			p->setExposureMonitor(result == 100 ? 0 : intervals[result - 101], p->getExposureRegion());
+		}
+		else if (result >= 200)
+		{
+			p->setExposureMonitor(p->getExposureInterval(), result == 200 ? String() : String(rois[result - 201].name));
+		}
+
+		updateValues();
+	}
+	else if (button == lockButton)
+	{
+		p->setPhaseLock(button->getToggleState());
+	}
+	else if (button == copyButton)
+	{
+		p->setCopyData(button->getToggleState());
+	}
+	else if (button == replayButton)
+	{
+		PopupMenu menu;
+		menu.addItem(1, "Replay in real time ...");
+		menu.addItem(2, "Replay as fast as possible ...");
+		menu.addItem(3, "Stop replay", p->isReplaying());
+
+		int result = menu.showAt(button);
+		if (result == 3)
+		{
+			p->setReplay(String());
+		}
+		else if (result > 0)
+		{
+			FileChooser chooser("Select a video file recorded by the RPi", File(p->getReplayFile()), "*.h264");
+			if (chooser.browseForFileToOpen())
+			{
+				if (!p->setReplay(chooser.getResult().getFullPathName(), result == 1 ? 1.0 : 0.0))
+				{
+					CoreServices::sendStatusMessage("RPiCam: no timestamps found for " + chooser.getResult().getFileName());
+				}
+			}
+		}
+
+		updateValues();
+	}
+	else if (button == snapshotButton)
+	{
+		// (see snapshotTaken)
+		if (p->takeSnapshot())
+		{
+			snapshotButton->setEnabled(false);
+		}
+		else
+		{
+			CoreServices::sendStatusMessage("RPiCam: snapshot failed");
+		}
+	}
+	else if (button == keyframeButton)
+	{
+		p->requestKeyframe();
+	}
+	else if (button == traceButton)
+	{
+		PopupMenu menu;
+		menu.addItem(1, "Save trace ...");
+		menu.addItem(2, "Save after each recording", true, p->getTraceAfterRecording());
+
+		int result = menu.showAt(button);
+		if (result == 1)
+		{
+			File dir = CoreServices::RecordNode::getRecordingPath();
+			FileChooser chooser("Save the trace", dir.getChildFile("RPiCam" + String(p->getNodeId()) + "_trace.json"), "*.json");
+			if (chooser.browseForFileToSave(true) && !p->exportTrace(chooser.getResult()))
+			{
+				CoreServices::sendStatusMessage("RPiCam: could not write " + chooser.getResult().getFileName());
+			}
+		}
+		else if (result == 2)
+		{
+			p->setTraceAfterRecording(!p->getTraceAfterRecording());
+		}
+
+		updateValues();
+	}
 	else
 	{
 		// this is not particularly efficient ...
@@ -359,4 +1052,39 @@ void RPiCamEditor::comboBoxChanged(ComboBox* cb)
 		int fps = cb->getItemText(index).getIntValue();
 		p->setFramerate(fps);
 	}
+	else if (cb == strobeCombo)
+	{
+		// first item ("-") disables strobe decoding
+		int id = cb->getSelectedId() - 2;
+		const Array<RPiCam::StrobeSource>& sources = p->getStrobeSources();
+		if (id >= 0 && id / RPiCam::MAX_STROBE_LINES < sources.size())
+		{
+			RPiCam::StrobeSource s = sources[id / RPiCam::MAX_STROBE_LINES];
+			p->setStrobeSource(s.nodeId, s.subProcessor);
+		}
+		p->setStrobeChannel(id >= 0 ? id % RPiCam::MAX_STROBE_LINES : -1);
+	}
+	else if (cb == intraCombo)
+	{
+		p->setIntraPeriod(cb->getSelectedId() - 1);
+	}
+	else if (cb == streamCombo || cb == bitrateCombo)
+	{
+		const int bitrates[] = {250, 500, 1000, 2000};
+		int kbps = p->getStreamBitrate();
+		if (bitrateCombo->getSelectedId() > 0)
+		{
+			kbps = bitrates[bitrateCombo->getSelectedId()-1];
+		}
+
+		int w = 0;
+		int h = 0;
+		if (streamCombo->getSelectedId() > 1)
+		{
+			StringArray size = StringArray::fromTokens(streamCombo->getText(), "x", "");
+			w = size[0].getIntValue();
+			h = size[1].getIntValue();
+		}
+		p->setStream(w, h, kbps);
+	}
 }
@@ -26,6 +26,8 @@
 #define __RPICAMEDITOR_H__
 
 #include <EditorHeaders.h>
+#include "CameraDiscovery.h"
+#include "RPiCamProtocol.h"
 
 class RPiCam;
 
@@ -62,7 +64,7 @@ public:
 };
 
 
-class RPiCamEditor : public GenericEditor, public Label::Listener, public ComboBox::Listener
+class RPiCamEditor : public GenericEditor, public Label::Listener, public ComboBox::Listener, public Timer
 {
 public:
     RPiCamEditor(GenericProcessor* parentNode, bool useDefaultParameterEditors);
@@ -72,10 +74,18 @@ public:
 	void labelTextChanged(juce::Label *);
 	void setLabelColor(juce::Colour color);
 	void comboBoxChanged(ComboBox* cb);
+	void timerCallback();
 
 	void updateValues();
+	void updateSettings() override;
+	void updateStrobeCombo();
 
 	void enableControls(bool state);
+	void snapshotTaken(bool success, const Image& image, const File& file);
+	void camerasFound(const Array<DiscoveredCamera>& cameras);
+	bool editRoi(RoiSettings& r);
+	bool editExposureControl();
+	void showExposure();
 
 private:
 
@@ -99,6 +109,33 @@ private:
 	ScopedPointer<UtilityButton> vflipButton;
 	ScopedPointer<UtilityButton> hflipButton;
 
+	ScopedPointer<Label> strobeLabel;
+	ScopedPointer<ComboBox> strobeCombo;
+
+	ScopedPointer<UtilityButton> copyButton;
+	ScopedPointer<Label> transferLabel;
+
+	ScopedPointer<Label> streamLabel;
+	ScopedPointer<ComboBox> streamCombo;
+	ScopedPointer<ComboBox> bitrateCombo;
+
+	ScopedPointer<Label> keyframeLabel;
+	ScopedPointer<ComboBox> intraCombo;
+	ScopedPointer<UtilityButton> keyframeButton;
+
+	ScopedPointer<UtilityButton> snapshotButton;
+	ScopedPointer<UtilityButton> traceButton;
+	ScopedPointer<UtilityButton> replayButton;
+	ScopedPointer<UtilityButton> findButton;
+
+	ScopedPointer<Label> roiLabel;
+	ScopedPointer<UtilityButton> roiButton;
+
+	ScopedPointer<UtilityButton> exposureButton;
+	Component::SafePointer<DialogWindow> exposureWindow;
+
+	ScopedPointer<UtilityButton> lockButton;
+
 	ScopedPointer<Label> zoomLabel;
 	OwnedArray<Label> zoomValues;
 	OwnedArray<TriangleButton> upButtons;
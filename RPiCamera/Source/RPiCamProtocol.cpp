@@ -0,0 +1,492 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include "RPiCamProtocol.h"
+
+
+namespace RPiCamProtocol
+{
+
+std::string tcpUrl(const std::string& address, int port)
+{
+	std::ostringstream ss;
+	ss << "tcp://" << address << ":" << port;
+	return ss.str();
+}
+
+
+bool isEndpoint(const std::string& address)
+{
+	return address.compare(0, 6, "tcp://") == 0
+		|| address.compare(0, 6, "ipc://") == 0
+		|| address.compare(0, 9, "inproc://") == 0;
+}
+
+
+std::string commandUrl(const std::string& address, int port)
+{
+	return isEndpoint(address) ? address : tcpUrl(address, port);
+}
+
+
+std::string frameUrl(const std::string& address, int port)
+{
+	if (!isEndpoint(address))
+	{
+		return tcpUrl(address, port + FRAME_PORT_OFFSET);
+	}
+
+	if (address.compare(0, 6, "tcp://") == 0)
+	{
+		// tcp://<host>:<port> -> next port
+		size_t colon = address.rfind(':');
+		if (colon > 5 && colon + 1 < address.size())
+		{
+			int p = atoi(address.c_str() + colon + 1);
+			return tcpUrl(address.substr(6, colon - 6), p + FRAME_PORT_OFFSET);
+		}
+		return address;
+	}
+
+	return address + ".frames";
+}
+
+
+std::string tagConfig(const std::string& command, int64_t version)
+{
+	std::ostringstream ss;
+	ss << command << " Cfg=" << (long long) version;
+	return ss.str();
+}
+
+
+std::string start(int experiment, int recording, const std::string& path)
+{
+	std::ostringstream ss;
+	ss << "Start Experiment=" << experiment << " Recording=" << recording << " Path=" << path;
+	return ss.str();
+}
+
+
+std::string stop()
+{
+	return "Stop";
+}
+
+
+std::string close()
+{
+	return "Close";
+}
+
+
+std::string resolution(int width, int height)
+{
+	std::ostringstream ss;
+	ss << "Resolution " << width << " " << height;
+	return ss.str();
+}
+
+
+std::string framerate(int fps)
+{
+	std::ostringstream ss;
+	ss << "Framerate " << fps;
+	return ss.str();
+}
+
+
+std::string framerateDelta(double delta)
+{
+	std::ostringstream ss;
+	ss.setf(std::ios::fixed);
+	ss.precision(6);
+	ss << "FramerateDelta " << delta;
+	return ss.str();
+}
+
+
+std::string vflip(bool status)
+{
+	return status ? "VFlip 1" : "VFlip 0";
+}
+
+
+std::string hflip(bool status)
+{
+	return status ? "HFlip 1" : "HFlip 0";
+}
+
+
+std::string zoom(const int z[4])
+{
+	// percent -> fraction of the image
+	std::ostringstream ss;
+	ss.setf(std::ios::fixed);
+	ss.precision(2);
+	ss << "Zoom";
+	for (int i = 0; i < 4; i++)
+	{
+		ss << " " << z[i] / 100.;
+	}
+	return ss.str();
+}
+
+
+std::string resetGains()
+{
+	return "ResetGains";
+}
+
+
+std::string stream(int width, int height, int bitrate)
+{
+	std::ostringstream ss;
+	ss << "Stream " << width << " " << height << " " << bitrate;
+	return ss.str();
+}
+
+
+std::string intraPeriod(int frames)
+{
+	std::ostringstream ss;
+	ss << "IntraPeriod " << (frames > 0 ? frames : 0);
+	return ss.str();
+}
+
+
+std::string requestKeyframe(const std::string& target)
+{
+	return target.empty() ? std::string("RequestKeyframe") : "RequestKeyframe " + target;
+}
+
+
+std::string rois(const std::vector<RoiSettings>& rois)
+{
+	std::ostringstream ss;
+	ss.setf(std::ios::fixed);
+	ss.precision(4);
+	ss << "Rois";
+	for (size_t i = 0; i < rois.size(); i++)
+	{
+		const RoiSettings& r = rois[i];
+		ss << " " << r.name << ":" << r.x << "," << r.y << "," << r.width << "," << r.height << ","
+		   << r.outputWidth << "," << r.outputHeight;
+	}
+	return ss.str();
+}
+
+
+std::string exposure(int interval, const RoiSettings* region)
+{
+	std::ostringstream ss;
+	ss.setf(std::ios::fixed);
+	ss.precision(4);
+	ss << "Exposure " << (interval > 0 ? interval : 0);
+	if (interval > 0 && region != nullptr)
+	{
+		ss << " " << region->x << " " << region->y << " " << region->width << " " << region->height;
+	}
+	return ss.str();
+}
+
+
+std::string exposureControl(double target, double maxSaturation, int minShutter, int maxShutter)
+{
+	std::ostringstream ss;
+	ss.setf(std::ios::fixed);
+	ss.precision(4);
+	ss << "ExposureControl " << target << " " << maxSaturation << " " << minShutter << " " << maxShutter;
+	return ss.str();
+}
+
+
+std::string snapshot()
+{
+	return "Snapshot";
+}
+
+
+std::string lease(int seconds, const std::string& name)
+{
+	std::ostringstream ss;
+	ss << "Lease " << (seconds > 0 ? seconds : 1);
+	if (!name.empty())
+	{
+		ss << " " << name;
+	}
+	return ss.str();
+}
+
+
+std::string release()
+{
+	return "Release";
+}
+
+
+std::string status()
+{
+	return "Status";
+}
+
+
+std::string discover()
+{
+	return "Discover";
+}
+
+
+std::string trace()
+{
+	return "Trace";
+}
+
+
+static bool parseInt(const char*& p, const char* end, int64_t& value)
+{
+	// (called for every published frame -> no locale, no allocation)
+	while (p < end && *p == ' ')
+	{
+		p++;
+	}
+
+	bool negative = false;
+	if (p < end && *p == '-')
+	{
+		negative = true;
+		p++;
+	}
+
+	if (p == end || *p < '0' || *p > '9')
+	{
+		return false;
+	}
+
+	int64_t v = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		v = 10 * v + (*p - '0');
+		p++;
+	}
+
+	value = negative ? -v : v;
+	return true;
+}
+
+
+bool parseFrame(const char* msg, size_t size, StreamedFrame& frame)
+{
+	const char* p = msg;
+	const char* end = msg + size;
+
+	if (size < 6 || memcmp(p, "Frame ", 6) != 0)
+	{
+		return false;
+	}
+	p += 6;
+	frame.received = 0;
+
+	return parseInt(p, end, frame.frameIndex)
+		&& parseInt(p, end, frame.pts)
+		&& parseInt(p, end, frame.ets);
+}
+
+
+bool parseExposure(const char* msg, size_t size, ExposureSummary& summary)
+{
+	if (size < 9 || memcmp(msg, "Exposure ", 9) != 0)
+	{
+		return false;
+	}
+
+	// a few messages per second -> no need to avoid the stream
+	std::istringstream ss(std::string(msg + 9, size - 9));
+	long long frame = 0;
+
+	if (!(ss >> frame >> summary.mean >> summary.saturated >> summary.dark >> summary.shutter
+		  >> summary.analogGain >> summary.digitalGain >> summary.target))
+	{
+		return false;
+	}
+	summary.frameIndex = frame;
+
+	summary.histogram.resize(EXPOSURE_BINS);
+	for (int i = 0; i < EXPOSURE_BINS; i++)
+	{
+		if (!(ss >> summary.histogram[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool parseWriteBuffer(const char* msg, size_t size, WriteBufferStatus& status)
+{
+	const char* p = msg;
+	const char* end = msg + size;
+
+	if (size < 7 || memcmp(p, "Buffer ", 7) != 0)
+	{
+		return false;
+	}
+	p += 7;
+
+	if (!(parseInt(p, end, status.fill)
+		&& parseInt(p, end, status.highWater)
+		&& parseInt(p, end, status.size)
+		&& parseInt(p, end, status.stalls)))
+	{
+		return false;
+	}
+
+	std::istringstream ss(std::string(p, end - p));
+	if (!(ss >> status.maxWriteTime))
+	{
+		status.maxWriteTime = 0;
+	}
+
+	return true;
+}
+
+
+bool parseLeased(const std::string& reply, std::string& holder, double& remaining)
+{
+	std::istringstream ss(reply);
+	std::string name;
+
+	if (!(ss >> name) || name != "Leased")
+	{
+		return false;
+	}
+
+	if (!(ss >> holder))
+	{
+		holder.clear();
+	}
+	if (!(ss >> remaining))
+	{
+		remaining = 0;
+	}
+
+	return true;
+}
+
+
+bool parseSnapshot(const std::string& reply, int64_t& cameraTime, double& unixTime)
+{
+	std::istringstream ss(reply);
+	std::string name;
+	long long t = 0;
+
+	if (!(ss >> name >> t) || name != "Snapshot")
+	{
+		return false;
+	}
+	cameraTime = t;
+
+	if (!(ss >> unixTime))
+	{
+		unixTime = 0;
+	}
+
+	return true;
+}
+
+
+bool parseTrace(const std::string& reply, int64_t& hostTime, std::vector<TraceEvent>& events)
+{
+	std::istringstream ss(reply);
+	std::string line;
+	std::string name;
+	long long t = 0;
+
+	events.clear();
+
+	if (!std::getline(ss, line))
+	{
+		return false;
+	}
+	std::istringstream header(line);
+	if (!(header >> name >> t) || name != "Trace")
+	{
+		return false;
+	}
+	hostTime = t;
+
+	while (std::getline(ss, line))
+	{
+		std::istringstream fields(line);
+		long long start, duration, value;
+		std::string category;
+		if (!(fields >> start >> duration >> value >> category))
+		{
+			continue;
+		}
+
+		// the rest of the line (names may contain spaces)
+		std::getline(fields >> std::ws, name);
+
+		TraceEvent event;
+		event.start = start;
+		event.duration = duration;
+		event.value = value;
+		snprintf(event.category, sizeof(event.category), "%s", category.c_str());
+		snprintf(event.name, sizeof(event.name), "%s", name.c_str());
+		events.push_back(event);
+	}
+
+	return true;
+}
+
+
+bool parseAnnouncement(const std::string& msg, CameraAnnouncement& announcement)
+{
+	std::istringstream ss(msg);
+	std::string name;
+
+	if (!(ss >> name >> announcement.port) || name != "Announce" || announcement.port <= 0)
+	{
+		return false;
+	}
+
+	if (!(ss >> announcement.cameraId))
+	{
+		announcement.cameraId.clear();
+	}
+	if (!(ss >> announcement.sensor))
+	{
+		announcement.sensor.clear();
+	}
+
+	return true;
+}
+
+}
@@ -0,0 +1,255 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __RPICAMPROTOCOL_H__
+#define __RPICAMPROTOCOL_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Trace.h"
+
+
+/**
+
+  Frame information published by the RPi for every recorded frame
+
+*/
+
+struct StreamedFrame
+{
+	int64_t frameIndex;
+	int64_t pts;	// encoder timestamp (usec)
+	int64_t ets;	// camera clock when the frame was written (usec)
+	int64_t received;	// local wall clock when the message arrived (usec since the epoch)
+};
+
+
+/**
+
+  Region of interest recorded by the RPi as a separate file
+
+  The rectangle is given in normalized coordinates relative to the recorded
+  image (origin: top left) and resampled to the output size.
+
+*/
+
+struct RoiSettings
+{
+	std::string name;
+	double x;
+	double y;
+	double width;
+	double height;
+	int outputWidth;
+	int outputHeight;
+};
+
+
+/**
+
+  Exposure statistics published by the RPi for every n-th frame
+
+  Computed from the luma plane of the recorded image or of a region of it
+  (see Python/rpicamera/exposure.py).
+
+*/
+
+struct ExposureSummary
+{
+	int64_t frameIndex;
+	double mean;			// mean luma (0-255)
+	double saturated;		// fraction of saturated pixels
+	double dark;			// fraction of black pixels
+	int shutter;			// exposure time (usec)
+	double analogGain;
+	double digitalGain;
+	double target;			// target mean of the exposure control (0: off)
+	std::vector<int> histogram;
+};
+
+
+/**
+
+  Write-behind buffer of the video file on the RPi
+
+  Published once per second while recording and when the file is closed.
+  A stall means that the encoder had to wait for the SD card.
+
+*/
+
+struct WriteBufferStatus
+{
+	int64_t fill;			// bytes
+	int64_t highWater;		// bytes
+	int64_t size;			// bytes
+	int64_t stalls;
+	double maxWriteTime;	// longest single write (s)
+};
+
+
+/**
+
+  Announcement of an rpicamera host on the local network
+
+*/
+
+struct CameraAnnouncement
+{
+	int port;				// command port
+	std::string cameraId;	// host name of the RPi
+	std::string sensor;		// e.g. ov5647, imx219
+};
+
+
+/**
+
+  Messages exchanged with the rpicamera host (see Python/rpicamera/controller.py)
+
+  Commands are sent to the host's command port (default: 5555) and answered
+  with a single text frame, except for "Snapshot" which is followed by the
+  image data. Frame information ("Frame <index> <pts> <ets>"), exposure
+  summaries ("Exposure <frame> <mean> ...") and write buffer statistics
+  ("Buffer <fill> ...") are published on the following port, together
+  with "Status <json>" and "Telemetry <json>" once per second. "Trace"
+  returns the host's timeline of commands, reconfigurations and recording
+  steps (see Python/rpicamera/trace.py).
+
+  Commands of the plugin end with the version of its camera settings
+  ("Cfg=<version>"), which the host records with each recording.
+
+  Only one client controls the camera: camera commands take or renew an
+  exclusive lease, which expires unless renewed ("Lease"). Other clients
+  get "Leased <holder> <remaining seconds>" instead, but can still query
+  the host and follow the published messages.
+
+  Instead of an address, a zmq endpoint can be given: tcp://<host>:<port>,
+  ipc://<path> (host on the same machine) or inproc://<name> (host in the
+  same process and zmq context, e.g. test rigs and benchmarks). Frames are
+  then published on ipc://<path>.frames or inproc://<name>.frames.
+
+  Hosts can be found via UDP: a "Discover" datagram sent to the discovery
+  port is answered by each host with "Announce <port> <camera id> <sensor>",
+  which is also broadcast periodically (see Python/rpicamera/discovery.py).
+
+*/
+
+namespace RPiCamProtocol
+{
+	const int DEFAULT_PORT = 5555;
+
+	/** Command port + offset */
+	const int FRAME_PORT_OFFSET = 1;
+	const int STREAM_PORT_OFFSET = 2;
+
+	/** UDP port of the hosts' discovery service */
+	const int DISCOVERY_PORT = 5554;
+
+	/** Luma histogram bins of the exposure summary */
+	const int EXPOSURE_BINS = 32;
+
+	std::string tcpUrl(const std::string& address, int port);
+
+	/** True for "tcp://...", "ipc://..." and "inproc://..." */
+	bool isEndpoint(const std::string& address);
+
+	/** Command endpoint for an address (host name, ip address or endpoint). */
+	std::string commandUrl(const std::string& address, int port);
+
+	/** Endpoint on which the host publishes frame information. */
+	std::string frameUrl(const std::string& address, int port);
+
+	/** "<command> Cfg=<version>": version of the plugin's camera settings
+	    (see CameraConfigStore), stripped by the host before parsing */
+	std::string tagConfig(const std::string& command, int64_t version);
+
+	std::string start(int experiment, int recording, const std::string& path);
+	std::string stop();
+	std::string close();
+	std::string resolution(int width, int height);
+	std::string framerate(int fps);
+
+	/** Fine adjustment of the frame rate (Hz), can be changed while recording. */
+	std::string framerateDelta(double delta);
+	std::string vflip(bool status);
+	std::string hflip(bool status);
+	std::string zoom(const int z[4]);
+	std::string resetGains();
+	std::string stream(int width, int height, int bitrate);
+
+	/** "IntraPeriod <frames>": key frame interval of the recording and the stream (0: default) */
+	std::string intraPeriod(int frames);
+
+	/** "RequestKeyframe [Stream|Recording]": IDR frame with the next frame (empty: both) */
+	std::string requestKeyframe(const std::string& target = std::string());
+
+	/** "Rois <name>:<x>,<y>,<w>,<h>,<width>,<height> ..." (none: off) */
+	std::string rois(const std::vector<RoiSettings>& rois);
+
+	/** "Exposure <interval> [<x> <y> <w> <h>]": summary of every n-th frame (0: off) */
+	std::string exposure(int interval, const RoiSettings* region = nullptr);
+
+	/** "ExposureControl <target> <max saturation> <min shutter> <max shutter>" (target 0: off) */
+	std::string exposureControl(double target, double maxSaturation, int minShutter, int maxShutter);
+	std::string snapshot();
+
+	/** "Lease <seconds> <name>": take or renew the exclusive control of the camera */
+	std::string lease(int seconds, const std::string& name);
+
+	/** "Release": give up the control */
+	std::string release();
+	std::string status();
+	std::string discover();
+
+	/** "Trace": the host's trace events (see parseTrace) */
+	std::string trace();
+
+	/** "Frame <index> <pts> <ets>" (not null-terminated) */
+	bool parseFrame(const char* msg, size_t size, StreamedFrame& frame);
+
+	/** "Exposure <frame> <mean> <saturated> <dark> <shutter> <analog gain>
+	     <digital gain> <target> <bin 0> ... <bin 31>" (not null-terminated) */
+	bool parseExposure(const char* msg, size_t size, ExposureSummary& summary);
+
+	/** "Buffer <fill> <high water> <size> <stalls> <max write time>" (not null-terminated) */
+	bool parseWriteBuffer(const char* msg, size_t size, WriteBufferStatus& status);
+
+	/** "Leased <holder> <remaining seconds>": the command was refused as
+	    another client controls the camera */
+	bool parseLeased(const std::string& reply, std::string& holder, double& remaining);
+
+	/** "Snapshot <camera timestamp> <unix time>" */
+	bool parseSnapshot(const std::string& reply, int64_t& cameraTime, double& unixTime);
+
+	/** "Trace <host time>" followed by one line per event,
+	    "<start> <duration> <value> <category> <name>" (times in usec) */
+	bool parseTrace(const std::string& reply, int64_t& hostTime, std::vector<TraceEvent>& events);
+
+	/** "Announce <port> <camera id> <sensor>" */
+	bool parseAnnouncement(const std::string& msg, CameraAnnouncement& announcement);
+}
+
+
+#endif  // __RPICAMPROTOCOL_H__
@@ -0,0 +1,217 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "BarcodeDecoder.h"
+#include "ReplaySource.h"
+
+
+ReplaySource::ReplaySource()
+	: framerate(0), width(0), height(0), sampleRate(30000.), speed(1.),
+	  pulseWidth(0.001), barcodeInterval(0), barcodeBits(16), bitShort(0.0002), bitLong(0.0005), bitGap(0.0002),
+	  startSample(0), nextFrame(0)
+{
+}
+
+
+bool ReplaySource::open(const std::string& path)
+{
+	close();
+
+	std::string tsPath = TimestampFile::findForVideo(path);
+	if (tsPath.empty() || !timestamps.read(tsPath) || timestamps.size() == 0)
+	{
+		timestamps = TimestampFile();
+		return false;
+	}
+
+	videoPath = path;
+	framerate = timestamps.framerate;
+	width = timestamps.width;
+	height = timestamps.height;
+
+	// the csv format has no header -> use the parameter file
+	std::string base = tsPath.substr(0, tsPath.rfind("_timestamps."));
+	readParameters(base + "_params.json");
+
+	return true;
+}
+
+
+void ReplaySource::close()
+{
+	timestamps = TimestampFile();
+	videoPath.clear();
+	framerate = 0;
+	width = 0;
+	height = 0;
+	nextFrame = 0;
+}
+
+
+static double jsonNumber(const std::string& text, const std::string& key, double defaultValue)
+{
+	// flat json object written by Controller.start_recording
+	size_t pos = text.find("\"" + key + "\"");
+	if (pos == std::string::npos)
+	{
+		return defaultValue;
+	}
+
+	pos = text.find(':', pos);
+	if (pos == std::string::npos)
+	{
+		return defaultValue;
+	}
+
+	const char* start = text.c_str() + pos + 1;
+	char* end = NULL;
+	double value = strtod(start, &end);
+
+	return end != start ? value : defaultValue;
+}
+
+
+bool ReplaySource::readParameters(const std::string& path)
+{
+	std::ifstream f(path.c_str());
+	if (!f.good())
+	{
+		return false;
+	}
+
+	std::stringstream ss;
+	ss << f.rdbuf();
+	std::string text = ss.str();
+
+	if (framerate <= 0)
+	{
+		framerate = jsonNumber(text, "framerate", 0);
+	}
+	if (width <= 0 || height <= 0)
+	{
+		width = (int) jsonNumber(text, "width", 0);
+		height = (int) jsonNumber(text, "height", 0);
+	}
+
+	return true;
+}
+
+
+void ReplaySource::setStrobe(double pw, int interval, int bits, double shortWidth, double longWidth, double gap)
+{
+	pulseWidth = pw;
+	barcodeInterval = interval;
+	barcodeBits = bits;
+	bitShort = shortWidth;
+	bitLong = longWidth;
+	bitGap = gap;
+}
+
+
+void ReplaySource::start(int64_t sampleNumber)
+{
+	startSample = sampleNumber;
+	nextFrame = 0;
+}
+
+
+int64_t ReplaySource::getFrameSample(size_t index) const
+{
+	// strobe pulses are sent when a frame has been written, i.e. at the
+	// camera time stored with the frame (pts for files without it)
+	const std::vector<int64_t>& t = timestamps.ets[0] > 0 ? timestamps.ets : timestamps.pts;
+	double dt = 1e-6 * (double) (t[index] - t[0]);
+
+	return startSample + (int64_t) std::floor(dt * sampleRate + 0.5);
+}
+
+
+void ReplaySource::addStrobe(size_t index, std::vector<ReplayEdge>& edges) const
+{
+	ReplayEdge edge;
+	double t = (double) getFrameSample(index);
+
+	edge.sampleNumber = (int64_t) t;
+	edge.state = true;
+	edges.push_back(edge);
+
+	t += pulseWidth * sampleRate;
+	edge.sampleNumber = (int64_t) std::floor(t + 0.5);
+	edge.state = false;
+	edges.push_back(edge);
+
+	if (barcodeInterval > 0 && index % barcodeInterval == 0)
+	{
+		// frame index modulo 2^bits, MSB first, followed by the parity bit
+		int64_t value = (int64_t) index & ((1LL << barcodeBits) - 1);
+		value = (value << 1) | BarcodeDecoder::parityBit(value);
+
+		for (int i = barcodeBits; i >= 0; i--)
+		{
+			t += bitGap * sampleRate;
+			edge.sampleNumber = (int64_t) std::floor(t + 0.5);
+			edge.state = true;
+			edges.push_back(edge);
+
+			t += ((value >> i) & 1 ? bitLong : bitShort) * sampleRate;
+			edge.sampleNumber = (int64_t) std::floor(t + 0.5);
+			edge.state = false;
+			edges.push_back(edge);
+		}
+	}
+}
+
+
+int ReplaySource::advance(int64_t clock, int maxFrames, std::vector<ReplayFrame>& frames, std::vector<ReplayEdge>& edges)
+{
+	// position of the replay in the recording's time line
+	double position = (double) startSample + speed * (double) (clock - startSample);
+
+	int count = 0;
+	while (nextFrame < timestamps.size() && count < maxFrames)
+	{
+		ReplayFrame frame;
+		frame.sampleNumber = getFrameSample(nextFrame);
+
+		if (speed > 0 && (double) frame.sampleNumber >= position)
+		{
+			break;
+		}
+
+		frame.frameIndex = (int64_t) nextFrame;
+		frame.pts = timestamps.pts[nextFrame];
+		frame.ets = timestamps.ets[nextFrame];
+		frames.push_back(frame);
+
+		addStrobe(nextFrame, edges);
+
+		nextFrame++;
+		count++;
+	}
+
+	return count;
+}
@@ -0,0 +1,144 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __REPLAYSOURCE_H__
+#define __REPLAYSOURCE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TimestampFile.h"
+
+
+/**
+
+  A frame of a replayed recording (as published by the RPi)
+
+*/
+
+struct ReplayFrame
+{
+	int64_t frameIndex;
+	int64_t pts;			// encoder timestamp (usec)
+	int64_t ets;			// camera clock when the frame was written (usec)
+	int64_t sampleNumber;	// rising edge of the frame's strobe pulse
+};
+
+
+/**
+
+  An edge of the replayed strobe signal
+
+*/
+
+struct ReplayEdge
+{
+	int64_t sampleNumber;
+	bool state;
+};
+
+
+/**
+
+  Plays back a session recorded by the rpicamera host
+
+  Reads the timestamps (*_timestamps.bin or *_timestamps.csv) and the
+  parameters (*_params.json) belonging to a video file and regenerates what
+  the RPi sends during a recording: the frame information and the strobe
+  signal including barcodes (see StrobeGenerator in camera.py). The video
+  itself is not decoded.
+
+  Each frame's strobe pulse is placed at the sample corresponding to the
+  camera time at which the frame was written, relative to the sample number
+  given to start(). Sample numbers therefore only depend on the recorded
+  timestamps, not on how fast the session is replayed: advance() releases
+  everything up to the caller's clock scaled by the replay speed (or as
+  much as requested for speed 0).
+
+*/
+
+class ReplaySource
+{
+public:
+	ReplaySource();
+
+	/** Returns false if no timestamps were found for the video file. */
+	bool open(const std::string& videoPath);
+	void close();
+	bool isOpen() const { return timestamps.size() > 0; }
+
+	void setSampleRate(double fs) { sampleRate = fs; }
+
+	/** 1: real time, 2: twice as fast, ..., 0: as fast as possible */
+	void setSpeed(double s) { speed = s >= 0 ? s : 0; }
+	double getSpeed() const { return speed; }
+
+	/** Strobe settings of the host (widths and gap in seconds). */
+	void setStrobe(double pulseWidth, int barcodeInterval, int barcodeBits, double bitShort, double bitLong, double bitGap);
+
+	/** Rewind; the first frame pulse starts at the given sample number. */
+	void start(int64_t sampleNumber);
+
+	/** Frames and strobe edges up to the given clock (in samples); at most
+		maxFrames frames are released per call. Returns the number of frames. */
+	int advance(int64_t clock, int maxFrames, std::vector<ReplayFrame>& frames, std::vector<ReplayEdge>& edges);
+
+	bool isFinished() const { return nextFrame >= timestamps.size(); }
+	int64_t getNumFrames() const { return (int64_t) timestamps.size(); }
+	int64_t getPosition() const { return (int64_t) nextFrame; }
+
+	double getFramerate() const { return framerate; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	const std::string& getVideoPath() const { return videoPath; }
+
+	/** Sample number of the strobe pulse of a frame. */
+	int64_t getFrameSample(size_t index) const;
+
+private:
+	void addStrobe(size_t index, std::vector<ReplayEdge>& edges) const;
+	bool readParameters(const std::string& path);
+
+	TimestampFile timestamps;
+	std::string videoPath;
+	double framerate;
+	int width;
+	int height;
+
+	double sampleRate;
+	double speed;
+
+	double pulseWidth;
+	int barcodeInterval;
+	int barcodeBits;
+	double bitShort;
+	double bitLong;
+	double bitGap;
+
+	int64_t startSample;
+	size_t nextFrame;
+};
+
+
+#endif  // __REPLAYSOURCE_H__
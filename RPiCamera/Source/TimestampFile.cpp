@@ -0,0 +1,188 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2015 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "TimestampFile.h"
+
+
+const char TIMESTAMP_MAGIC[] = "RPICAMTS";
+const int TIMESTAMP_HEADER_SIZE = 128;
+
+
+TimestampFile::TimestampFile()
+	: framerate(0), width(0), height(0)
+{
+}
+
+
+static bool fileExists(const std::string& path)
+{
+	std::ifstream f(path.c_str());
+	return f.good();
+}
+
+
+std::string TimestampFile::findForVideo(const std::string& videoPath)
+{
+	std::string base = videoPath;
+	size_t dot = base.find_last_of('.');
+	size_t sep = base.find_last_of("/\\");
+	if (dot != std::string::npos && (sep == std::string::npos || dot > sep))
+	{
+		base = base.substr(0, dot);
+	}
+
+	const char* suffixes[] = { "_timestamps.bin", "_timestamps.csv" };
+	for (int i = 0; i < 2; i++)
+	{
+		if (fileExists(base + suffixes[i]))
+		{
+			return base + suffixes[i];
+		}
+	}
+
+	return std::string();
+}
+
+
+bool TimestampFile::read(const std::string& path)
+{
+	pts.clear();
+	ets.clear();
+
+	std::ifstream f(path.c_str(), std::ios::binary);
+	char magic[8] = { 0 };
+	f.read(magic, sizeof(magic));
+
+	if (f.gcount() == sizeof(magic) && memcmp(magic, TIMESTAMP_MAGIC, sizeof(magic)) == 0)
+	{
+		return readBinary(path);
+	}
+
+	return readText(path);
+}
+
+
+template <typename T>
+static T readValue(const char* data, size_t& offset)
+{
+	T value;
+	memcpy(&value, data + offset, sizeof(T));
+	offset += sizeof(T);
+	return value;
+}
+
+
+bool TimestampFile::readBinary(const std::string& path)
+{
+	std::ifstream f(path.c_str(), std::ios::binary | std::ios::ate);
+	if (!f)
+	{
+		return false;
+	}
+
+	int64_t fileSize = (int64_t) f.tellg();
+	if (fileSize < TIMESTAMP_HEADER_SIZE)
+	{
+		return false;
+	}
+	f.seekg(0);
+
+	char header[TIMESTAMP_HEADER_SIZE];
+	f.read(header, sizeof(header));
+
+	// layout as in timestamps.py (little endian)
+	size_t offset = 8;
+	uint32_t version = readValue<uint32_t>(header, offset);
+	uint32_t headerSize = readValue<uint32_t>(header, offset);
+	uint32_t recordSize = readValue<uint32_t>(header, offset);
+
+	if (version < 1 || recordSize < 16 || headerSize < 76 || headerSize > fileSize)
+	{
+		return false;
+	}
+
+	cameraId = std::string(header + offset, strnlen(header + offset, 32));
+	offset += 32;
+	clockMode = std::string(header + offset, strnlen(header + offset, 8));
+	offset += 8;
+	framerate = readValue<double>(header, offset);
+	width = (int) readValue<uint32_t>(header, offset);
+	height = (int) readValue<uint32_t>(header, offset);
+
+	// ignore a trailing partial record
+	size_t numRecords = (size_t) ((fileSize - headerSize) / recordSize);
+	std::vector<char> records(numRecords * recordSize);
+
+	f.seekg(headerSize);
+	if (numRecords > 0)
+	{
+		f.read(&records[0], records.size());
+	}
+
+	pts.resize(numRecords);
+	ets.resize(numRecords);
+	for (size_t i = 0; i < numRecords; i++)
+	{
+		memcpy(&pts[i], &records[i * recordSize], sizeof(int64_t));
+		memcpy(&ets[i], &records[i * recordSize + 8], sizeof(int64_t));
+	}
+
+	return true;
+}
+
+
+bool TimestampFile::readText(const std::string& path)
+{
+	std::ifstream f(path.c_str());
+	if (!f)
+	{
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(f, line))
+	{
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		long long p, e;
+		if (sscanf(line.c_str(), "%lld,%lld", &p, &e) == 2)
+		{
+			pts.push_back(p);
+			ets.push_back(e);
+		}
+		else if (line.compare(0, 4, "None") == 0 && sscanf(line.c_str(), "None,%lld", &e) == 1)
+		{
+			// invalid pts written by older versions
+			pts.push_back(-1);
+			ets.push_back(e);
+		}
+	}
+
+	return true;
+}
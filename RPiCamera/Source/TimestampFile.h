@@ -0,0 +1,72 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __TIMESTAMPFILE_H__
+#define __TIMESTAMPFILE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/**
+
+  Frame timestamps written by the rpicamera host
+
+  Reads both the binary format (*_timestamps.bin, see timestamps.py) and
+  the csv format written by older versions (*_timestamps.csv). Truncated
+  files are read up to the last complete record.
+
+*/
+
+class TimestampFile
+{
+public:
+	TimestampFile();
+
+	/** Returns false if the file could not be read. */
+	bool read(const std::string& path);
+
+	/** *_timestamps.bin or *_timestamps.csv next to a video file. */
+	static std::string findForVideo(const std::string& videoPath);
+
+	size_t size() const { return pts.size(); }
+
+	// presentation timestamps (usec; -1 if invalid) and camera clock (usec)
+	std::vector<int64_t> pts;
+	std::vector<int64_t> ets;
+
+	// header fields (binary format only)
+	std::string cameraId;
+	std::string clockMode;
+	double framerate;
+	int width;
+	int height;
+
+private:
+	bool readBinary(const std::string& path);
+	bool readText(const std::string& path);
+};
+
+
+#endif  // __TIMESTAMPFILE_H__
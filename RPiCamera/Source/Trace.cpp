@@ -0,0 +1,221 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+
+
+Trace::Trace(size_t capacity)
+	: events(capacity > 0 ? capacity : 1), sequence(new std::atomic<uint64_t>[events.size()]), next(0)
+{
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		sequence[i].store(0);
+	}
+}
+
+
+int64_t Trace::now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+static void copyName(char* dst, size_t size, const char* src)
+{
+	if (src == nullptr)
+	{
+		dst[0] = 0;
+		return;
+	}
+
+	size_t n = strlen(src);
+	n = n < size - 1 ? n : size - 1;
+	memcpy(dst, src, n);
+	dst[n] = 0;
+}
+
+
+void Trace::add(const char* category, const char* name, int64_t start, int64_t duration, int64_t value)
+{
+	uint64_t index = next.fetch_add(1);
+	size_t slot = index % events.size();
+
+	// odd: being written, even: event index + 1 (times two)
+	sequence[slot].store(2 * index + 1, std::memory_order_relaxed);
+
+	// keeps the writes below from becoming visible before the odd sequence
+	std::atomic_thread_fence(std::memory_order_release);
+
+	TraceEvent& event = events[slot];
+	event.start = start;
+	event.duration = duration;
+	event.value = value;
+	copyName(event.category, sizeof(event.category), category);
+	copyName(event.name, sizeof(event.name), name);
+
+	sequence[slot].store(2 * index + 2, std::memory_order_release);
+}
+
+
+void Trace::copy(std::vector<TraceEvent>& result) const
+{
+	result.clear();
+
+	uint64_t end = next.load();
+	uint64_t begin = end > events.size() ? end - events.size() : 0;
+
+	for (uint64_t index = begin; index < end; index++)
+	{
+		size_t slot = index % events.size();
+		if (sequence[slot].load(std::memory_order_acquire) != 2 * index + 2)
+		{
+			continue;
+		}
+
+		TraceEvent event = events[slot];
+
+		// overwritten while copying
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (sequence[slot].load(std::memory_order_relaxed) != 2 * index + 2)
+		{
+			continue;
+		}
+
+		result.push_back(event);
+	}
+}
+
+
+void Trace::clear()
+{
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		sequence[i].store(0);
+	}
+}
+
+
+static void writeString(std::ostream& out, const char* s)
+{
+	out << '"';
+	for (; *s != 0; s++)
+	{
+		unsigned char c = (unsigned char) *s;
+		if (c == '"' || c == '\\')
+		{
+			out << '\\' << (char) c;
+		}
+		else if (c < 0x20)
+		{
+			out << ' ';
+		}
+		else
+		{
+			out << (char) c;
+		}
+	}
+	out << '"';
+}
+
+
+void writeChromeTrace(std::ostream& out, const std::vector<TraceProcess>& processes)
+{
+	// times relative to the first event keep the numbers readable
+	int64_t origin = 0;
+	bool first = true;
+	for (size_t i = 0; i < processes.size(); i++)
+	{
+		for (size_t j = 0; j < processes[i].events.size(); j++)
+		{
+			int64_t t = processes[i].events[j].start + processes[i].offset;
+			if (first || t < origin)
+			{
+				origin = t;
+				first = false;
+			}
+		}
+	}
+
+	out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"origin_us\":" << origin << "},\"traceEvents\":[";
+
+	const char* separator = "\n";
+	for (size_t i = 0; i < processes.size(); i++)
+	{
+		const TraceProcess& process = processes[i];
+		int pid = (int) i + 1;
+
+		out << separator << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << pid << ",\"tid\":0,\"args\":{\"name\":";
+		writeString(out, process.name.c_str());
+		out << "}}";
+		separator = ",\n";
+
+		std::map<std::string, int> tracks;
+		for (size_t j = 0; j < process.events.size(); j++)
+		{
+			const TraceEvent& event = process.events[j];
+
+			int tid;
+			std::map<std::string, int>::iterator it = tracks.find(event.category);
+			if (it == tracks.end())
+			{
+				tid = (int) tracks.size() + 1;
+				tracks[event.category] = tid;
+
+				out << separator << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid << ",\"tid\":" << tid << ",\"args\":{\"name\":";
+				writeString(out, event.category);
+				out << "}}";
+			}
+			else
+			{
+				tid = it->second;
+			}
+
+			out << separator << "{\"name\":";
+			writeString(out, event.name);
+			out << ",\"cat\":";
+			writeString(out, event.category);
+			if (event.duration > 0)
+			{
+				out << ",\"ph\":\"X\",\"dur\":" << event.duration;
+			}
+			else
+			{
+				out << ",\"ph\":\"i\",\"s\":\"t\"";
+			}
+			out << ",\"ts\":" << (event.start + process.offset - origin) << ",\"pid\":" << pid << ",\"tid\":" << tid;
+			if (event.value >= 0)
+			{
+				out << ",\"args\":{\"value\":" << event.value << "}";
+			}
+			out << "}";
+		}
+	}
+
+	out << "\n]}\n";
+}
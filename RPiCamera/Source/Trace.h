@@ -0,0 +1,124 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+struct TraceEvent
+{
+	int64_t start;		// usec since the epoch (wall clock)
+	int64_t duration;	// usec (0: instant event)
+	int64_t value;		// e.g. number of emitted events (-1: none)
+	char category[16];
+	char name[48];
+};
+
+
+/**
+
+  Timeline of spans and instant events
+
+  Events are written into a fixed ring of slots, so recording never
+  allocates or blocks and can be used on the processing thread; the
+  oldest events are overwritten. Slots are claimed atomically and carry a
+  sequence number so that copy() skips slots which are being written
+  while the trace is read.
+
+  Times are wall clock usec since the epoch, the same reference as the
+  host's trace (see rpicamera/trace.py), so both can be merged into one
+  timeline after estimating the clock offset (see writeChromeTrace).
+
+  @see TraceSpan, RPiCam::exportTrace
+
+*/
+
+class Trace
+{
+public:
+	Trace(size_t capacity = 8192);
+
+	static int64_t now();
+
+	void add(const char* category, const char* name, int64_t start, int64_t duration = 0, int64_t value = -1);
+	void instant(const char* category, const char* name, int64_t value = -1) { add(category, name, now(), 0, value); }
+
+	/** completed events, oldest first */
+	void copy(std::vector<TraceEvent>& events) const;
+	void clear();
+
+	size_t getCapacity() const { return events.size(); }
+
+private:
+	std::vector<TraceEvent> events;
+	std::unique_ptr<std::atomic<uint64_t>[]> sequence;
+	std::atomic<uint64_t> next;
+
+	Trace(const Trace&) = delete;
+	Trace& operator=(const Trace&) = delete;
+};
+
+
+/** adds a span from construction to destruction */
+
+class TraceSpan
+{
+public:
+	TraceSpan(Trace& trace, const char* category, const char* name, int64_t value = -1)
+		: trace(trace), category(category), name(name), value(value), start(Trace::now()) {}
+	~TraceSpan() { trace.add(category, name, start, Trace::now() - start, value); }
+
+	void setValue(int64_t v) { value = v; }
+
+private:
+	Trace& trace;
+	const char* category;
+	const char* name;
+	int64_t value;
+	int64_t start;
+};
+
+
+struct TraceProcess
+{
+	std::string name;
+	std::vector<TraceEvent> events;
+	int64_t offset;		// usec added to the event times (clock offset)
+};
+
+
+/** Chrome trace ("traceEvents") JSON, e.g. for chrome://tracing or
+    ui.perfetto.dev; every process gets its own pid and every category its
+    own track */
+void writeChromeTrace(std::ostream& out, const std::vector<TraceProcess>& processes);
+
+
+#endif  // __TRACE_H__
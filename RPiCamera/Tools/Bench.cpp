@@ -0,0 +1,449 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2015 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+
+  rpicam_bench: micro benchmarks of the per-frame code paths of the plugin
+  (parsing of published frame messages, strobe decoding and frame
+  matching, formatting of text events into their batch; emitting them
+  through JUCE is not covered) on a synthetic session. Build with
+  optimization and run under perf, valgrind etc. as needed. Also simulates
+  the phase lock of cameras with drifting clocks and fails (exit code 1)
+  if its mean correction does not compensate the clock offset.
+
+  Usage: rpicam_bench [-n frames] [-r rate] [-f fps] [-b interval] [-c cameras] [video.h264]
+
+    -n     number of synthetic frames (default: 1000000)
+    -r     sample rate (default: 30000)
+    -f     frame rate (default: 30)
+    -b     barcode interval (default: 30)
+    -c     max. number of cameras for the event benchmark (default: 16)
+    video  additionally replay a recorded session (see rpicam_replay)
+
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "BarcodeDecoder.h"
+#include "EventBatch.h"
+#include "FrameMatcher.h"
+#include "PhaseLock.h"
+#include "ReplaySource.h"
+#include "RPiCamProtocol.h"
+
+
+typedef std::chrono::steady_clock Clock;
+
+
+static double secondsSince(Clock::time_point t0)
+{
+	return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+
+static void report(const char* name, int64_t count, double seconds)
+{
+	printf("%-24s %10lld ops %9.3f s %10.1f ns/op\n", name, (long long) count, seconds, 1e9 * seconds / (count > 0 ? count : 1));
+}
+
+
+static void benchParse(int64_t numFrames)
+{
+	std::vector<std::string> messages;
+	for (int i = 0; i < 1000; i++)
+	{
+		char msg[64];
+		int n = snprintf(msg, sizeof(msg), "Frame %d %lld %lld", 100000 + i, 1000000000LL + 33333LL * i, 1000005000LL + 33333LL * i);
+		messages.push_back(std::string(msg, n));
+	}
+
+	StreamedFrame frame;
+	int64_t checksum = 0;
+
+	Clock::time_point t0 = Clock::now();
+	for (int64_t i = 0; i < numFrames; i++)
+	{
+		const std::string& msg = messages[i % messages.size()];
+		if (RPiCamProtocol::parseFrame(msg.data(), msg.size(), frame))
+		{
+			checksum += frame.pts;
+		}
+	}
+	report("parse frame message", numFrames, secondsSince(t0));
+
+	if (checksum == 0)
+	{
+		printf("(unexpected checksum)\n");
+	}
+}
+
+
+static void benchAlignment(int64_t numFrames, double sampleRate, double fps, int barcodeInterval)
+{
+	const int numBits = 16;
+	const double bitShort = 0.0002 * sampleRate;
+	const double bitLong = 0.0005 * sampleRate;
+	const double bitGap = 0.0002 * sampleRate;
+	const double period = sampleRate / fps;
+
+	// strobe edges as generated by the host (see StrobeGenerator in camera.py)
+	std::vector<std::pair<int64_t, bool> > edges;
+	edges.reserve(numFrames * 2 + (barcodeInterval > 0 ? numFrames / barcodeInterval + 1 : 0) * 2 * (numBits + 1));
+
+	for (int64_t i = 0; i < numFrames; i++)
+	{
+		double t = i * period;
+		edges.push_back(std::make_pair((int64_t) t, true));
+		t += 0.001 * sampleRate;
+		edges.push_back(std::make_pair((int64_t) t, false));
+
+		if (barcodeInterval > 0 && i % barcodeInterval == 0)
+		{
+			int64_t value = i & ((1LL << numBits) - 1);
+			value = (value << 1) | BarcodeDecoder::parityBit(value);
+			for (int b = numBits; b >= 0; b--)
+			{
+				t += bitGap;
+				edges.push_back(std::make_pair((int64_t) t, true));
+				t += (value >> b) & 1 ? bitLong : bitShort;
+				edges.push_back(std::make_pair((int64_t) t, false));
+			}
+		}
+	}
+
+	BarcodeDecoder decoder;
+	decoder.setSampleRate(sampleRate);
+	decoder.setNumBits(numBits);
+	decoder.setNominalFramerate(fps);
+
+	std::vector<FramePulse> pulses;
+	pulses.reserve(numFrames);
+
+	Clock::time_point t0 = Clock::now();
+	FramePulse pulse;
+	for (size_t i = 0; i < edges.size(); i++)
+	{
+		decoder.addEdge(edges[i].first, edges[i].second);
+		while (decoder.popPulse(pulse))
+		{
+			pulses.push_back(pulse);
+		}
+	}
+	decoder.flush();
+	while (decoder.popPulse(pulse))
+	{
+		pulses.push_back(pulse);
+	}
+	report("decode strobe (edges)", (int64_t) edges.size(), secondsSince(t0));
+
+	FrameMatcher matcher;
+	matcher.setSampleRate(sampleRate);
+	matcher.setNominalFramerate(fps);
+
+	t0 = Clock::now();
+	for (int64_t i = 0; i < numFrames; i++)
+	{
+		matcher.addFrame(i, (int64_t) (i * 1e6 / fps));
+		if (i < (int64_t) pulses.size())
+		{
+			matcher.addPulse(pulses[i]);
+		}
+	}
+	std::vector<FrameTableEntry> table;
+	int64_t numMatched = matcher.getNumMatched();
+	matcher.finish(table);
+	report("match frames", numFrames, secondsSince(t0));
+
+	printf("%lld pulses decoded, %lld frames matched\n", (long long) pulses.size(), (long long) numMatched);
+}
+
+
+static void benchEvents(int64_t numFrames, double sampleRate, double fps, int maxCameras)
+{
+	// Only formats the frame events into the preallocated batches; emitting
+	// them (TextEvent::createTextEvent, String::fromUTF8 and addEvent in
+	// RPiCam::emitEvents) needs JUCE and is not measured here, see the
+	// "emit events" spans of the plugin's trace instead.
+	// One plugin instance (and batch) per camera; worst case: an event for every frame
+	const int blockSize = 1024;
+	const int64_t numBlocks = (int64_t) (numFrames * sampleRate / fps / blockSize) + 1;
+	const std::string prefix = "RPiCam Address=192.168.0.10 Frame=";
+
+	for (int numCameras = 1; numCameras <= maxCameras; numCameras *= 2)
+	{
+		std::vector<std::unique_ptr<EventBatch> > batches;
+		for (int c = 0; c < numCameras; c++)
+		{
+			batches.push_back(std::unique_ptr<EventBatch>(new EventBatch(256, 1024)));
+		}
+		std::vector<int64_t> nextFrame(numCameras, 0);
+		int64_t numEvents = 0;
+		size_t checksum = 0;
+
+		Clock::time_point t0 = Clock::now();
+		for (int64_t block = 0; block < numBlocks; block++)
+		{
+			int64_t blockEnd = (block + 1) * blockSize;
+
+			for (int c = 0; c < numCameras; c++)
+			{
+				EventBatch& batch = *batches[c];
+				batch.clear();
+
+				// cameras are not synchronized
+				for (;;)
+				{
+					int64_t sample = (int64_t) ((nextFrame[c] + 0.1 * c) * sampleRate / fps);
+					if (sample >= blockEnd)
+					{
+						break;
+					}
+					batch.addFrame(sample, block, prefix, nextFrame[c]++);
+				}
+
+				// (emitting only reads the preallocated slots)
+				for (size_t i = 0; i < batch.size(); i++)
+				{
+					checksum += batch[i].length;
+				}
+				numEvents += batch.size();
+			}
+		}
+		double seconds = secondsSince(t0);
+
+		char name[64];
+		snprintf(name, sizeof(name), "format events, %2d cam(s)", numCameras);
+		printf("%-24s %10lld blks %9.3f s %10.1f ns/blk/cam %10lld events\n", name, (long long) numBlocks, seconds,
+			1e9 * seconds / numBlocks / numCameras, (long long) numEvents);
+
+		if (checksum == 0)
+		{
+			printf("(unexpected checksum)\n");
+		}
+	}
+}
+
+
+static bool benchPhaseLock(double sampleRate, double fps)
+{
+	// cameras with clock offsets, 0.1 ms strobe jitter and the 1/256 Hz
+	// resolution of the RPi's frame rate adjustment; 2 minutes each. Once
+	// locked, the applied adjustment has to average to -offset * fps.
+	const double offsets[] = {-100, -20, 0, 50, 100};	// ppm
+	const double tolerance = 0.001;
+	const double maxDeviation = 0.0001;	// Hz
+	std::mt19937 rng(1);
+	std::normal_distribution<double> jitter(0, 0.0001 * sampleRate);
+	bool ok = true;
+
+	for (int k = 0; k < 5; k++)
+	{
+		PhaseLock lock;
+		lock.setSampleRate(sampleRate);
+		lock.setNominalFramerate(fps);
+		lock.setTolerance(tolerance);
+
+		double t = 0.3 * sampleRate / fps;	// initial phase
+		double delta = 0;
+		double lockedAfter = -1;
+		double maxError = 0;
+		double deltaSum = 0;
+		int64_t numSteady = 0;
+		int64_t numFrames = (int64_t) (120 * fps);
+
+		Clock::time_point t0 = Clock::now();
+		for (int64_t i = 0; i < numFrames; i++)
+		{
+			t += sampleRate / (fps * (1 + offsets[k] * 1e-6) + delta);
+			if (lock.addPulse((int64_t) (t + jitter(rng))))
+			{
+				// (the RPi rounds to the same resolution)
+				delta = lock.getCorrection();
+
+				if (lock.isLocked() && lockedAfter < 0)
+				{
+					lockedAfter = i / fps;
+				}
+				if (lockedAfter >= 0 && i / fps > lockedAfter + 10)
+				{
+					maxError = std::max(maxError, std::fabs(lock.getPhaseError()));
+				}
+			}
+
+			// steady state: the second minute (the integral settles within
+			// about 20 s; time average over frames)
+			if (lockedAfter >= 0 && i >= numFrames / 2)
+			{
+				deltaSum += delta;
+				numSteady++;
+			}
+		}
+		double seconds = secondsSince(t0);
+
+		double expected = -offsets[k] * 1e-6 * fps;
+		double mean = numSteady > 0 ? deltaSum / numSteady : 0;
+		bool passed = numSteady > 0 && std::fabs(mean - expected) <= maxDeviation;
+		ok = ok && passed;
+
+		printf("phase lock %+5.0f ppm     %10lld ops %9.3f s  locked after %5.1f s, max. error %.3f ms (10 s later), mean correction %+.5f Hz (expected %+.5f Hz) %s\n",
+			offsets[k], (long long) numFrames, seconds, lockedAfter, 1e3 * maxError, mean, expected, passed ? "ok" : "FAILED");
+	}
+
+	return ok;
+}
+
+
+static void benchReplay(const std::string& video, double sampleRate, int barcodeInterval)
+{
+	ReplaySource replay;
+
+	Clock::time_point t0 = Clock::now();
+	if (!replay.open(video))
+	{
+		fprintf(stderr, "%s: no timestamps found\n", video.c_str());
+		return;
+	}
+	report("read timestamps", replay.getNumFrames(), secondsSince(t0));
+
+	double fps = replay.getFramerate() > 0 ? replay.getFramerate() : 30.;
+
+	BarcodeDecoder decoder;
+	decoder.setSampleRate(sampleRate);
+	decoder.setNominalFramerate(fps);
+
+	FrameMatcher matcher;
+	matcher.setSampleRate(sampleRate);
+	matcher.setNominalFramerate(fps);
+
+	replay.setSampleRate(sampleRate);
+	replay.setSpeed(0);
+	replay.setStrobe(0.001, barcodeInterval, decoder.getNumBits(), 0.0002, 0.0005, 0.0002);
+	replay.start(0);
+
+	std::vector<ReplayFrame> frames;
+	std::vector<ReplayEdge> edges;
+
+	t0 = Clock::now();
+	while (!replay.isFinished())
+	{
+		frames.clear();
+		edges.clear();
+		replay.advance(0, 1024, frames, edges);
+
+		for (size_t i = 0; i < edges.size(); i++)
+		{
+			decoder.addEdge(edges[i].sampleNumber, edges[i].state);
+		}
+
+		FramePulse pulse;
+		while (decoder.popPulse(pulse))
+		{
+			matcher.addPulse(pulse);
+		}
+
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			matcher.addFrame(frames[i].frameIndex, frames[i].pts);
+		}
+	}
+	std::vector<FrameTableEntry> table;
+	matcher.finish(table);
+	report("replay session (frames)", replay.getNumFrames(), secondsSince(t0));
+}
+
+
+static void usage()
+{
+	printf("Usage: rpicam_bench [-n frames] [-r rate] [-f fps] [-b interval] [-c cameras] [video.h264]\n");
+}
+
+
+int main(int argc, char** argv)
+{
+	int64_t numFrames = 1000000;
+	double sampleRate = 30000.;
+	double fps = 30.;
+	int barcodeInterval = 30;
+	int maxCameras = 16;
+	std::string video;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+
+		if (arg == "-n" && i + 1 < argc)
+		{
+			numFrames = atoll(argv[++i]);
+		}
+		else if (arg == "-r" && i + 1 < argc)
+		{
+			sampleRate = atof(argv[++i]);
+		}
+		else if (arg == "-f" && i + 1 < argc)
+		{
+			fps = atof(argv[++i]);
+		}
+		else if (arg == "-b" && i + 1 < argc)
+		{
+			barcodeInterval = atoi(argv[++i]);
+		}
+		else if (arg == "-c" && i + 1 < argc)
+		{
+			maxCameras = atoi(argv[++i]);
+		}
+		else if (arg == "-h" || arg == "--help")
+		{
+			usage();
+			return 0;
+		}
+		else
+		{
+			video = arg;
+		}
+	}
+
+	if (numFrames <= 0 || sampleRate <= 0 || fps <= 0)
+	{
+		usage();
+		return 1;
+	}
+
+	benchParse(numFrames);
+	benchAlignment(numFrames, sampleRate, fps, barcodeInterval);
+	benchEvents(numFrames, sampleRate, fps, maxCameras);
+	bool locked = benchPhaseLock(sampleRate, fps);
+
+	if (!video.empty())
+	{
+		benchReplay(video, sampleRate, barcodeInterval);
+	}
+
+	return locked ? 0 : 1;
+}
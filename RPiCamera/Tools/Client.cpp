@@ -0,0 +1,236 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2015 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+
+  rpicam_client: minimal command line client for the rpicamera host, e.g.
+  to script a camera or to test the host without the Open Ephys GUI.
+
+  Usage: rpicam_client [-a address] [-p port] [-t timeout] [-o file] command ...
+         rpicam_client [-a address] [-p port] -f frames
+         rpicam_client [-a address] [-p port] -s messages
+
+    -a     address of the RPi or endpoint, e.g. ipc:///tmp/rpicam (default: localhost)
+    -p     command port (default: 5555)
+    -t     reply timeout in ms (default: 5000)
+    -o     write binary reply data (e.g., of "Snapshot") to this file
+    -f     print the given number of published frames and exit
+    -s     print the given number of published status and telemetry
+           messages and exit (read only, e.g. while another client
+           controls the camera)
+
+  Examples:
+
+    rpicam_client -a 192.168.0.10 Status
+    rpicam_client -a 192.168.0.10 -o still.jpg Snapshot
+    rpicam_client -a 192.168.0.10 -f 100
+    rpicam_client -a 192.168.0.10 -s 10
+
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CameraClient.h"
+#include "FrameStream.h"
+#include "RPiCamProtocol.h"
+
+
+static void usage()
+{
+	printf("Usage: rpicam_client [-a address] [-p port] [-t timeout] [-o file] command ...\n");
+	printf("       rpicam_client [-a address] [-p port] -f frames\n");
+	printf("       rpicam_client [-a address] [-p port] -s messages\n");
+}
+
+
+static int printFrames(void* context, const std::string& url, int numFrames)
+{
+	FrameStream stream(context);
+	stream.connect(url);
+
+	std::vector<StreamedFrame> frames(1024);
+	int count = 0;
+
+	while (count < numFrames)
+	{
+		int n = stream.read(&frames[0], (int) frames.size());
+		for (int i = 0; i < n && count < numFrames; i++, count++)
+		{
+			printf("%lld %lld %lld\n", (long long) frames[i].frameIndex, (long long) frames[i].pts, (long long) frames[i].ets);
+		}
+
+		if (n == 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+
+	stream.disconnect();
+
+	return 0;
+}
+
+
+static int printStatus(void* context, const std::string& url, int numMessages)
+{
+	void* socket = zmq_socket(context, ZMQ_SUB);
+	zmq_setsockopt(socket, ZMQ_SUBSCRIBE, "Status ", 7);
+	zmq_setsockopt(socket, ZMQ_SUBSCRIBE, "Telemetry ", 10);
+
+	int linger = 0;
+	zmq_setsockopt(socket, ZMQ_LINGER, &linger, sizeof(int));
+
+	int result = 0;
+	if (zmq_connect(socket, url.c_str()) != 0)
+	{
+		fprintf(stderr, "could not connect to %s\n", url.c_str());
+		result = 1;
+	}
+
+	std::vector<char> msg(65536);
+	for (int count = 0; result == 0 && count < numMessages; count++)
+	{
+		int n = zmq_recv(socket, &msg[0], msg.size(), 0);
+		if (n < 0)
+		{
+			result = 1;
+			break;
+		}
+		printf("%.*s\n", n < (int) msg.size() ? n : (int) msg.size(), &msg[0]);
+		fflush(stdout);
+	}
+
+	zmq_close(socket);
+
+	return result;
+}
+
+
+int main(int argc, char** argv)
+{
+	std::string address = "localhost";
+	int port = RPiCamProtocol::DEFAULT_PORT;
+	int timeout = 5000;
+	int numFrames = 0;
+	int numMessages = 0;
+	std::string output;
+	std::string command;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+
+		if (arg == "-a" && i + 1 < argc)
+		{
+			address = argv[++i];
+		}
+		else if (arg == "-p" && i + 1 < argc)
+		{
+			port = atoi(argv[++i]);
+		}
+		else if (arg == "-t" && i + 1 < argc)
+		{
+			timeout = atoi(argv[++i]);
+		}
+		else if (arg == "-o" && i + 1 < argc)
+		{
+			output = argv[++i];
+		}
+		else if (arg == "-f" && i + 1 < argc)
+		{
+			numFrames = atoi(argv[++i]);
+		}
+		else if (arg == "-s" && i + 1 < argc)
+		{
+			numMessages = atoi(argv[++i]);
+		}
+		else if (arg == "-h" || arg == "--help")
+		{
+			usage();
+			return 0;
+		}
+		else
+		{
+			// remaining arguments form the command
+			command += command.empty() ? arg : " " + arg;
+		}
+	}
+
+	void* context = zmq_ctx_new();
+	int result = 0;
+
+	if (numFrames > 0)
+	{
+		result = printFrames(context, RPiCamProtocol::frameUrl(address, port), numFrames);
+	}
+	else if (numMessages > 0)
+	{
+		result = printStatus(context, RPiCamProtocol::frameUrl(address, port), numMessages);
+	}
+	else if (!command.empty())
+	{
+		CameraClient client(context);
+		client.setUrl(RPiCamProtocol::commandUrl(address, port));
+
+		std::vector<ZmqFrame> reply;
+		if (!client.request(command, reply, timeout) || reply.empty())
+		{
+			fprintf(stderr, "no reply from %s\n", client.getUrl().c_str());
+			result = 1;
+		}
+		else
+		{
+			printf("%s\n", reply[0].str().c_str());
+
+			if (!output.empty() && reply.size() > 1)
+			{
+				FILE* f = fopen(output.c_str(), "wb");
+				if (f == NULL || fwrite(reply[1].data(), 1, reply[1].size(), f) != reply[1].size())
+				{
+					fprintf(stderr, "could not write %s\n", output.c_str());
+					result = 1;
+				}
+				if (f != NULL)
+				{
+					fclose(f);
+				}
+			}
+		}
+
+		client.close();
+	}
+	else
+	{
+		usage();
+		result = 1;
+	}
+
+	zmq_ctx_destroy(context);
+
+	return result;
+}
@@ -0,0 +1,424 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2015 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+
+  rpicam_event_latency: latency of the plugin's receive path, from a frame
+  message published on zmq to the frame's text event in the processing
+  loop, measured on a single machine without a camera.
+
+  It does not measure the capture-to-event latency of a real setup: there
+  is no sensor, no encoder and no rpicamera host. A synthetic camera
+  renders a machine-readable frame counter (frame index and render time as
+  blocks of black and white pixels) into gray frames at the frame rate; a
+  stand-in publisher reads the counter back and publishes "Frame <index>
+  <pts> <render time>" in the format of the host's encoder callback. The
+  frames are received by FrameStream and handed to a simulated processing
+  loop (blocks of samples at the acquisition rate) that decodes the strobe
+  pulses, matches frames and formats one text event per frame, i.e. the
+  same code as RPiCam::process(). Exposure, encoding and the host's own
+  latency are visible in an exported trace of a real recording instead.
+
+  Reports the latency distribution of each stage. With -l, the tool exits
+  with status 1 if the 99th percentile of the total latency exceeds the
+  limit (e.g. as a regression check for changes to the timing paths).
+
+  Usage: rpicam_event_latency [-e endpoint] [-f fps] [-d seconds] [-x width] [-y height] [-r rate] [-s samples] [-l ms]
+
+    -e     endpoint of the frame messages (default: inproc://rpicam-event-latency),
+           e.g. ipc:///tmp/rpicam-event-latency or tcp://127.0.0.1:5599
+    -f     frame rate (default: 30)
+    -d     duration in seconds (default: 10)
+    -x/-y  frame size (default: 640x480)
+    -r     sample rate of the simulated acquisition (default: 30000)
+    -s     samples per processing block (default: 1024)
+    -l     fail if the 99th percentile of the total latency exceeds this (ms)
+
+*/
+
+#include <zmq.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BarcodeDecoder.h"
+#include "EventBatch.h"
+#include "FrameMatcher.h"
+#include "FrameStream.h"
+#include "RPiCamProtocol.h"
+
+
+typedef std::chrono::system_clock WallClock;
+
+// frame index and render time (usec since the epoch) rendered into the frame
+const int COUNTER_INDEX_BITS = 32;
+const int COUNTER_TIME_BITS = 64;
+const int COUNTER_BLOCK = 8;
+
+
+static double wallTime()
+{
+	// usec since the epoch (same clock as StreamedFrame::received)
+	return std::chrono::duration<double, std::micro>(WallClock::now().time_since_epoch()).count();
+}
+
+
+class SyntheticCamera
+{
+public:
+	SyntheticCamera(int w, int h) : width(w), height(h), luma(w * h)
+	{
+	}
+
+	/** Render a gray gradient with the counter in the top rows. */
+	void render(int64_t frameIndex, int64_t renderTime)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				luma[y * width + x] = (uint8_t) ((x + y + frameIndex) & 0x7f) + 64;
+			}
+		}
+
+		for (int b = 0; b < COUNTER_INDEX_BITS + COUNTER_TIME_BITS; b++)
+		{
+			bool bit = b < COUNTER_INDEX_BITS ? (frameIndex >> b) & 1 : (renderTime >> (b - COUNTER_INDEX_BITS)) & 1;
+			int x0 = (b % blocksPerRow()) * COUNTER_BLOCK;
+			int y0 = (b / blocksPerRow()) * COUNTER_BLOCK;
+
+			for (int y = y0; y < y0 + COUNTER_BLOCK; y++)
+			{
+				std::fill(&luma[y * width + x0], &luma[y * width + x0] + COUNTER_BLOCK, bit ? 255 : 0);
+			}
+		}
+	}
+
+	/** Read the counter back from the block centers. */
+	void read(int64_t& frameIndex, int64_t& renderTime) const
+	{
+		uint64_t index = 0;
+		uint64_t time = 0;
+
+		for (int b = 0; b < COUNTER_INDEX_BITS + COUNTER_TIME_BITS; b++)
+		{
+			int x = (b % blocksPerRow()) * COUNTER_BLOCK + COUNTER_BLOCK / 2;
+			int y = (b / blocksPerRow()) * COUNTER_BLOCK + COUNTER_BLOCK / 2;
+			uint64_t bit = luma[y * width + x] > 127 ? 1 : 0;
+
+			if (b < COUNTER_INDEX_BITS)
+			{
+				index |= bit << b;
+			}
+			else
+			{
+				time |= bit << (b - COUNTER_INDEX_BITS);
+			}
+		}
+
+		frameIndex = (int64_t) index;
+		renderTime = (int64_t) time;
+	}
+
+	bool fits() const
+	{
+		int rows = (COUNTER_INDEX_BITS + COUNTER_TIME_BITS + blocksPerRow() - 1) / std::max(1, blocksPerRow());
+		return blocksPerRow() > 0 && rows * COUNTER_BLOCK <= height;
+	}
+
+private:
+	int blocksPerRow() const { return width / COUNTER_BLOCK; }
+
+	int width;
+	int height;
+	std::vector<uint8_t> luma;
+};
+
+
+struct FrameTimes
+{
+	double rendered;
+	double published;
+	double received;
+	double processed;
+	double emitted;
+};
+
+
+static void runSource(void* socket, SyntheticCamera* camera, double fps, int numFrames,
+	WallClock::time_point start, std::vector<FrameTimes>* times)
+{
+	char msg[128];
+
+	for (int i = 0; i < numFrames; i++)
+	{
+		std::this_thread::sleep_until(start + std::chrono::microseconds((int64_t) (i * 1e6 / fps)));
+
+		// the synthetic frame is ready now
+		double rendered = wallTime();
+		camera->render(i, (int64_t) rendered);
+
+		// the host only knows what is in the frame
+		int64_t frameIndex = 0;
+		int64_t renderTime = 0;
+		camera->read(frameIndex, renderTime);
+
+		int n = snprintf(msg, sizeof(msg), "Frame %lld %lld %lld", (long long) frameIndex,
+			(long long) (frameIndex * 1e6 / fps), (long long) renderTime);
+		zmq_send(socket, msg, n, 0);
+
+		(*times)[i].rendered = rendered;
+		(*times)[i].published = wallTime();
+	}
+}
+
+
+static void report(const char* name, std::vector<double>& values)
+{
+	if (values.empty())
+	{
+		printf("%-24s %8d\n", name, 0);
+		return;
+	}
+
+	std::sort(values.begin(), values.end());
+
+	double sum = 0;
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		sum += values[i];
+	}
+
+	#define PERCENTILE(p) (values[std::min(values.size() - 1, (size_t) ((p) * values.size()))] / 1000.)
+	printf("%-24s %8d %9.3f %9.3f %9.3f %9.3f %9.3f\n", name, (int) values.size(), sum / values.size() / 1000.,
+		PERCENTILE(0.5), PERCENTILE(0.9), PERCENTILE(0.99), values.back() / 1000.);
+	#undef PERCENTILE
+}
+
+
+static void usage()
+{
+	printf("Usage: rpicam_event_latency [-e endpoint] [-f fps] [-d seconds] [-x width] [-y height] [-r rate] [-s samples] [-l ms]\n");
+}
+
+
+int main(int argc, char** argv)
+{
+	std::string endpoint = "inproc://rpicam-event-latency";
+	double fps = 30.;
+	double duration = 10.;
+	int width = 640;
+	int height = 480;
+	double sampleRate = 30000.;
+	int blockSize = 1024;
+	double limit = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+
+		if (arg == "-e" && i + 1 < argc)
+		{
+			endpoint = argv[++i];
+		}
+		else if (arg == "-f" && i + 1 < argc)
+		{
+			fps = atof(argv[++i]);
+		}
+		else if (arg == "-d" && i + 1 < argc)
+		{
+			duration = atof(argv[++i]);
+		}
+		else if (arg == "-x" && i + 1 < argc)
+		{
+			width = atoi(argv[++i]);
+		}
+		else if (arg == "-y" && i + 1 < argc)
+		{
+			height = atoi(argv[++i]);
+		}
+		else if (arg == "-r" && i + 1 < argc)
+		{
+			sampleRate = atof(argv[++i]);
+		}
+		else if (arg == "-s" && i + 1 < argc)
+		{
+			blockSize = atoi(argv[++i]);
+		}
+		else if (arg == "-l" && i + 1 < argc)
+		{
+			limit = atof(argv[++i]);
+		}
+		else
+		{
+			usage();
+			return arg == "-h" || arg == "--help" ? 0 : 1;
+		}
+	}
+
+	SyntheticCamera camera(width, height);
+	int numFrames = (int) (duration * fps);
+
+	if (fps <= 0 || numFrames <= 0 || sampleRate <= 0 || blockSize <= 0 || !camera.fits())
+	{
+		usage();
+		return 1;
+	}
+
+	void* context = zmq_ctx_new();
+
+	// stand-in for the host's pub socket (bound first: required for inproc)
+	void* publisher = zmq_socket(context, ZMQ_PUB);
+	if (zmq_bind(publisher, endpoint.c_str()) != 0)
+	{
+		fprintf(stderr, "could not bind %s: %s\n", endpoint.c_str(), zmq_strerror(zmq_errno()));
+		zmq_close(publisher);
+		zmq_ctx_destroy(context);
+		return 1;
+	}
+
+	FrameStream stream(context);
+	stream.connect(endpoint);
+
+	// subscriptions take a moment to reach the publisher
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+	std::vector<FrameTimes> times(numFrames, FrameTimes{0, 0, 0, 0, 0});
+	std::vector<StreamedFrame> frames(1024);
+
+	BarcodeDecoder decoder;
+	decoder.setSampleRate(sampleRate);
+	decoder.setNominalFramerate(fps);
+
+	FrameMatcher matcher;
+	matcher.setSampleRate(sampleRate);
+	matcher.setNominalFramerate(fps);
+
+	EventBatch events(256, 1024);
+	const std::string prefix = "RPiCam Address=" + endpoint + " Frame=";
+
+	WallClock::time_point start = WallClock::now() + std::chrono::milliseconds(100);
+	std::thread source(runSource, publisher, &camera, fps, numFrames, start, &times);
+
+	// processing blocks at the acquisition rate; the strobe pulse of each
+	// frame is generated at its scheduled render time
+	const double blockDuration = blockSize / sampleRate;
+	const int64_t pulseWidth = (int64_t) (0.001 * sampleRate);
+	int nextPulse = 0;
+	int numReceived = 0;
+	int64_t block = 0;
+
+	while (numReceived < numFrames)
+	{
+		block++;
+		std::this_thread::sleep_until(start + std::chrono::microseconds((int64_t) (block * blockDuration * 1e6)));
+
+		if (block * blockDuration > duration + 2.0)
+		{
+			break;  // frames lost
+		}
+
+		int64_t blockEnd = block * blockSize;
+		while (nextPulse < numFrames && (int64_t) (nextPulse * sampleRate / fps) + pulseWidth < blockEnd)
+		{
+			int64_t onset = (int64_t) (nextPulse * sampleRate / fps);
+			decoder.addEdge(onset, true);
+			decoder.addEdge(onset + pulseWidth, false);
+			nextPulse++;
+		}
+
+		// same order as RPiCam::process()
+		events.clear();
+		double processed = wallTime();
+
+		FramePulse pulse;
+		while (decoder.popPulse(pulse))
+		{
+			matcher.addPulse(pulse);
+		}
+
+		int n = stream.read(&frames[0], (int) frames.size());
+		for (int i = 0; i < n; i++)
+		{
+			const StreamedFrame& f = frames[i];
+			matcher.addFrame(f.frameIndex, f.pts);
+			events.addFrame(blockEnd - blockSize, block, prefix, f.frameIndex);
+
+			if (f.frameIndex >= 0 && f.frameIndex < numFrames)
+			{
+				FrameTimes& t = times[(size_t) f.frameIndex];
+				t.received = (double) f.received;
+				t.processed = processed;
+				t.emitted = wallTime();
+				numReceived++;
+			}
+		}
+	}
+
+	source.join();
+	stream.disconnect();
+	zmq_close(publisher);
+	zmq_ctx_destroy(context);
+
+	std::vector<double> published, transport, waiting, processing, total;
+	for (int i = 0; i < numFrames; i++)
+	{
+		const FrameTimes& t = times[i];
+		if (t.emitted > 0)
+		{
+			published.push_back(t.published - t.rendered);
+			transport.push_back(t.received - t.published);
+			waiting.push_back(t.processed - t.received);
+			processing.push_back(t.emitted - t.processed);
+			total.push_back(t.emitted - t.rendered);
+		}
+	}
+
+	printf("%s, %.1f fps, %dx%d, blocks of %.1f ms, %lld frames matched\n", endpoint.c_str(), fps, width, height,
+		1000. * blockDuration, (long long) matcher.getNumMatched());
+	printf("%-24s %8s %9s %9s %9s %9s %9s\n", "stage (ms)", "frames", "mean", "p50", "p90", "p99", "max");
+	report("render -> published", published);
+	report("published -> received", transport);
+	report("received -> process", waiting);
+	report("process -> event", processing);
+	report("render -> event", total);
+
+	int result = 0;
+	if (numReceived < numFrames)
+	{
+		printf("%d of %d frames lost\n", numFrames - numReceived, numFrames);
+		result = 1;
+	}
+
+	if (limit > 0 && !total.empty() && total[std::min(total.size() - 1, (size_t) (0.99 * total.size()))] > 1000. * limit)
+	{
+		printf("99th percentile above %.3f ms\n", limit);
+		result = 1;
+	}
+
+	return result;
+}
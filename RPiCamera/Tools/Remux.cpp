@@ -0,0 +1,386 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2015 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+
+  rpicam_remux: wrap raw h264 files recorded by the rpicamera host into a
+  container (mp4 or mkv) without re-encoding.
+
+  In contrast to "ffmpeg -r fps", every frame gets its actual capture time
+  from the timestamp file, i.e. the output has a variable frame rate and
+  dropped frames do not shift subsequent frames. Files are processed in
+  parallel.
+
+  Usage: rpicam_remux [-j jobs] [-f mp4|mkv] [-o] path [path ...]
+
+    path   h264 file or directory (searched recursively)
+    -j     number of parallel jobs (default: number of cores)
+    -f     output container (default: mp4)
+    -o     overwrite existing output files
+
+*/
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>
+}
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TimestampFile.h"
+
+
+static std::mutex printLock;
+
+
+static bool isDirectory(const std::string& path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+
+static bool endsWith(const std::string& s, const std::string& suffix)
+{
+	return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+static void findVideoFiles(const std::string& path, std::vector<std::string>& files)
+{
+	if (!isDirectory(path))
+	{
+		if (endsWith(path, ".h264"))
+		{
+			files.push_back(path);
+		}
+		return;
+	}
+
+	DIR* dir = opendir(path.c_str());
+	if (dir == NULL)
+	{
+		return;
+	}
+
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		std::string name(entry->d_name);
+		if (name != "." && name != "..")
+		{
+			findVideoFiles(path + "/" + name, files);
+		}
+	}
+	closedir(dir);
+}
+
+
+/**
+  Capture time of every frame relative to the first frame (usec). Invalid
+  encoder timestamps (pts < 0) are replaced using the camera clock (ets)
+  of the same frame and the offset between both clocks of its neighbours.
+*/
+static std::vector<int64_t> getFrameTimes(const TimestampFile& ts)
+{
+	size_t n = ts.size();
+	std::vector<int64_t> t(ts.pts);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		if (t[i] >= 0)
+		{
+			continue;
+		}
+
+		int64_t offset = 0;
+		bool found = false;
+		for (size_t d = 1; d < n && !found; d++)
+		{
+			if (i >= d && ts.pts[i - d] >= 0)
+			{
+				offset = ts.ets[i - d] - ts.pts[i - d];
+				found = true;
+			}
+			else if (i + d < n && ts.pts[i + d] >= 0)
+			{
+				offset = ts.ets[i + d] - ts.pts[i + d];
+				found = true;
+			}
+		}
+		t[i] = ts.ets[i] - offset;
+	}
+
+	// the container requires strictly increasing timestamps
+	for (size_t i = 1; i < n; i++)
+	{
+		if (t[i] <= t[i - 1])
+		{
+			t[i] = t[i - 1] + 1;
+		}
+	}
+
+	if (n > 0)
+	{
+		int64_t t0 = t[0];
+		for (size_t i = 0; i < n; i++)
+		{
+			t[i] -= t0;
+		}
+	}
+
+	return t;
+}
+
+
+static std::string remux(const std::string& videoPath, const std::string& outputPath)
+{
+	std::string tsPath = TimestampFile::findForVideo(videoPath);
+	if (tsPath.empty())
+	{
+		return "no timestamp file";
+	}
+
+	TimestampFile ts;
+	if (!ts.read(tsPath) || ts.size() == 0)
+	{
+		return "could not read " + tsPath;
+	}
+	std::vector<int64_t> frameTimes = getFrameTimes(ts);
+
+	const AVRational usec = { 1, 1000000 };
+
+	AVFormatContext* in = NULL;
+	AVFormatContext* out = NULL;
+	AVPacket* pkt = NULL;
+	std::string error;
+	int64_t frame = 0;
+	int64_t lastTime = 0;
+	int64_t frameInterval = 0;
+	AVStream* outStream = NULL;
+
+	auto inputFormat = av_find_input_format("h264");
+
+	if (avformat_open_input(&in, videoPath.c_str(), inputFormat, NULL) < 0)
+	{
+		return "could not open video";
+	}
+
+	if (avformat_find_stream_info(in, NULL) < 0 || in->nb_streams < 1)
+	{
+		error = "no video stream";
+		goto cleanup;
+	}
+
+	if (avformat_alloc_output_context2(&out, NULL, NULL, outputPath.c_str()) < 0)
+	{
+		error = "could not create output context";
+		goto cleanup;
+	}
+
+	outStream = avformat_new_stream(out, NULL);
+	avcodec_parameters_copy(outStream->codecpar, in->streams[0]->codecpar);
+	outStream->codecpar->codec_tag = 0;
+	outStream->time_base = usec;
+
+	if (!(out->oformat->flags & AVFMT_NOFILE) && avio_open(&out->pb, outputPath.c_str(), AVIO_FLAG_WRITE) < 0)
+	{
+		error = "could not open output file";
+		goto cleanup;
+	}
+
+	if (avformat_write_header(out, NULL) < 0)
+	{
+		error = "could not write header";
+		goto cleanup;
+	}
+
+	// (average) frame interval for frames without timestamp
+	if (frameTimes.size() > 1)
+	{
+		frameInterval = frameTimes.back() / (int64_t) (frameTimes.size() - 1);
+	}
+
+	pkt = av_packet_alloc();
+	while (av_read_frame(in, pkt) >= 0)
+	{
+		// the raw h264 demuxer returns one access unit (= frame) per packet
+		int64_t t;
+		if (frame < (int64_t) frameTimes.size())
+		{
+			t = frameTimes[frame];
+		}
+		else
+		{
+			t = lastTime + frameInterval;
+		}
+		lastTime = t;
+
+		// no B-frames -> decoding order == presentation order
+		pkt->stream_index = 0;
+		pkt->pts = av_rescale_q(t, usec, outStream->time_base);
+		pkt->dts = pkt->pts;
+		pkt->duration = av_rescale_q(frameInterval, usec, outStream->time_base);
+		pkt->pos = -1;
+
+		if (av_interleaved_write_frame(out, pkt) < 0)
+		{
+			error = "error writing frame";
+			break;
+		}
+		frame++;
+	}
+
+	av_write_trailer(out);
+
+	if (error.empty() && frame != (int64_t) frameTimes.size())
+	{
+		error = "warning: " + std::to_string(frame) + " frames but " + std::to_string(frameTimes.size()) + " timestamps";
+	}
+
+cleanup:
+	av_packet_free(&pkt);
+	avformat_close_input(&in);
+	if (out != NULL)
+	{
+		if (!(out->oformat->flags & AVFMT_NOFILE))
+		{
+			avio_closep(&out->pb);
+		}
+		avformat_free_context(out);
+	}
+
+	return error;
+}
+
+
+static void usage()
+{
+	printf("Usage: rpicam_remux [-j jobs] [-f mp4|mkv] [-o] path [path ...]\n");
+}
+
+
+int main(int argc, char** argv)
+{
+	int numJobs = (int) std::thread::hardware_concurrency();
+	std::string container = "mp4";
+	bool overwrite = false;
+	std::vector<std::string> videoFiles;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+
+		if (arg == "-j" && i + 1 < argc)
+		{
+			numJobs = atoi(argv[++i]);
+		}
+		else if (arg == "-f" && i + 1 < argc)
+		{
+			container = argv[++i];
+		}
+		else if (arg == "-o")
+		{
+			overwrite = true;
+		}
+		else if (arg == "-h" || arg == "--help")
+		{
+			usage();
+			return 0;
+		}
+		else
+		{
+			findVideoFiles(arg, videoFiles);
+		}
+	}
+
+	if (videoFiles.empty())
+	{
+		usage();
+		return 1;
+	}
+
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+	av_register_all();
+#endif
+	av_log_set_level(AV_LOG_ERROR);
+
+	std::atomic<size_t> next(0);
+	std::atomic<int> numFailed(0);
+
+	auto worker = [&]()
+	{
+		size_t i;
+		while ((i = next++) < videoFiles.size())
+		{
+			const std::string& video = videoFiles[i];
+			std::string output = video.substr(0, video.size() - 5) + "." + container;
+
+			struct stat st;
+			if (!overwrite && stat(output.c_str(), &st) == 0)
+			{
+				continue;
+			}
+
+			std::string error = remux(video, output);
+
+			std::lock_guard<std::mutex> lock(printLock);
+			if (error.empty())
+			{
+				printf("%s -> %s\n", video.c_str(), output.c_str());
+			}
+			else
+			{
+				printf("%s: %s\n", video.c_str(), error.c_str());
+				if (error.compare(0, 7, "warning") != 0)
+				{
+					numFailed++;
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < std::max(1, numJobs); i++)
+	{
+		threads.push_back(std::thread(worker));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+
+	return numFailed > 0 ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2015 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+
+  rpicam_replay: feed a recorded session through the strobe decoder and
+  frame matcher used by the plugin (see ReplaySource) and write the
+  resulting frame table.
+
+  Sample numbers only depend on the recorded timestamps, so the output is
+  identical for every run and every replay speed. Useful to benchmark the
+  decoder/matcher and to regression-test alignment code without hardware.
+
+  Usage: rpicam_replay [-r rate] [-s speed] [-b interval] [-n bits] [-o output] video.h264
+
+    -r     sample rate (default: 30000)
+    -s     replay speed (1: real time; default 0: as fast as possible)
+    -b     barcode interval used by the host (default: 0, no barcodes)
+    -n     number of barcode bits (default: 16)
+    -o     frame table (default: <video>_replay_frames.bin)
+
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BarcodeDecoder.h"
+#include "FrameMatcher.h"
+#include "ReplaySource.h"
+
+
+const int BLOCK_SIZE = 1024;
+const int MAX_FRAMES_PER_BLOCK = 1024;
+
+
+static void usage()
+{
+	printf("Usage: rpicam_replay [-r rate] [-s speed] [-b interval] [-n bits] [-o output] video.h264\n");
+}
+
+
+int main(int argc, char** argv)
+{
+	double sampleRate = 30000.;
+	double speed = 0;
+	int barcodeInterval = 0;
+	int barcodeBits = 16;
+	std::string output;
+	std::string video;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+
+		if (arg == "-r" && i + 1 < argc)
+		{
+			sampleRate = atof(argv[++i]);
+		}
+		else if (arg == "-s" && i + 1 < argc)
+		{
+			speed = atof(argv[++i]);
+		}
+		else if (arg == "-b" && i + 1 < argc)
+		{
+			barcodeInterval = atoi(argv[++i]);
+		}
+		else if (arg == "-n" && i + 1 < argc)
+		{
+			barcodeBits = atoi(argv[++i]);
+		}
+		else if (arg == "-o" && i + 1 < argc)
+		{
+			output = argv[++i];
+		}
+		else if (arg == "-h" || arg == "--help")
+		{
+			usage();
+			return 0;
+		}
+		else
+		{
+			video = arg;
+		}
+	}
+
+	if (video.empty() || sampleRate <= 0)
+	{
+		usage();
+		return 1;
+	}
+
+	ReplaySource replay;
+	if (!replay.open(video))
+	{
+		fprintf(stderr, "%s: no timestamps found\n", video.c_str());
+		return 1;
+	}
+
+	if (output.empty())
+	{
+		output = video.substr(0, video.find_last_of('.')) + "_replay_frames.bin";
+	}
+
+	double fps = replay.getFramerate() > 0 ? replay.getFramerate() : 30.;
+
+	BarcodeDecoder decoder;
+	decoder.setSampleRate(sampleRate);
+	decoder.setNumBits(barcodeBits);
+	decoder.setNominalFramerate(fps);
+
+	FrameMatcher matcher;
+	matcher.setSampleRate(sampleRate);
+	matcher.setNominalFramerate(fps);
+
+	replay.setSampleRate(sampleRate);
+	replay.setSpeed(speed);
+	replay.setStrobe(0.001, barcodeInterval, decoder.getNumBits(), 0.0002, 0.0005, 0.0002);
+	replay.start(0);
+
+	std::vector<ReplayFrame> frames;
+	std::vector<ReplayEdge> edges;
+	frames.reserve(MAX_FRAMES_PER_BLOCK);
+	edges.reserve(MAX_FRAMES_PER_BLOCK * 2 * (decoder.getNumBits() + 1));
+
+	auto t0 = std::chrono::steady_clock::now();
+	auto blockDuration = std::chrono::duration<double>(BLOCK_SIZE / sampleRate);
+	int64_t clock = 0;
+
+	// same order as RPiCam::process: edges, pulses, then frame information
+	while (!replay.isFinished())
+	{
+		clock += BLOCK_SIZE;
+
+		frames.clear();
+		edges.clear();
+		replay.advance(clock, MAX_FRAMES_PER_BLOCK, frames, edges);
+
+		for (size_t i = 0; i < edges.size(); i++)
+		{
+			decoder.addEdge(edges[i].sampleNumber, edges[i].state);
+		}
+
+		FramePulse pulse;
+		while (decoder.popPulse(pulse))
+		{
+			matcher.addPulse(pulse);
+		}
+
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			matcher.addFrame(frames[i].frameIndex, frames[i].pts);
+		}
+
+		if (speed > 0)
+		{
+			// the clock runs in real time; the replay scales it by its speed
+			std::this_thread::sleep_until(t0 + (clock / BLOCK_SIZE) * std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockDuration));
+		}
+	}
+
+	decoder.flush();
+	FramePulse pulse;
+	while (decoder.popPulse(pulse))
+	{
+		matcher.addPulse(pulse);
+	}
+
+	std::vector<FrameTableEntry> table;
+	int64_t numMatched = matcher.getNumMatched();
+	matcher.finish(table);
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	if (!FrameMatcher::writeTable(output, table, sampleRate))
+	{
+		fprintf(stderr, "%s: could not write frame table\n", output.c_str());
+		return 1;
+	}
+
+	printf("%s: %lld frames, %lld matched, %.3f s (%.0f frames/s) -> %s\n",
+		   video.c_str(), (long long) replay.getNumFrames(), (long long) numMatched,
+		   elapsed, replay.getNumFrames() / (elapsed > 0 ? elapsed : 1e-9), output.c_str());
+
+	return 0;
+}